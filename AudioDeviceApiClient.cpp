@@ -7,28 +7,33 @@
 
 #include "public/SoundAgentInterface.h"
 
+#include "internal/AllocationAccounting.h"
+#include "internal/EventTrace.h"
+#include "internal/JsonUtils.h"
 #include "internal/TimeUtil.h"
 
 #include <spdlog/spdlog.h>
 #include <string>
-#include <nlohmann/json.hpp>
 
 #include "HttpRequestDispatcherInterface.h"
 
 
 
 
-// ReSharper disable CppPassValueParameterByConstReference
 AudioDeviceApiClient::AudioDeviceApiClient(HttpRequestDispatcherInterface& processor,
-                                           std::function<std::string()> getHostNameCallback,
-                                           std::function<std::string()> getOperationSystemNameCallback
+                                           std::string_view hostName,
+                                           std::string_view operationSystemName
 )
-    : requestProcessor_(processor)  // NOLINT(performance-unnecessary-value-param)
-    , getHostNameCallback_(std::move(getHostNameCallback))
-    , getOperationSystemNameCallback_(std::move(getOperationSystemNameCallback))
+    : requestProcessor_(processor)
+    , volumeUrlSuffixTail_(std::string("/") + std::string(hostName))
 {
+    postEnvelopeHead_.push_back('{');
+    ed::AppendJsonString(postEnvelopeHead_, contracts::message_fields::HOST_NAME);
+    postEnvelopeHead_.push_back(':');
+    ed::AppendJsonString(postEnvelopeHead_, hostName);
+    AppendKey(postEnvelopeHead_, contracts::message_fields::OPERATION_SYSTEM_NAME);
+    ed::AppendJsonString(postEnvelopeHead_, operationSystemName);
 }
-// ReSharper restore CppPassValueParameterByConstReference
 
 void AudioDeviceApiClient::PostDeviceToApi(SoundDeviceEventType eventType, const SoundDeviceInterface* device, const std::string& hintPrefix) const
 {
@@ -38,59 +43,91 @@ void AudioDeviceApiClient::PostDeviceToApi(SoundDeviceEventType eventType, const
         return;
     }
 
-    const std::string hostName = getHostNameCallback_();
-    const std::string operationSystemName = getOperationSystemNameCallback_();
+    DeviceRecord record;
+    device->Read(record);
+    PostDeviceToApi(eventType, record, hintPrefix);
+}
 
-    const auto nowTime = std::chrono::system_clock::now();
-    const auto timeAsUtcString = ed::TimePointToStringAsUtc(
-        nowTime,
-        true, // insertTBetweenDateAndTime
-        true // addTimeZone
-    );
-
-    const nlohmann::json payload = {
-        {"pnpId", device->GetPnpId()},
-        {"hostName", hostName},
-        {"name", device->GetName()},
-        {"operationSystemName", operationSystemName},
-        {"flowType", device->GetFlow()},
-        {"renderVolume", device->GetCurrentRenderVolume()},
-        {"captureVolume", device->GetCurrentCaptureVolume()},
-        {contracts::message_fields::UPDATE_DATE, timeAsUtcString},
-        {contracts::message_fields::DEVICE_MESSAGE_TYPE, eventType}
-    };
-
-    // Convert nlohmann::json to string and to value
-    const std::string payloadString = payload.dump();
-    const auto hint = hintPrefix + "Post a device." + device->GetPnpId();
+void AudioDeviceApiClient::PostDeviceToApi(SoundDeviceEventType eventType, const DeviceRecord& device, const std::string& hintPrefix) const
+{
+    ALLOCATION_SCOPE(AudioDeviceApiClient);
+    ed::tracing::CurrentEventTrace().CompleteStage(ed::tracing::EventStage::Dispatch);
+
+    const auto& pnpId = device.pnpId;
+    const auto& name = device.name;
+
+    // Splice the variable fields into the pre-serialized envelope
+    std::string payloadString;
+    payloadString.reserve(postEnvelopeHead_.size() + pnpId.size() + name.size() + 192);
+    payloadString.append(postEnvelopeHead_);
+    AppendKey(payloadString, contracts::message_fields::PNP_ID);
+    ed::AppendJsonString(payloadString, pnpId);
+    AppendKey(payloadString, contracts::message_fields::NAME);
+    ed::AppendJsonString(payloadString, name);
+    AppendKey(payloadString, contracts::message_fields::FLOW_TYPE);
+    ed::AppendJsonNumber(payloadString, device.flow);
+    AppendKey(payloadString, contracts::message_fields::RENDER_VOLUME);
+    ed::AppendJsonNumber(payloadString, device.renderVolume);
+    AppendKey(payloadString, contracts::message_fields::CAPTURE_VOLUME);
+    ed::AppendJsonNumber(payloadString, device.captureVolume);
+    AppendUpdateDate(payloadString);
+    AppendKey(payloadString, contracts::message_fields::DEVICE_MESSAGE_TYPE);
+    ed::AppendJsonNumber(payloadString, eventType);
+    payloadString.push_back('}');
+
+    const auto hint = hintPrefix + "Post a device." + pnpId;
 
     spdlog::info("Enqueueing: {}...", hint);
 
-    requestProcessor_.EnqueueRequest(true, "", payloadString, hint);
+    requestProcessor_.EnqueueRequest(true, pnpId, "", payloadString, hint);
 }
 
 void AudioDeviceApiClient::PutVolumeChangeToApi(const std::string & pnpId, bool renderOrCapture, uint16_t volume, const std::string& hintPrefix) const
 {
-    const auto nowTime = std::chrono::system_clock::now();
-    const auto timeAsUtcString = ed::TimePointToStringAsUtc(
-        nowTime,
-        true, // insertTBetweenDateAndTime
-        true // addTimeZone
-    );
-
-    const nlohmann::json payload = {
-        {contracts::message_fields::DEVICE_MESSAGE_TYPE, renderOrCapture ? SoundDeviceEventType::VolumeRenderChanged : SoundDeviceEventType::VolumeCaptureChanged},
-        {contracts::message_fields::VOLUME, volume},
-        {contracts::message_fields::UPDATE_DATE, timeAsUtcString }
-    };
-    const std::string payloadString = payload.dump();
+    ALLOCATION_SCOPE(AudioDeviceApiClient);
+    ed::tracing::CurrentEventTrace().CompleteStage(ed::tracing::EventStage::Dispatch);
+
+    std::string payloadString;
+    payloadString.reserve(128);
+    payloadString.push_back('{');
+    ed::AppendJsonString(payloadString, contracts::message_fields::DEVICE_MESSAGE_TYPE);
+    payloadString.push_back(':');
+    ed::AppendJsonNumber(payloadString, renderOrCapture ? SoundDeviceEventType::VolumeRenderChanged : SoundDeviceEventType::VolumeCaptureChanged);
+    AppendKey(payloadString, contracts::message_fields::VOLUME);
+    ed::AppendJsonNumber(payloadString, volume);
+    AppendUpdateDate(payloadString);
+    payloadString.push_back('}');
 
     const auto hint = hintPrefix + "Volume change (PUT) for a device: " + pnpId;
     spdlog::info("Enqueueing: {}...", hint);
     // Instead of sending directly, enqueue the request in the processor
 
-    const auto urlSuffix = std::format("/{}/{}", pnpId, getHostNameCallback_());
+    const auto urlSuffix = "/" + pnpId + volumeUrlSuffixTail_;
 
-    requestProcessor_.EnqueueRequest(false, urlSuffix, payloadString, hint);
+    requestProcessor_.EnqueueRequest(false, pnpId, urlSuffix, payloadString, hint);
 }
 
+void AudioDeviceApiClient::AppendKey(std::string& payload, std::string_view key)
+{
+    payload.push_back(',');
+    ed::AppendJsonString(payload, key);
+    payload.push_back(':');
+}
+
+void AudioDeviceApiClient::AppendUpdateDate(std::string& payload)
+{
+    const auto& trace = ed::tracing::CurrentEventTrace();
+    const auto updateDate = trace.IsTraced()
+        ? ed::tracing::ToSystemTime(trace.captureTime)
+        : std::chrono::system_clock::now();
+
+    char timeAsUtcBuffer[ed::CachedTimestampFormatter::MAX_LENGTH];
+    const std::string_view timeAsUtcString(timeAsUtcBuffer, ed::ThreadLocalTimestampFormatter(
+        true, // utcOrLocal
+        true, // insertTBetweenDateAndTime
+        true // addTimeZone
+    ).Format(updateDate, timeAsUtcBuffer));
+
+    AppendKey(payload, contracts::message_fields::UPDATE_DATE);
+    ed::AppendJsonString(payload, timeAsUtcString);
+}
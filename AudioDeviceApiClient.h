@@ -1,7 +1,7 @@
 ﻿#pragma once
 
-#include <functional>
-#include <memory>
+#include <string>
+#include <string_view>
 
 #include "public/SoundAgentInterface.h"
 
@@ -13,17 +13,28 @@ class SoundDeviceInterface;
 class AudioDeviceApiClient {
 public:
     AudioDeviceApiClient(HttpRequestDispatcherInterface &processor,
-                         std::function<std::string()> getHostNameCallback,
-                         std::function<std::string()> getOperationSystemNameCallback
+                         std::string_view hostName,
+                         std::string_view operationSystemName
     );
 
+    void PostDeviceToApi(SoundDeviceEventType eventType, const DeviceRecord& device,
+                         const std::string& hintPrefix) const;
     void PostDeviceToApi(SoundDeviceEventType eventType, const SoundDeviceInterface* device,
                          const std::string& hintPrefix) const;
     void PutVolumeChangeToApi(const std::string& pnpId, bool renderOrCapture, uint16_t volume,
                               const std::string& hintPrefix) const;
 
+private:
+    // Appends ,"<key>": to a payload being spliced
+    static void AppendKey(std::string& payload, std::string_view key);
+    // The update date of a traced event is its capture time rather than the time of serializing
+    static void AppendUpdateDate(std::string& payload);
+
 private:
     HttpRequestDispatcherInterface& requestProcessor_;
-    std::function<std::string()> getHostNameCallback_;
-    std::function<std::string()> getOperationSystemNameCallback_;
+
+    // The invariant part of the payloads, serialized once: {"hostName":"...","operationSystemName":"..."
+    std::string postEnvelopeHead_;
+    // "/<hostName>", appended to the PnP id in a volume change URL suffix
+    std::string volumeUrlSuffixTail_;
 };
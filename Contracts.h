@@ -7,6 +7,14 @@ namespace contracts::message_fields
     inline constexpr std::string_view HTTP_REQUEST = "httpRequest";
     inline constexpr std::string_view URL_SUFFIX = "urlSuffix";
 
+    inline constexpr std::string_view PNP_ID = "pnpId";
+    inline constexpr std::string_view HOST_NAME = "hostName";
+    inline constexpr std::string_view NAME = "name";
+    inline constexpr std::string_view OPERATION_SYSTEM_NAME = "operationSystemName";
+    inline constexpr std::string_view FLOW_TYPE = "flowType";
+    inline constexpr std::string_view RENDER_VOLUME = "renderVolume";
+    inline constexpr std::string_view CAPTURE_VOLUME = "captureVolume";
+
     inline constexpr std::string_view DEVICE_MESSAGE_TYPE = "deviceMessageType";
     inline constexpr std::string_view VOLUME = "volume";
     inline constexpr std::string_view UPDATE_DATE = "updateDate";
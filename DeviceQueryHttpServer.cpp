@@ -0,0 +1,337 @@
+#include "os-dependencies.h"
+
+#include "DeviceQueryHttpServer.h"
+
+#include "internal/JsonUtils.h"
+
+#include <Poco/Net/HTTPRequestHandler.h>
+#include <Poco/Net/HTTPRequestHandlerFactory.h>
+#include <Poco/Net/HTTPServer.h>
+#include <Poco/Net/HTTPServerParams.h>
+#include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/Net/HTTPServerResponse.h>
+#include <Poco/Net/ServerSocket.h>
+#include <Poco/Net/SocketAddress.h>
+#include <Poco/URI.h>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <charconv>
+#include <ostream>
+#include <ranges>
+
+
+class DeviceQueryHttpServer::RequestHandler final : public Poco::Net::HTTPRequestHandler
+{
+public:
+    explicit RequestHandler(DeviceQueryHttpServer& server)
+        : server_(server)
+    {
+    }
+
+    void handleRequest(Poco::Net::HTTPServerRequest& request, Poco::Net::HTTPServerResponse& response) override
+    {
+        using Poco::Net::HTTPResponse;
+
+        if (request.getMethod() != Poco::Net::HTTPRequest::HTTP_GET)
+        {
+            Send(response, HTTPResponse::HTTP_METHOD_NOT_ALLOWED, "", R"({"error":"Only GET is supported"})");
+            return;
+        }
+
+        const Poco::URI uri(request.getURI());
+        const auto& path = uri.getPath();
+
+        if (path == DEVICES_PATH)
+        {
+            std::string sinceValue;
+            for (const auto& [key, value] : uri.getQueryParameters())
+            {
+                if (key == "since")
+                {
+                    sinceValue = value;
+                }
+            }
+
+            if (sinceValue.empty())
+            {
+                uint64_t version = 0;
+                const auto document = server_.GetDevicesDocument(version);
+                const auto etag = fmt::format("\"{}\"", version);
+                if (IsNotModified(request, etag))
+                {
+                    Send(response, HTTPResponse::HTTP_NOT_MODIFIED, etag, "");
+                    return;
+                }
+                Send(response, HTTPResponse::HTTP_OK, etag, *document);
+                return;
+            }
+
+            uint64_t sinceVersion = 0;
+            if (const auto [ptr, ec] = std::from_chars(sinceValue.data(), sinceValue.data() + sinceValue.size(), sinceVersion);
+                ec != std::errc() || ptr != sinceValue.data() + sinceValue.size())
+            {
+                Send(response, HTTPResponse::HTTP_BAD_REQUEST, "", R"({"error":"Invalid since value"})");
+                return;
+            }
+
+            uint64_t version = 0;
+            const auto document = server_.GetDevicesDeltaDocument(sinceVersion, version);
+            const auto etag = fmt::format("\"{}-{}\"", sinceVersion, version);
+            if (IsNotModified(request, etag))
+            {
+                Send(response, HTTPResponse::HTTP_NOT_MODIFIED, etag, "");
+                return;
+            }
+            Send(response, HTTPResponse::HTTP_OK, etag, document);
+            return;
+        }
+
+        if (constexpr std::string_view devicePrefix = DEVICE_PATH_PREFIX;
+            path.starts_with(devicePrefix) && path.size() > devicePrefix.size())
+        {
+            const auto pnpId = path.substr(devicePrefix.size());
+            std::string document;
+            uint64_t changedVersion = 0;
+            if (!server_.GetDeviceDocument(pnpId, document, changedVersion))
+            {
+                Send(response, HTTPResponse::HTTP_NOT_FOUND, "", R"({"error":"Device not found"})");
+                return;
+            }
+            const auto etag = fmt::format("\"{}\"", changedVersion);
+            if (IsNotModified(request, etag))
+            {
+                Send(response, HTTPResponse::HTTP_NOT_MODIFIED, etag, "");
+                return;
+            }
+            Send(response, HTTPResponse::HTTP_OK, etag, document);
+            return;
+        }
+
+        Send(response, HTTPResponse::HTTP_NOT_FOUND, "", R"({"error":"Unknown resource"})");
+    }
+
+private:
+    static bool IsNotModified(const Poco::Net::HTTPServerRequest& request, const std::string& etag)
+    {
+        const std::string ifNoneMatch = request.get("If-None-Match", "");
+        return !ifNoneMatch.empty() && (ifNoneMatch == "*" || ifNoneMatch.find(etag) != std::string::npos);
+    }
+
+    static void Send(Poco::Net::HTTPServerResponse& response, Poco::Net::HTTPResponse::HTTPStatus status,
+                     const std::string& etag, const std::string& body)
+    {
+        response.setStatus(status);
+        response.set("Cache-Control", "no-cache");
+        if (!etag.empty())
+        {
+            response.set("ETag", etag);
+        }
+        if (status == Poco::Net::HTTPResponse::HTTP_NOT_MODIFIED)
+        {
+            response.setContentLength(0);
+            response.send();
+            return;
+        }
+        response.setContentType("application/json");
+        response.setContentLength(static_cast<std::streamsize>(body.size()));
+        response.send().write(body.data(), static_cast<std::streamsize>(body.size()));
+    }
+
+private:
+    static constexpr auto DEVICES_PATH = "/devices";
+    static constexpr auto DEVICE_PATH_PREFIX = "/devices/";
+
+    DeviceQueryHttpServer& server_;
+};
+
+class DeviceQueryHttpServer::RequestHandlerFactory final : public Poco::Net::HTTPRequestHandlerFactory
+{
+public:
+    explicit RequestHandlerFactory(DeviceQueryHttpServer& server)
+        : server_(server)
+    {
+    }
+
+    Poco::Net::HTTPRequestHandler* createRequestHandler(const Poco::Net::HTTPServerRequest&) override
+    {
+        return new RequestHandler(server_);
+    }
+
+private:
+    DeviceQueryHttpServer& server_;
+};
+
+
+DeviceQueryHttpServer::DeviceQueryHttpServer(SoundDeviceCollectionInterface& collection, const std::string& address,
+                                             uint16_t port)
+    : collection_(collection)
+    , address_(address)
+    , port_(port)
+    , cachedDocument_(std::make_shared<const std::string>(R"({"version":0,"devices":[]})"))
+{
+}
+
+DeviceQueryHttpServer::~DeviceQueryHttpServer()
+{
+    Stop();
+}
+
+void DeviceQueryHttpServer::Start()
+{
+    if (httpServer_)
+    {
+        return;
+    }
+
+    const Poco::Net::ServerSocket serverSocket(Poco::Net::SocketAddress(address_, port_));
+
+    auto* params = new Poco::Net::HTTPServerParams;
+    params->setMaxThreads(2);
+    params->setMaxQueued(16);
+
+    httpServer_ = std::make_unique<Poco::Net::HTTPServer>(new RequestHandlerFactory(*this), serverSocket, params);
+    httpServer_->start();
+    spdlog::info("Device query HTTP server listening on {}:{}.", address_, port_);
+}
+
+void DeviceQueryHttpServer::Stop()
+{
+    if (!httpServer_)
+    {
+        return;
+    }
+
+    httpServer_->stopAll(true);
+    httpServer_.reset();
+    spdlog::info("Device query HTTP server stopped.");
+}
+
+void DeviceQueryHttpServer::OnCollectionChanged(SoundDeviceEventType event, const std::string& devicePnpId)
+{
+    // Entries share the collection's version, so "since" values are interchangeable with GetChangesSince
+    if (event == SoundDeviceEventType::Detached)
+    {
+        const auto collectionVersion = collection_.GetVersion();
+        std::lock_guard lock(guard_);
+        if (pnpToEntryMap_.erase(devicePnpId) != 0)
+        {
+            pnpToRemovedVersionMap_[devicePnpId] = collectionVersion;
+            version_ = std::max(version_, collectionVersion);
+        }
+        return;
+    }
+
+    if (!collection_.TryFind(devicePnpId, deviceRecord_))
+    {
+        return;
+    }
+
+    auto document = SerializeDevice(deviceRecord_);
+    const auto collectionVersion = collection_.GetVersion();
+
+    std::lock_guard lock(guard_);
+    pnpToRemovedVersionMap_.erase(devicePnpId);
+    auto& entry = pnpToEntryMap_[devicePnpId];
+    entry.document = std::move(document);
+    entry.changedVersion = collectionVersion;
+    version_ = std::max(version_, collectionVersion);
+}
+
+std::shared_ptr<const std::string> DeviceQueryHttpServer::GetDevicesDocument(uint64_t& version)
+{
+    std::lock_guard lock(guard_);
+    version = version_;
+    if (cachedDocumentVersion_ != version_)
+    {
+        std::string document = fmt::format(R"({{"version":{},"devices":[)", version_);
+        bool isFirst = true;
+        for (const auto& entry : pnpToEntryMap_ | std::views::values)
+        {
+            if (!isFirst)
+            {
+                document.push_back(',');
+            }
+            isFirst = false;
+            document += entry.document;
+        }
+        document += "]}";
+
+        cachedDocument_ = std::make_shared<const std::string>(std::move(document));
+        cachedDocumentVersion_ = version_;
+    }
+    return cachedDocument_;
+}
+
+std::string DeviceQueryHttpServer::GetDevicesDeltaDocument(uint64_t sinceVersion, uint64_t& version) const
+{
+    std::lock_guard lock(guard_);
+    version = version_;
+
+    std::string document = fmt::format(R"({{"version":{},"since":{},"devices":[)", version_, sinceVersion);
+    bool isFirst = true;
+    for (const auto& entry : pnpToEntryMap_ | std::views::values)
+    {
+        if (entry.changedVersion <= sinceVersion)
+        {
+            continue;
+        }
+        if (!isFirst)
+        {
+            document.push_back(',');
+        }
+        isFirst = false;
+        document += entry.document;
+    }
+    document += R"(],"removed":[)";
+    isFirst = true;
+    for (const auto& [pnpId, removedVersion] : pnpToRemovedVersionMap_)
+    {
+        if (removedVersion <= sinceVersion)
+        {
+            continue;
+        }
+        if (!isFirst)
+        {
+            document.push_back(',');
+        }
+        isFirst = false;
+        ed::AppendJsonString(document, pnpId);
+    }
+    document += "]}";
+    return document;
+}
+
+bool DeviceQueryHttpServer::GetDeviceDocument(const std::string& pnpId, std::string& document,
+                                              uint64_t& changedVersion) const
+{
+    std::lock_guard lock(guard_);
+    const auto foundPair = pnpToEntryMap_.find(pnpId);
+    if (foundPair == pnpToEntryMap_.end())
+    {
+        return false;
+    }
+    document = foundPair->second.document;
+    changedVersion = foundPair->second.changedVersion;
+    return true;
+}
+
+std::string DeviceQueryHttpServer::SerializeDevice(const DeviceRecord& device)
+{
+    // Device strings are valid UTF-8 by contract, so they are spliced without a validating serializer
+    std::string document;
+    document.reserve(device.pnpId.size() + device.name.size() + 96);
+    document.append(R"({"pnpId":)");
+    ed::AppendJsonString(document, device.pnpId);
+    document.append(R"(,"name":)");
+    ed::AppendJsonString(document, device.name);
+    document.append(R"(,"flowType":)");
+    ed::AppendJsonNumber(document, device.flow);
+    document.append(R"(,"renderVolume":)");
+    ed::AppendJsonNumber(document, device.renderVolume);
+    document.append(R"(,"captureVolume":)");
+    ed::AppendJsonNumber(document, device.captureVolume);
+    document.push_back('}');
+    return document;
+}
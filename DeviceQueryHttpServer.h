@@ -0,0 +1,66 @@
+#pragma once
+
+#include "public/SoundAgentInterface.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Poco::Net
+{
+    class HTTPServer;
+}
+
+// Optional read-only HTTP view of the device table:
+//   GET /devices                  - all devices, served from a cached document
+//   GET /devices?since=<version>  - only the devices changed after <version>, and the PnP ids removed since
+//   GET /devices/{pnpId}          - a single device
+// Every response carries an ETag; a matching If-None-Match is answered with 304.
+class DeviceQueryHttpServer final : public SoundDeviceObserverInterface
+{
+    class RequestHandler;
+    class RequestHandlerFactory;
+
+public:
+    DeviceQueryHttpServer(SoundDeviceCollectionInterface& collection, const std::string& address, uint16_t port);
+
+    DISALLOW_COPY_MOVE(DeviceQueryHttpServer);
+    ~DeviceQueryHttpServer() override;
+
+    void Start();
+    void Stop();
+
+public:
+    void OnCollectionChanged(SoundDeviceEventType event, const std::string& devicePnpId) override;
+
+private:
+    struct DeviceEntry
+    {
+        std::string document;
+        uint64_t changedVersion = 0;
+    };
+
+    // Thread-safe, called by the HTTP worker threads
+    [[nodiscard]] std::shared_ptr<const std::string> GetDevicesDocument(uint64_t& version);
+    [[nodiscard]] std::string GetDevicesDeltaDocument(uint64_t sinceVersion, uint64_t& version) const;
+    [[nodiscard]] bool GetDeviceDocument(const std::string& pnpId, std::string& document, uint64_t& changedVersion) const;
+
+    static std::string SerializeDevice(const DeviceRecord& device);
+
+private:
+    SoundDeviceCollectionInterface& collection_;
+    std::string address_;
+    uint16_t port_;
+    std::unique_ptr<Poco::Net::HTTPServer> httpServer_;
+    DeviceRecord deviceRecord_; // Used by the collection's loop thread only
+
+    mutable std::mutex guard_;
+    uint64_t version_ = 0;
+    std::unordered_map<std::string, DeviceEntry> pnpToEntryMap_;
+    // The version a device was detached at, kept for the deltas until the device is reported again
+    std::unordered_map<std::string, uint64_t> pnpToRemovedVersionMap_;
+    std::shared_ptr<const std::string> cachedDocument_;
+    uint64_t cachedDocumentVersion_ = 0;
+};
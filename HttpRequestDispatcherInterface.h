@@ -2,6 +2,7 @@
 
 #include "internal/ClassDefHelper.h"
 
+#include <chrono>
 #include <string>
 
 class HttpRequestDispatcherInterface
@@ -9,10 +10,16 @@ class HttpRequestDispatcherInterface
 public:
     virtual void EnqueueRequest(
         bool postOrPut,
+        const std::string& devicePnpId,
         const std::string& urlSuffix,
         const std::string& payload,
         const std::string& hint
     ) = 0;
+    // Upstream stages may shed optional work while the dispatcher is congested
+    [[nodiscard]] virtual bool IsUnderBackpressure() const = 0;
+    // Shutdown: stops taking requests and delivers the queued ones until the deadline; called once
+    virtual void Drain(std::chrono::steady_clock::time_point deadline) = 0;
+
     AS_INTERFACE(HttpRequestDispatcherInterface);
     DISALLOW_COPY_MOVE(HttpRequestDispatcherInterface);
 };
@@ -4,19 +4,42 @@
 #include <Poco/Util/Option.h>
 #include <Poco/Util/OptionSet.h>
 #include <Poco/Util/HelpFormatter.h>
+#include <Poco/Util/XMLConfiguration.h>
+#include <Poco/Net/HTTPClientSession.h>
+#include <Poco/Net/HTTPRequest.h>
+#include <Poco/Net/HTTPResponse.h>
 #include <Poco/Task.h>
 #include <Poco/String.h>
+#include <Poco/StringTokenizer.h>
+#include <Poco/AutoPtr.h>
+#include <Poco/Exception.h>
+#include <Poco/Path.h>
 
 #include <iostream>
 #include <csignal>
 #include <atomic>
+#include <chrono>
 #include <memory>
+#include <algorithm>
+#include <limits>
+#include <optional>
 
 #include "cpversion.h"
 #include "ServiceObserver.h"
 #include "RabbitMqHttpRequestDispatcher.h"
+#include "RelayHttpRequestDispatcher.h"
+#include "RelayServer.h"
+#include "DeviceQueryHttpServer.h"
+#include "MetricsHttpServer.h"
+#include "internal/AllocationAccounting.h"
+#include "internal/Metrics.h"
+#include "internal/PrivatePaths.h"
+#include "internal/StallWatchdog.h"
+#include "internal/StartupTrace.h"
 #include "SoundLibRuntimeSettings.h"
 
+#include "magic_enum/magic_enum.hpp"
+
 
 using Poco::Util::Application;
 using Poco::Util::Option;
@@ -26,39 +49,21 @@ using Poco::Util::HelpFormatter;
 class LinuxSoundScanner final : public Application
 {
 protected:
-    static std::function<void()> deactivateCallback_;
-    static void SignalHandler(int) {
-        if (deactivateCallback_) {
-            deactivateCallback_();
-        }
-    }
-
-    static void SetupSignalHandlers(
-        const std::function<void()> & deactivateCallback
-    )
-    {
-        deactivateCallback_ = deactivateCallback;
-        std::signal(SIGTERM, SignalHandler);
-        std::signal(SIGINT, SignalHandler);
-    }
-
     void initialize(Application& self) override
     {
-        loadConfiguration();
+        auto& startupTrace = ed::StartupTrace::Inst();
+        startupTrace.EndPhase("process loading");
+        LoadConfigurationFile();
         Application::initialize(self);
+        startupTrace.EndPhase("configuration");
 
-        SetUpLog();
+        if (healthCheckRequested_)
+        {
+            return; // A short-lived probe: no log file
+        }
 
-        SoundLibRuntimeSettings::SetPulseAudioReconnectionEnabled(
-            config().hasProperty(API_PULSE_AUDIO_RECONNECTION_PROPERTY_KEY)
-                ? config().getBool(API_PULSE_AUDIO_RECONNECTION_PROPERTY_KEY)
-                : DEFAULT_PULSE_AUDIO_RECONNECTION_ENABLED
-        );
-        SoundLibRuntimeSettings::SetPulseAudioInitialReconnectDelayMs(
-            config().hasProperty(API_INITIAL_RECONNECT_DELAY_MS_PROPERTY_KEY)
-                ? config().getUInt(API_INITIAL_RECONNECT_DELAY_MS_PROPERTY_KEY)
-                : DEFAULT_INITIAL_RECONNECT_DELAY_MS
-        );
+        ApplyRuntimeSettings(ReadRuntimeSettings());
+        SetUpLog();
 
         if (transportMethod_.empty())
         {   // If no transport method is provided via command line, read it from the configuration
@@ -68,6 +73,7 @@ protected:
 
         if (Poco::icompare(transportMethod_, API_TRANSPORT_METHOD_PROPERTY_VALUE00_NONE) != 0
             && Poco::icompare(transportMethod_, API_TRANSPORT_METHOD_PROPERTY_VALUE02_RABBITMQ) != 0
+            && Poco::icompare(transportMethod_, API_TRANSPORT_METHOD_PROPERTY_VALUE03_RELAY) != 0
         )
         {
             spdlog::info(R"(Invalid transport method "{}". Set it to "{}".)", transportMethod_, API_TRANSPORT_METHOD_PROPERTY_VALUE00_NONE);
@@ -77,20 +83,184 @@ protected:
         {
             spdlog::info(R"(Transport method value "{}" validated.)", transportMethod_);
         }
+        startupTrace.EndPhase("settings");
+    }
+
+    void uninitialize() override
+    {
+        ed::watchdog::StallWatchdog::Inst().Stop();
+        Application::uninitialize();
+    }
+
+    // The settings that can change at run time (SIGHUP): none of them needs a reconnect
+    struct RuntimeSettings
+    {
+        spdlog::level::level_enum logLevel;
+        spdlog::level::level_enum flushLevel;
+        std::chrono::seconds flushInterval;
+        bool isDeferredFormattingEnabled;
+        std::chrono::milliseconds stallThreshold;
+        bool isPulseAudioReconnectionEnabled;
+        uint32_t initialReconnectDelayMs;
+    };
+
+    // Throws Poco::Exception on a malformed value; applies nothing
+    [[nodiscard]] RuntimeSettings ReadRuntimeSettings() const
+    {
+        const auto& logger = ed::model::Logger::Inst();
+        return {
+            ReadLogLevel(API_LOG_LEVEL_PROPERTY_KEY, logger.GetLevel()),
+            ReadLogLevel(API_LOG_FLUSH_LEVEL_PROPERTY_KEY, logger.GetFlushLevel()),
+            std::chrono::seconds(config().hasProperty(API_LOG_FLUSH_INTERVAL_PROPERTY_KEY)
+                ? config().getUInt(API_LOG_FLUSH_INTERVAL_PROPERTY_KEY)
+                : logger.GetFlushInterval().count()),
+            config().hasProperty(API_LOG_DEFERRED_FORMATTING_PROPERTY_KEY)
+                ? config().getBool(API_LOG_DEFERRED_FORMATTING_PROPERTY_KEY)
+                : DEFAULT_LOG_DEFERRED_FORMATTING,
+            std::chrono::milliseconds(config().hasProperty(API_WATCHDOG_STALL_THRESHOLD_MS_PROPERTY_KEY)
+                ? config().getUInt(API_WATCHDOG_STALL_THRESHOLD_MS_PROPERTY_KEY)
+                : DEFAULT_WATCHDOG_STALL_THRESHOLD_MS),
+            config().hasProperty(API_PULSE_AUDIO_RECONNECTION_PROPERTY_KEY)
+                ? config().getBool(API_PULSE_AUDIO_RECONNECTION_PROPERTY_KEY)
+                : DEFAULT_PULSE_AUDIO_RECONNECTION_ENABLED,
+            config().hasProperty(API_INITIAL_RECONNECT_DELAY_MS_PROPERTY_KEY)
+                ? config().getUInt(API_INITIAL_RECONNECT_DELAY_MS_PROPERTY_KEY)
+                : DEFAULT_INITIAL_RECONNECT_DELAY_MS
+        };
+    }
+
+    // Applied on the loop thread after the start; the library settings are atomics read there too
+    static void ApplyRuntimeSettings(const RuntimeSettings& settings)
+    {
+        ed::model::Logger::Inst()
+            .SetLevel(settings.logLevel)
+            .SetFlushPolicy(settings.flushLevel, settings.flushInterval);
+        ed::model::DeferredLog::Inst().SetEnabled(settings.isDeferredFormattingEnabled);
+
+        if (auto& watchdog = ed::watchdog::StallWatchdog::Inst();
+            settings.stallThreshold != watchdog.GetStallThreshold())
+        {
+            watchdog.Start(settings.stallThreshold);
+        }
+
+        SoundLibRuntimeSettings::SetPulseAudioReconnectionEnabled(settings.isPulseAudioReconnectionEnabled);
+        SoundLibRuntimeSettings::SetPulseAudioInitialReconnectDelayMs(settings.initialReconnectDelayMs);
+    }
+
+    // As loadConfiguration() does for the XML file, but labeled so that a reload replaces this layer
+    // rather than stacking on it: a key deleted from the file must fall back to its default, not to its value at start
+    void LoadConfigurationFile()
+    {
+        Poco::Path configPath(config().getString("application.baseName") + ".xml");
+        if (!findFile(configPath))
+        {
+            return;
+        }
+        config().add(new Poco::Util::XMLConfiguration(configPath.toString()), CONFIGURATION_FILE_LABEL, PRIO_DEFAULT);
+        config().setString("application.configDir", configPath.absolute().parent().toString());
+    }
+
+    // SIGHUP: re-reads the configuration file and applies the runtime settings, without touching the connections.
+    // All or nothing: every value is read before any is applied; on an error the previous configuration stays.
+    void ReloadConfiguration(RabbitMqHttpRequestDispatcher* rabbitMqDispatcher)
+    {
+        spdlog::info("Reloading the configuration...");
+        Poco::AutoPtr<Poco::Util::AbstractConfiguration> previousConfig;
+        RuntimeSettings runtimeSettings{};
+        std::optional<RequestPublisherSettings> requestPublisherSettings;
+        try
+        {
+            if (!config().hasProperty("application.configDir"))
+            {
+                throw Poco::FileNotFoundException("no configuration file was loaded at start");
+            }
+            // Takes the place of the file layer, so that the keys deleted from the file fall back to their defaults
+            const Poco::Path configPath(config().getString("application.configDir"),
+                                        config().getString("application.baseName") + ".xml");
+            const Poco::AutoPtr<Poco::Util::AbstractConfiguration> reloadedConfig(
+                new Poco::Util::XMLConfiguration(configPath.toString()));
+            previousConfig = config().find(CONFIGURATION_FILE_LABEL);
+            if (previousConfig)
+            {
+                config().removeConfiguration(previousConfig);
+            }
+            config().add(reloadedConfig, CONFIGURATION_FILE_LABEL, PRIO_DEFAULT);
+
+            runtimeSettings = ReadRuntimeSettings();
+            if (rabbitMqDispatcher != nullptr)
+            {
+                requestPublisherSettings = ReadRequestPublisherSettings();
+            }
+        }
+        catch (const Poco::Exception& ex)
+        {
+            spdlog::error("Configuration not reloaded: {}", ex.displayText());
+            RestoreConfiguration(previousConfig);
+            return;
+        }
+        catch (const std::exception& ex)
+        {
+            spdlog::error("Configuration not reloaded: {}", ex.what());
+            RestoreConfiguration(previousConfig);
+            return;
+        }
+
+        ApplyRuntimeSettings(runtimeSettings);
+        if (requestPublisherSettings.has_value())
+        {
+            rabbitMqDispatcher->UpdateSettings(requestPublisherSettings.value());
+        }
+        spdlog::info("Configuration reloaded: log level {}, PulseAudio reconnection {} ({} ms), stall threshold {} ms.",
+                     spdlog::level::to_string_view(runtimeSettings.logLevel),
+                     runtimeSettings.isPulseAudioReconnectionEnabled ? "on" : "off",
+                     runtimeSettings.initialReconnectDelayMs,
+                     runtimeSettings.stallThreshold.count());
+    }
+
+    // Puts back the file layer in use before the reload
+    void RestoreConfiguration(const Poco::AutoPtr<Poco::Util::AbstractConfiguration>& previousConfig)
+    {
+        if (const auto reloadedConfig = config().find(CONFIGURATION_FILE_LABEL))
+        {
+            config().removeConfiguration(reloadedConfig);
+        }
+        if (previousConfig)
+        {
+            config().add(previousConfig, CONFIGURATION_FILE_LABEL, PRIO_DEFAULT);
+        }
     }
 
-    static void SetUpLog()
+    void SetUpLog() const
     {
         constexpr auto appName = "LinuxSoundScanner";
-        ed::model::Logger::Inst().ConfigureAppNameAndVersion(appName, VERSION).SetOutputToConsole(true);
+        ed::model::Logger::Inst()
+            .SetRotationPolicy(
+                ed::model::Logger::Inst().GetMaxFileSize(), ed::model::Logger::Inst().GetMaxFiles(),
+                static_cast<uint64_t>(config().hasProperty(API_LOG_COMPRESSED_RETENTION_MB_PROPERTY_KEY)
+                    ? config().getUInt(API_LOG_COMPRESSED_RETENTION_MB_PROPERTY_KEY)
+                    : DEFAULT_LOG_COMPRESSED_RETENTION_MB) * 1024 * 1024)
+            .ConfigureAppNameAndVersion(appName, VERSION).SetOutputToConsole(true);
+        ed::StartupTrace::Inst().EndPhase("log set-up: console");
         try
         {
+            const auto retentionPolicy = ReadLogRetentionPolicy();
+            ed::utility::LogRetentionResult retentionResult;
+            ed::utility::LogRetentionResult archiveRetentionResult;
             if (std::filesystem::path logFile;
                 ed::utility::AppPath::GetAndValidateLogFilePathName(
-                    logFile, appName)
+                    logFile, appName, retentionPolicy, &retentionResult, &archiveRetentionResult)
             )
             {
                 ed::model::Logger::Inst().SetPathName(logFile);
+                spdlog::info("Log retention: {} old log file(s) kept ({} bytes), {} removed ({} bytes).",
+                             retentionResult.keptFileCount, retentionResult.keptBytes,
+                             retentionResult.removedFileCount, retentionResult.removedBytes);
+                if (retentionPolicy.action == ed::utility::LogRetentionAction::Archive)
+                {
+                    spdlog::info("Log retention: {} archived log file(s) kept ({} bytes), {} deleted ({} bytes).",
+                                 archiveRetentionResult.keptFileCount, archiveRetentionResult.keptBytes,
+                                 archiveRetentionResult.removedFileCount, archiveRetentionResult.removedBytes);
+                }
             }
             else
             {
@@ -101,6 +271,7 @@ protected:
         {
             spdlog::warn("Logging set-up partially done; Log file can not be used: {}.", ex.what());
         }
+        ed::StartupTrace::Inst().EndPhase("log set-up: retention and file");
     }
 
 
@@ -110,12 +281,24 @@ protected:
         Application::defineOptions(options);
 
         options.addOption(
-            Poco::Util::Option("transport", "", "Transport method: None or RabbitMQ")
+            Poco::Util::Option("transport", "", "Transport method: None, RabbitMQ or Relay")
             .required(false)
             .repeatable(false)
             .argument("<transport>", true)
             .callback(Poco::Util::OptionCallback<LinuxSoundScanner>(this, &LinuxSoundScanner::HandleTransport)));
 
+        options.addOption(
+            Option("healthcheck", "", "Query the /health endpoint of a running instance and exit with 0 if healthy")
+            .required(false)
+            .repeatable(false)
+            .callback(Poco::Util::OptionCallback<LinuxSoundScanner>(this, &LinuxSoundScanner::HandleHealthCheck)));
+
+        options.addOption(
+            Option("startup-trace", "", "Print the duration of each startup phase once the initial inventory is published")
+            .required(false)
+            .repeatable(false)
+            .callback(Poco::Util::OptionCallback<LinuxSoundScanner>(this, &LinuxSoundScanner::HandleStartupTrace)));
+
         options.addOption(
             Option("help", "h", "Help information")
                 .required(false)
@@ -137,6 +320,58 @@ protected:
         transportMethod_ = value;
     }
 
+    void HandleHealthCheck(const std::string&, const std::string&)
+    {
+        stopOptionsProcessing();
+        healthCheckRequested_ = true;
+    }
+
+    void HandleStartupTrace(const std::string&, const std::string&)
+    {
+        startupTraceRequested_ = true;
+    }
+
+    [[nodiscard]] int RunHealthCheck() const
+    {
+        try
+        {
+            const auto port = ReadPortConfigProperty(API_METRICS_HTTP_PORT_PROPERTY_KEY, DEFAULT_METRICS_HTTP_PORT);
+            if (port == 0)
+            {
+                std::cout << "The metrics HTTP endpoint is disabled.\n";
+                return HEALTH_CHECK_FAILED_EXIT_CODE;
+            }
+
+            // A wildcard listen address is probed via the loopback interface
+            auto address = config().getString(API_METRICS_HTTP_ADDRESS_PROPERTY_KEY, DEFAULT_METRICS_HTTP_ADDRESS);
+            if (address == "0.0.0.0")
+            {
+                address = "127.0.0.1";
+            }
+
+            Poco::Net::HTTPClientSession session(address, port);
+            session.setTimeout(Poco::Timespan(HEALTH_CHECK_TIMEOUT_SECONDS, 0));
+            Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_GET, MetricsHttpServer::HEALTH_PATH,
+                                           Poco::Net::HTTPMessage::HTTP_1_1);
+            session.sendRequest(request);
+            Poco::Net::HTTPResponse response;
+            std::cout << session.receiveResponse(response).rdbuf();
+            return response.getStatus() == Poco::Net::HTTPResponse::HTTP_OK
+                ? Application::EXIT_OK
+                : HEALTH_CHECK_FAILED_EXIT_CODE;
+        }
+        catch (const Poco::Exception& ex)
+        {
+            std::cout << "Health check failed: " << ex.displayText() << "\n";
+            return HEALTH_CHECK_FAILED_EXIT_CODE;
+        }
+        catch (const std::exception& ex)
+        {
+            std::cout << "Health check failed: " << ex.what() << "\n";
+            return HEALTH_CHECK_FAILED_EXIT_CODE;
+        }
+    }
+
     void HandleHelp(const std::string&, const std::string&)
     {
         HelpFormatter helpFormatter(options());
@@ -160,10 +395,13 @@ protected:
     {
         if (onlyConsoleOutputRequested_)
             return Application::EXIT_OK;
+        if (healthCheckRequested_)
+            return RunHealthCheck();
 
         try
         {
             spdlog::info("Linux Sound Scanner {} started", VERSION); 
+            auto& startupTrace = ed::StartupTrace::Inst();
 
             const auto deviceCollectionSmartPtr = SoundAgent::CreateDeviceCollection();
             if (deviceCollectionSmartPtr == nullptr)
@@ -171,15 +409,17 @@ protected:
                 throw std::runtime_error("Failed to create device collection");
             }
             auto& collection = *deviceCollectionSmartPtr;
+            startupTrace.EndPhase("device collection");
 
             std::unique_ptr<HttpRequestDispatcherInterface> requestDispatcherSmartPtr;
+            RabbitMqHttpRequestDispatcher* rabbitMqDispatcher = nullptr; // Its queue settings can be reloaded
 
             if (Poco::icompare(transportMethod_, API_TRANSPORT_METHOD_PROPERTY_VALUE00_NONE) == 0)
             {
                 class EmptyDispatcher : public HttpRequestDispatcherInterface
                 {
                 public:
-                    void EnqueueRequest(bool,
+                    void EnqueueRequest(bool, const std::string&,
                                         const std::string&, const std::string&,
                                         const std::string&
                     ) override
@@ -187,6 +427,15 @@ protected:
                         spdlog::info("Enqueueing ignored, because the transport method is \"{}\"",
                                      API_TRANSPORT_METHOD_PROPERTY_VALUE00_NONE);
                     }
+
+                    [[nodiscard]] bool IsUnderBackpressure() const override
+                    {
+                        return false;
+                    }
+
+                    void Drain(std::chrono::steady_clock::time_point) override
+                    {
+                    }
                 };
                 requestDispatcherSmartPtr = std::make_unique<EmptyDispatcher>();
             }
@@ -195,28 +444,155 @@ protected:
                 const auto rmqHostName = ReadOptionalSimpleConfigProperty(API_RMQ_HOST_PROPERTY_KEY);
                 const auto rmqUserName = ReadOptionalSimpleConfigProperty(API_RMQ_USER_PROPERTY_KEY);
                 const auto rmqPassword = ReadOptionalSimpleConfigProperty(API_RMQ_PASSWORD_PROPERTY_KEY);
-                requestDispatcherSmartPtr = std::make_unique<RabbitMqHttpRequestDispatcher>(
+                auto rabbitMqDispatcherSmartPtr = std::make_unique<RabbitMqHttpRequestDispatcher>(
                     rmqHostName,
                     rmqUserName,
-                    rmqPassword);
+                    rmqPassword,
+                    ReadRequestPublisherSettings());
+                rabbitMqDispatcher = rabbitMqDispatcherSmartPtr.get();
+                requestDispatcherSmartPtr = std::move(rabbitMqDispatcherSmartPtr);
+            }
+            else if (Poco::icompare(transportMethod_, API_TRANSPORT_METHOD_PROPERTY_VALUE03_RELAY) == 0)
+            {
+                requestDispatcherSmartPtr = std::make_unique<RelayHttpRequestDispatcher>(ReadRelaySocketPath());
+            }
+            startupTrace.EndPhase("transport");
+
+            // Only a process owning a broker connection can relay for others
+            std::unique_ptr<RelayServer> relayServerSmartPtr;
+            if (Poco::icompare(transportMethod_, API_TRANSPORT_METHOD_PROPERTY_VALUE02_RABBITMQ) == 0
+                && (config().hasProperty(API_RELAY_LISTEN_PROPERTY_KEY)
+                    ? config().getBool(API_RELAY_LISTEN_PROPERTY_KEY)
+                    : DEFAULT_RELAY_LISTEN))
+            {
+                relayServerSmartPtr = std::make_unique<RelayServer>(
+                    *requestDispatcherSmartPtr, ReadRelaySocketPath(), ReadRelayAccessSettings());
+                relayServerSmartPtr->Start();
             }
             
             ServiceObserver subscriber(collection, *requestDispatcherSmartPtr);
 
             collection.Subscribe(subscriber);
 
-            std::atomic<SoundDeviceCollectionInterface*> collectionPtrAtomic(&collection);
-            SetupSignalHandlers(
-                [&collectionPtrAtomic]()
-                {
-                    spdlog::info("Termination signal received.\n");
-                    collectionPtrAtomic.load()->DeactivateAndStopLoop();
-                }
-            );
+            std::unique_ptr<DeviceQueryHttpServer> queryServerSmartPtr;
+            if (const auto queryHttpPort = ReadPortConfigProperty(API_QUERY_HTTP_PORT_PROPERTY_KEY, DEFAULT_QUERY_HTTP_PORT);
+                queryHttpPort != 0)
+            {
+                queryServerSmartPtr = std::make_unique<DeviceQueryHttpServer>(
+                    collection,
+                    ReadOptionalSimpleConfigProperty(API_QUERY_HTTP_ADDRESS_PROPERTY_KEY, DEFAULT_QUERY_HTTP_ADDRESS),
+                    queryHttpPort);
+                collection.Subscribe(*queryServerSmartPtr);
+                queryServerSmartPtr->Start();
+            }
+
+            std::unique_ptr<MetricsHttpServer> metricsServerSmartPtr;
+            if (const auto metricsHttpPort = ReadPortConfigProperty(API_METRICS_HTTP_PORT_PROPERTY_KEY, DEFAULT_METRICS_HTTP_PORT);
+                metricsHttpPort != 0)
+            {
+                auto& registry = ed::metrics::Registry::Inst();
+                registry.AddCounterCallback("soundscanner_log_dropped_messages_total",
+                    "Log messages lost by the asynchronous logger or the log buffer.",
+                    [] { return ed::model::Logger::Inst().GetDroppedMessageCount(); });
+                registry.AddCounterCallback("soundscanner_log_synchronous_fallbacks_total",
+                    "Deferred log lines formatted synchronously, because the ring was full or the line too long.",
+                    [] { return ed::model::DeferredLog::Inst().GetSynchronousFallbackCount(); });
+#ifdef ALLOCATION_ACCOUNTING
+                RegisterAllocationMetrics(registry);
+#endif
+
+                // Registered by the device collection; healthy while PulseAudio can be monitored
+                const auto& contextReadyGauge = registry.GetGauge("soundscanner_pulseaudio_context_ready",
+                    "1 while the PulseAudio context is ready, otherwise 0.");
+                metricsServerSmartPtr = std::make_unique<MetricsHttpServer>(
+                    ReadOptionalSimpleConfigProperty(API_METRICS_HTTP_ADDRESS_PROPERTY_KEY, DEFAULT_METRICS_HTTP_ADDRESS),
+                    metricsHttpPort,
+                    [&contextReadyGauge](std::string& reason)
+                    {
+                        if (contextReadyGauge.GetValue() != 0)
+                        {
+                            return true;
+                        }
+                        reason = "PulseAudio context is not ready";
+                        return false;
+                    });
+                metricsServerSmartPtr->Start();
+            }
+            startupTrace.EndPhase("local servers");
+
+            // Phases and milestones are always exported as metrics; the report is printed on request.
+            // Without a broker, the inventory counts as published once it is handed to the transport.
+            if (startupTraceRequested_)
+            {
+                startupTrace.SetFinalMilestone(
+                    Poco::icompare(transportMethod_, API_TRANSPORT_METHOD_PROPERTY_VALUE02_RABBITMQ) == 0
+                        ? ed::StartupTrace::MILESTONE_INVENTORY_CONFIRMED
+                        : ed::StartupTrace::MILESTONE_INVENTORY_DISPATCHED,
+                    [this](const std::string& report)
+                    {
+                        isStartupTraceReported_.store(true);
+                        spdlog::info("Startup trace:\n{}", report);
+                    });
+            }
+
+            // Handled on the loop (this) thread, so the loop is stopped outside signal context
+            std::chrono::steady_clock::time_point stopRequestTime;
+            const auto onTerminationSignal = [&collection, &stopRequestTime]
+            {
+                spdlog::info("Termination signal received.");
+                stopRequestTime = std::chrono::steady_clock::now();
+                collection.DeactivateAndStopLoop();
+            };
+            collection.AddSignalHandler(SIGTERM, onTerminationSignal);
+            collection.AddSignalHandler(SIGINT, onTerminationSignal);
+            collection.AddSignalHandler(SIGHUP, [this, rabbitMqDispatcher]
+            {
+                ReloadConfiguration(rabbitMqDispatcher);
+            });
 
             collection.ActivateAndStartLoop(); // waits here for deactivation
 
+            // The whole shutdown, counted from the signal, is bounded by one deadline
+            const auto shutdownTimeout = std::chrono::milliseconds(
+                config().hasProperty(API_SHUTDOWN_TIMEOUT_MS_PROPERTY_KEY)
+                    ? config().getUInt(API_SHUTDOWN_TIMEOUT_MS_PROPERTY_KEY)
+                    : DEFAULT_SHUTDOWN_TIMEOUT_MS);
+            if (stopRequestTime == std::chrono::steady_clock::time_point{})
+            {
+                stopRequestTime = std::chrono::steady_clock::now();
+            }
+            const auto shutdownDeadline = stopRequestTime + shutdownTimeout;
+
+            if (startupTraceRequested_ && !isStartupTraceReported_.load())
+            {
+                spdlog::info("Startup trace (incomplete at shutdown):\n{}", startupTrace.Render());
+            }
+
+            // Stop intake: no device events, queries or relayed requests reach the dispatcher any more
+            if (metricsServerSmartPtr)
+            {
+                metricsServerSmartPtr->Stop();
+            }
+            if (queryServerSmartPtr)
+            {
+                queryServerSmartPtr->Stop();
+                collection.Unsubscribe(*queryServerSmartPtr);
+            }
             collection.Unsubscribe(subscriber);
+            if (relayServerSmartPtr)
+            {
+                relayServerSmartPtr->Stop();
+            }
+
+            // Flush the queued messages and wait for their confirms; the RabbitMQ publisher spills what is left
+            requestDispatcherSmartPtr->Drain(shutdownDeadline);
+            spdlog::info("Shutdown drain finished {} ms after the stop request (deadline {} ms).",
+                         std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::steady_clock::now() - stopRequestTime).count(),
+                         shutdownTimeout.count());
+#ifdef ALLOCATION_ACCOUNTING
+            spdlog::info("{}", ed::allocation::RenderReport());
+#endif
             spdlog::info("Main loop exited. Shutting down...");
         }
         catch (const std::exception & e)
@@ -228,6 +604,132 @@ protected:
         return Application::EXIT_OK;
     }
 
+#ifdef ALLOCATION_ACCOUNTING
+    static void RegisterAllocationMetrics(ed::metrics::Registry& registry)
+    {
+        registry.AddCounterCallback("soundscanner_processed_events_total",
+            "Collection events processed, the denominator of the allocation budget.",
+            [] { return ed::allocation::GetProcessedEventCount(); });
+        for (size_t i = 0; i < ed::allocation::STAGE_LABELS.size(); ++i)
+        {
+            const auto stage = static_cast<ed::allocation::Stage>(i);
+            const auto labels = fmt::format(R"(stage="{}")", ed::allocation::STAGE_LABELS[i]);
+            registry.AddCounterCallback("soundscanner_allocations_total", "Heap allocations per event path stage.",
+                [stage] { return ed::allocation::GetStageStats(stage).allocationCount; }, labels);
+            registry.AddCounterCallback("soundscanner_allocated_bytes_total", "Heap bytes allocated per event path stage.",
+                [stage] { return ed::allocation::GetStageStats(stage).allocatedBytes; }, labels);
+        }
+    }
+#endif
+
+    [[nodiscard]] RequestPublisherSettings ReadRequestPublisherSettings() const
+    {
+        RequestPublisherSettings settings;
+        auto& queueSettings = settings.outboundQueue;
+        queueSettings.capacity = config().hasProperty(API_RMQ_OUTBOUND_QUEUE_CAPACITY_PROPERTY_KEY)
+            ? config().getUInt(API_RMQ_OUTBOUND_QUEUE_CAPACITY_PROPERTY_KEY)
+            : queueSettings.capacity;
+        queueSettings.highWatermark = config().hasProperty(API_RMQ_OUTBOUND_QUEUE_HIGH_WATERMARK_PROPERTY_KEY)
+            ? config().getUInt(API_RMQ_OUTBOUND_QUEUE_HIGH_WATERMARK_PROPERTY_KEY)
+            : queueSettings.capacity * 4 / 5;
+        queueSettings.lowWatermark = config().hasProperty(API_RMQ_OUTBOUND_QUEUE_LOW_WATERMARK_PROPERTY_KEY)
+            ? config().getUInt(API_RMQ_OUTBOUND_QUEUE_LOW_WATERMARK_PROPERTY_KEY)
+            : queueSettings.capacity / 5;
+        settings.maxUnconfirmed = ReadUInt16ConfigProperty(API_RMQ_MAX_UNCONFIRMED_PROPERTY_KEY, settings.maxUnconfirmed);
+        settings.producerPoolSize = ReadUInt16ConfigProperty(API_RMQ_PRODUCER_POOL_SIZE_PROPERTY_KEY, settings.producerPoolSize);
+        // A relative path is placed in the private state directory
+        try
+        {
+            settings.spillFilePath = ed::utility::PrivatePaths::Resolve(
+                ReadOptionalSimpleConfigProperty(API_RMQ_SPILL_FILE_PATH_PROPERTY_KEY, DEFAULT_RMQ_SPILL_FILE_PATH),
+                ed::utility::PrivatePaths::GetStateDir(PRIVATE_DIR_NAME)).string();
+        }
+        catch (const std::runtime_error& ex)
+        {
+            spdlog::error("No spill file, unsent messages are dropped at shutdown: {}", ex.what());
+            settings.spillFilePath.clear();
+        }
+
+        const auto policyName = ReadOptionalSimpleConfigProperty(
+            API_RMQ_OUTBOUND_QUEUE_POLICY_PROPERTY_KEY,
+            std::string(magic_enum::enum_name(queueSettings.overflowPolicy)));
+        if (const auto policy = magic_enum::enum_cast<OutboundQueueOverflowPolicy>(policyName, magic_enum::case_insensitive);
+            policy.has_value())
+        {
+            queueSettings.overflowPolicy = policy.value();
+        }
+        else
+        {
+            spdlog::warn(R"(Invalid outbound queue policy "{}". Using "{}".)", policyName,
+                         magic_enum::enum_name(queueSettings.overflowPolicy));
+        }
+
+        spdlog::info("Outbound queue: capacity {}, policy {}, watermarks {}/{}; {} producer(s), max. {} unconfirmed each.",
+                     queueSettings.capacity, magic_enum::enum_name(queueSettings.overflowPolicy),
+                     queueSettings.highWatermark, queueSettings.lowWatermark,
+                     settings.producerPoolSize, settings.maxUnconfirmed);
+        return settings;
+    }
+
+    // A relative path is placed in the private runtime directory, which relay and clients of the same user share
+    [[nodiscard]] std::string ReadRelaySocketPath() const
+    {
+        return ed::utility::PrivatePaths::Resolve(
+            ReadOptionalSimpleConfigProperty(API_RELAY_SOCKET_PATH_PROPERTY_KEY, DEFAULT_RELAY_SOCKET_PATH),
+            ed::utility::PrivatePaths::GetRuntimeDir(PRIVATE_DIR_NAME)).string();
+    }
+
+    // Comma-separated user names or uids
+    [[nodiscard]] RelayAccessSettings ReadRelayAccessSettings() const
+    {
+        RelayAccessSettings settings;
+        settings.allowedGroup = ReadOptionalSimpleConfigProperty(API_RELAY_ALLOWED_GROUP_PROPERTY_KEY);
+        const Poco::StringTokenizer users(ReadOptionalSimpleConfigProperty(API_RELAY_ALLOWED_USERS_PROPERTY_KEY),
+                                          ",", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+        settings.allowedUsers.assign(users.begin(), users.end());
+        return settings;
+    }
+
+    [[nodiscard]] ed::utility::LogRetentionPolicy ReadLogRetentionPolicy() const
+    {
+        ed::utility::LogRetentionPolicy policy;
+        policy.maxFileCount = config().hasProperty(API_LOG_RETENTION_MAX_FILES_PROPERTY_KEY)
+            ? config().getUInt(API_LOG_RETENTION_MAX_FILES_PROPERTY_KEY)
+            : DEFAULT_LOG_RETENTION_MAX_FILES;
+        policy.maxTotalBytes = static_cast<uint64_t>(config().hasProperty(API_LOG_RETENTION_MAX_MB_PROPERTY_KEY)
+            ? config().getUInt(API_LOG_RETENTION_MAX_MB_PROPERTY_KEY)
+            : DEFAULT_LOG_RETENTION_MAX_MB) * 1024 * 1024;
+        policy.maxAge = std::chrono::days(config().hasProperty(API_LOG_RETENTION_MAX_AGE_DAYS_PROPERTY_KEY)
+            ? config().getUInt(API_LOG_RETENTION_MAX_AGE_DAYS_PROPERTY_KEY)
+            : DEFAULT_LOG_RETENTION_MAX_AGE_DAYS);
+        policy.action = config().hasProperty(API_LOG_RETENTION_ACTION_PROPERTY_KEY)
+            && Poco::icompare(config().getString(API_LOG_RETENTION_ACTION_PROPERTY_KEY),
+                              API_LOG_RETENTION_ACTION_PROPERTY_VALUE_ARCHIVE) == 0
+            ? ed::utility::LogRetentionAction::Archive
+            : ed::utility::LogRetentionAction::Delete;
+        return policy;
+    }
+
+    // Logging is not set up yet when this runs, so an invalid value is reported on stderr
+    [[nodiscard]] spdlog::level::level_enum ReadLogLevel(const std::string& propertyName,
+                                                         spdlog::level::level_enum defaultLevel) const
+    {
+        if (!config().hasProperty(propertyName))
+        {
+            return defaultLevel;
+        }
+
+        const auto levelName = Poco::toLower(config().getString(propertyName));
+        const auto level = spdlog::level::from_str(levelName);
+        if (level == spdlog::level::off && levelName != "off")
+        {
+            std::cerr << "Invalid log level \"" << levelName << "\" in " << propertyName << ", using \""
+                << spdlog::level::to_string_view(defaultLevel).data() << "\"." << std::endl;
+            return defaultLevel;
+        }
+        return level;
+    }
+
     [[nodiscard]] std::string ReadOptionalSimpleConfigProperty(const std::string& propertyName,
                                                                const std::string& defaultValue = "") const
     {
@@ -240,6 +742,43 @@ protected:
         return ReadStringConfigProperty(propertyName);
     }
 
+    // A count that must be at least 1 and fit 16 bits; an out-of-range value is clamped with a warning
+    [[nodiscard]] uint16_t ReadUInt16ConfigProperty(const std::string& propertyName, uint16_t defaultValue) const
+    {
+        if (!config().hasProperty(propertyName))
+        {
+            return defaultValue;
+        }
+
+        const auto value = config().getUInt(propertyName);
+        const auto clampedValue = std::clamp<unsigned>(value, 1, std::numeric_limits<uint16_t>::max());
+        if (clampedValue != value)
+        {
+            spdlog::warn(R"(Property "{}" = {} is out of range [1, {}]. Using {}.)",
+                         propertyName, value, std::numeric_limits<uint16_t>::max(), clampedValue);
+        }
+        return static_cast<uint16_t>(clampedValue);
+    }
+
+    // 0 disables the endpoint; a value that does not fit a port is an error, not wrapped to another port
+    [[nodiscard]] uint16_t ReadPortConfigProperty(const std::string& propertyName, uint16_t defaultValue) const
+    {
+        if (!config().hasProperty(propertyName))
+        {
+            return defaultValue;
+        }
+
+        const auto value = config().getUInt(propertyName);
+        if (value > std::numeric_limits<uint16_t>::max())
+        {
+            const auto msg = std::string("FATAL: Property \"") + propertyName + "\" = " + std::to_string(value)
+                + " is not a port number.";
+            spdlog::error(msg);
+            throw std::runtime_error(msg);
+        }
+        return static_cast<uint16_t>(value);
+    }
+
     [[nodiscard]] std::string ReadStringConfigProperty(const std::string& propertyName) const
     {
         if (!config().hasProperty(propertyName))
@@ -255,23 +794,72 @@ protected:
 
 private:
     bool onlyConsoleOutputRequested_ = false;
+    bool healthCheckRequested_ = false;
+    bool startupTraceRequested_ = false;
+    std::atomic<bool> isStartupTraceReported_{false};
     
     std::string transportMethod_;
 
+    static constexpr auto CONFIGURATION_FILE_LABEL = "file";
+
+    static constexpr auto API_LOG_LEVEL_PROPERTY_KEY = "custom.logLevel";
+    static constexpr auto API_LOG_FLUSH_LEVEL_PROPERTY_KEY = "custom.logFlushLevel";
+    static constexpr auto API_LOG_FLUSH_INTERVAL_PROPERTY_KEY = "custom.logFlushIntervalSeconds";
+    static constexpr auto API_LOG_DEFERRED_FORMATTING_PROPERTY_KEY = "custom.logDeferredFormatting";
+    static constexpr auto API_LOG_COMPRESSED_RETENTION_MB_PROPERTY_KEY = "custom.logCompressedRetentionMegabytes";
+    static constexpr auto API_LOG_RETENTION_MAX_FILES_PROPERTY_KEY = "custom.logRetentionMaxFiles";
+    static constexpr auto API_LOG_RETENTION_MAX_MB_PROPERTY_KEY = "custom.logRetentionMaxMegabytes";
+    static constexpr auto API_LOG_RETENTION_MAX_AGE_DAYS_PROPERTY_KEY = "custom.logRetentionMaxAgeDays";
+    static constexpr auto API_LOG_RETENTION_ACTION_PROPERTY_KEY = "custom.logRetentionAction";
+    static constexpr auto API_LOG_RETENTION_ACTION_PROPERTY_VALUE_ARCHIVE = "Archive";
+
     static constexpr auto API_TRANSPORT_METHOD_PROPERTY_KEY = "custom.transportMethod";
     static constexpr auto API_TRANSPORT_METHOD_PROPERTY_VALUE00_NONE = "None";
     static constexpr auto API_TRANSPORT_METHOD_PROPERTY_VALUE02_RABBITMQ = "RabbitMQ";
+    static constexpr auto API_TRANSPORT_METHOD_PROPERTY_VALUE03_RELAY = "Relay";
 
     static constexpr auto API_RMQ_HOST_PROPERTY_KEY = "custom.rmqHostName";
     static constexpr auto API_RMQ_USER_PROPERTY_KEY = "custom.rmqUserName";
     static constexpr auto API_RMQ_PASSWORD_PROPERTY_KEY = "custom.rmqPassword";
+    static constexpr auto API_RMQ_OUTBOUND_QUEUE_CAPACITY_PROPERTY_KEY = "custom.rmqOutboundQueueCapacity";
+    static constexpr auto API_RMQ_OUTBOUND_QUEUE_POLICY_PROPERTY_KEY = "custom.rmqOutboundQueuePolicy";
+    static constexpr auto API_RMQ_OUTBOUND_QUEUE_HIGH_WATERMARK_PROPERTY_KEY = "custom.rmqOutboundQueueHighWatermark";
+    static constexpr auto API_RMQ_OUTBOUND_QUEUE_LOW_WATERMARK_PROPERTY_KEY = "custom.rmqOutboundQueueLowWatermark";
+    static constexpr auto API_RMQ_MAX_UNCONFIRMED_PROPERTY_KEY = "custom.rmqMaxUnconfirmed";
+    static constexpr auto API_RMQ_PRODUCER_POOL_SIZE_PROPERTY_KEY = "custom.rmqProducerPoolSize";
+    static constexpr auto API_RMQ_SPILL_FILE_PATH_PROPERTY_KEY = "custom.rmqSpillFilePath";
+    static constexpr auto API_SHUTDOWN_TIMEOUT_MS_PROPERTY_KEY = "custom.shutdownTimeoutMs";
     static constexpr auto API_PULSE_AUDIO_RECONNECTION_PROPERTY_KEY = "custom.pulseAudioReconnection";
     static constexpr auto API_INITIAL_RECONNECT_DELAY_MS_PROPERTY_KEY = "custom.pulseAudioInitialReconnectDelayMs";
+    static constexpr auto API_RELAY_SOCKET_PATH_PROPERTY_KEY = "custom.relaySocketPath";
+    static constexpr auto API_RELAY_LISTEN_PROPERTY_KEY = "custom.relayListen";
+    static constexpr auto API_RELAY_ALLOWED_GROUP_PROPERTY_KEY = "custom.relayAllowedGroup";
+    static constexpr auto API_RELAY_ALLOWED_USERS_PROPERTY_KEY = "custom.relayAllowedUsers";
+    static constexpr auto API_QUERY_HTTP_PORT_PROPERTY_KEY = "custom.queryHttpPort";
+    static constexpr auto API_QUERY_HTTP_ADDRESS_PROPERTY_KEY = "custom.queryHttpAddress";
+    static constexpr auto API_METRICS_HTTP_PORT_PROPERTY_KEY = "custom.metricsHttpPort";
+    static constexpr auto API_METRICS_HTTP_ADDRESS_PROPERTY_KEY = "custom.metricsHttpAddress";
+    static constexpr auto API_WATCHDOG_STALL_THRESHOLD_MS_PROPERTY_KEY = "custom.watchdogStallThresholdMs";
     static constexpr bool DEFAULT_PULSE_AUDIO_RECONNECTION_ENABLED = false;
     static constexpr unsigned int DEFAULT_INITIAL_RECONNECT_DELAY_MS = 1000;
+    static constexpr uint16_t DEFAULT_QUERY_HTTP_PORT = 0; // disabled
+    static constexpr auto DEFAULT_QUERY_HTTP_ADDRESS = "127.0.0.1";
+    static constexpr uint16_t DEFAULT_METRICS_HTTP_PORT = 0; // disabled
+    static constexpr auto DEFAULT_METRICS_HTTP_ADDRESS = "127.0.0.1";
+    static constexpr unsigned int DEFAULT_WATCHDOG_STALL_THRESHOLD_MS = 500;
+    static constexpr unsigned int DEFAULT_SHUTDOWN_TIMEOUT_MS = 5000;
+    static constexpr auto DEFAULT_RMQ_SPILL_FILE_PATH = "spill.dat";
+    static constexpr int HEALTH_CHECK_FAILED_EXIT_CODE = 1;
+    static constexpr long HEALTH_CHECK_TIMEOUT_SECONDS = 3;
+    static constexpr auto PRIVATE_DIR_NAME = "linuxsoundscanner";
+    static constexpr auto DEFAULT_RELAY_SOCKET_PATH = "relay.sock";
+    static constexpr bool DEFAULT_RELAY_LISTEN = false;
+    static constexpr bool DEFAULT_LOG_DEFERRED_FORMATTING = true;
+    static constexpr unsigned int DEFAULT_LOG_COMPRESSED_RETENTION_MB = 10;
+    static constexpr unsigned int DEFAULT_LOG_RETENTION_MAX_FILES = 100;
+    static constexpr unsigned int DEFAULT_LOG_RETENTION_MAX_MB = 200;
+    static constexpr unsigned int DEFAULT_LOG_RETENTION_MAX_AGE_DAYS = 30;
 };
 
-std::function<void()> LinuxSoundScanner::deactivateCallback_{nullptr};
-
 
 POCO_APP_MAIN(LinuxSoundScanner)
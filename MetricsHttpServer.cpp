@@ -0,0 +1,136 @@
+#include "os-dependencies.h"
+
+#include "MetricsHttpServer.h"
+
+#include "internal/Metrics.h"
+
+#include <Poco/Net/HTTPRequestHandler.h>
+#include <Poco/Net/HTTPRequestHandlerFactory.h>
+#include <Poco/Net/HTTPServer.h>
+#include <Poco/Net/HTTPServerParams.h>
+#include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/Net/HTTPServerResponse.h>
+#include <Poco/Net/ServerSocket.h>
+#include <Poco/Net/SocketAddress.h>
+#include <Poco/URI.h>
+
+#include <spdlog/spdlog.h>
+
+#include <ostream>
+
+
+class MetricsHttpServer::RequestHandler final : public Poco::Net::HTTPRequestHandler
+{
+public:
+    explicit RequestHandler(const HealthCheck& healthCheck)
+        : healthCheck_(healthCheck)
+    {
+    }
+
+    void handleRequest(Poco::Net::HTTPServerRequest& request, Poco::Net::HTTPServerResponse& response) override
+    {
+        using Poco::Net::HTTPResponse;
+
+        if (request.getMethod() != Poco::Net::HTTPRequest::HTTP_GET)
+        {
+            Send(response, HTTPResponse::HTTP_METHOD_NOT_ALLOWED, TEXT_CONTENT_TYPE, "Only GET is supported\n");
+            return;
+        }
+
+        const auto path = Poco::URI(request.getURI()).getPath();
+        if (path == METRICS_PATH)
+        {
+            Send(response, HTTPResponse::HTTP_OK, METRICS_CONTENT_TYPE, ed::metrics::Registry::Inst().Render());
+            return;
+        }
+        if (path == HEALTH_PATH)
+        {
+            if (std::string reason; healthCheck_ && !healthCheck_(reason))
+            {
+                Send(response, HTTPResponse::HTTP_SERVICE_UNAVAILABLE, TEXT_CONTENT_TYPE, reason + "\n");
+                return;
+            }
+            Send(response, HTTPResponse::HTTP_OK, TEXT_CONTENT_TYPE, "ok\n");
+            return;
+        }
+
+        Send(response, HTTPResponse::HTTP_NOT_FOUND, TEXT_CONTENT_TYPE, "Unknown resource\n");
+    }
+
+private:
+    static void Send(Poco::Net::HTTPServerResponse& response, Poco::Net::HTTPResponse::HTTPStatus status,
+                     const char* contentType, const std::string& body)
+    {
+        response.setStatus(status);
+        response.set("Cache-Control", "no-cache");
+        response.setContentType(contentType);
+        response.setContentLength(static_cast<std::streamsize>(body.size()));
+        response.send().write(body.data(), static_cast<std::streamsize>(body.size()));
+    }
+
+private:
+    static constexpr auto METRICS_CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+    static constexpr auto TEXT_CONTENT_TYPE = "text/plain; charset=utf-8";
+
+    const HealthCheck& healthCheck_;
+};
+
+class MetricsHttpServer::RequestHandlerFactory final : public Poco::Net::HTTPRequestHandlerFactory
+{
+public:
+    explicit RequestHandlerFactory(const HealthCheck& healthCheck)
+        : healthCheck_(healthCheck)
+    {
+    }
+
+    Poco::Net::HTTPRequestHandler* createRequestHandler(const Poco::Net::HTTPServerRequest&) override
+    {
+        return new RequestHandler(healthCheck_);
+    }
+
+private:
+    const HealthCheck& healthCheck_;
+};
+
+
+MetricsHttpServer::MetricsHttpServer(const std::string& address, uint16_t port, HealthCheck healthCheck)
+    : address_(address)
+    , port_(port)
+    , healthCheck_(std::move(healthCheck))
+{
+}
+
+MetricsHttpServer::~MetricsHttpServer()
+{
+    Stop();
+}
+
+void MetricsHttpServer::Start()
+{
+    if (httpServer_)
+    {
+        return;
+    }
+
+    const Poco::Net::ServerSocket serverSocket(Poco::Net::SocketAddress(address_, port_));
+
+    auto* params = new Poco::Net::HTTPServerParams;
+    params->setMaxThreads(1);
+    params->setMaxQueued(8);
+
+    httpServer_ = std::make_unique<Poco::Net::HTTPServer>(new RequestHandlerFactory(healthCheck_), serverSocket, params);
+    httpServer_->start();
+    spdlog::info("Metrics HTTP server listening on {}:{}.", address_, port_);
+}
+
+void MetricsHttpServer::Stop()
+{
+    if (!httpServer_)
+    {
+        return;
+    }
+
+    httpServer_->stopAll(true);
+    httpServer_.reset();
+    spdlog::info("Metrics HTTP server stopped.");
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "internal/ClassDefHelper.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace Poco::Net
+{
+    class HTTPServer;
+}
+
+// Local HTTP endpoint for monitoring:
+//   GET /metrics  - all metrics of ed::metrics::Registry in the Prometheus text exposition format
+//   GET /health   - 200 "ok" or 503 with the reason, for container health checks
+class MetricsHttpServer final
+{
+    class RequestHandler;
+    class RequestHandlerFactory;
+
+public:
+    // Returns true if healthy; otherwise fills the reason
+    using HealthCheck = std::function<bool(std::string& reason)>;
+
+    MetricsHttpServer(const std::string& address, uint16_t port, HealthCheck healthCheck);
+
+    DISALLOW_COPY_MOVE(MetricsHttpServer);
+    ~MetricsHttpServer();
+
+    void Start();
+    void Stop();
+
+    static constexpr auto METRICS_PATH = "/metrics";
+    static constexpr auto HEALTH_PATH = "/health";
+
+private:
+    std::string address_;
+    uint16_t port_;
+    HealthCheck healthCheck_;
+    std::unique_ptr<Poco::Net::HTTPServer> httpServer_;
+};
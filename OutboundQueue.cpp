@@ -0,0 +1,320 @@
+#include "os-dependencies.h"
+
+#include "OutboundQueue.h"
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+
+namespace
+{
+    constexpr int WATERMARK_NOT_CROSSED = -1;
+    // Drops are logged on the first one and then once per this many; the counters record each one
+    constexpr uint64_t DROP_LOG_INTERVAL = 1000;
+}
+
+OutboundQueue::OutboundQueue(const OutboundQueueSettings& settings)
+    : settings_(NormalizeSettings(settings))
+    , metrics_(GetMetrics())
+{
+}
+
+OutboundQueueSettings OutboundQueue::NormalizeSettings(OutboundQueueSettings settings)
+{
+    settings.capacity = std::max<size_t>(settings.capacity, 1);
+    settings.highWatermark = std::clamp<size_t>(settings.highWatermark, 1, settings.capacity);
+    settings.lowWatermark = std::min(settings.lowWatermark, settings.highWatermark - 1);
+    return settings;
+}
+
+OutboundQueue::~OutboundQueue()
+{
+    metrics_.depth.Add(-static_cast<int64_t>(messages_.size()));
+}
+
+OutboundQueue::Metrics OutboundQueue::GetMetrics()
+{
+    // Shared by all queues (lanes) of the process
+    auto& registry = ed::metrics::Registry::Inst();
+    constexpr auto MESSAGES_NAME = "soundscanner_outbound_messages_total";
+    constexpr auto MESSAGES_HELP = "Messages offered to the outbound queue, by outcome.";
+    return {
+        registry.GetCounter(MESSAGES_NAME, MESSAGES_HELP, R"(outcome="enqueued")"),
+        registry.GetCounter(MESSAGES_NAME, MESSAGES_HELP, R"(outcome="dropped_oldest")"),
+        registry.GetCounter(MESSAGES_NAME, MESSAGES_HELP, R"(outcome="dropped_newest")"),
+        registry.GetCounter(MESSAGES_NAME, MESSAGES_HELP, R"(outcome="collapsed")"),
+        registry.GetCounter("soundscanner_outbound_blocked_pushes_total",
+                            "Pushes that waited for space in a full outbound queue."),
+        registry.GetGauge("soundscanner_outbound_queue_depth", "Messages waiting in the outbound queues.")
+    };
+}
+
+void OutboundQueue::SetWatermarkCallback(std::function<void(bool isAboveHighWatermark)> watermarkCallback)
+{
+    std::lock_guard lock(guard_);
+    watermarkCallback_ = std::move(watermarkCallback);
+}
+
+void OutboundQueue::UpdateSettings(const OutboundQueueSettings& settings)
+{
+    int crossed;
+    {
+        std::lock_guard lock(guard_);
+        const bool wasCollapsing = IsCollapsingLocked();
+        settings_ = NormalizeSettings(settings);
+        if (IsCollapsingLocked() != wasCollapsing)
+        {
+            // Index the queued messages by collapse key, the newest per key; or drop the index
+            collapseKeyToMessageMap_.clear();
+            for (auto it = messages_.begin(); IsCollapsingLocked() && it != messages_.end(); ++it)
+            {
+                if (!it->collapseKey.empty())
+                {
+                    collapseKeyToMessageMap_.insert_or_assign(it->collapseKey, it);
+                }
+            }
+        }
+        crossed = UpdateWatermarkLocked();
+    }
+    // A larger capacity releases blocked pushes
+    notFullCondition_.notify_all();
+    NotifyWatermark(crossed);
+}
+
+bool OutboundQueue::Push(OutboundMessage message)
+{
+    return PushBack(std::move(message), true);
+}
+
+bool OutboundQueue::TryPush(OutboundMessage message)
+{
+    return PushBack(std::move(message), false);
+}
+
+bool OutboundQueue::PushBack(OutboundMessage message, bool isBlockingAllowed)
+{
+    int crossed;
+    {
+        std::unique_lock lock(guard_);
+        if (isClosed_)
+        {
+            ++counters_.droppedNewest;
+            metrics_.droppedNewest.Increment();
+            return false;
+        }
+
+        const bool isCollapsing = IsCollapsingLocked() && !message.collapseKey.empty();
+        if (isCollapsing)
+        {
+            if (const auto foundPair = collapseKeyToMessageMap_.find(message.collapseKey);
+                foundPair != collapseKeyToMessageMap_.end())
+            {
+                // Move the queued message to the back, behind the messages queued since: replacing it in place
+                // would send the newer state ahead of them. The queued trace is kept, so the latency
+                // of the older, superseded event is measured.
+                messages_.splice(messages_.end(), messages_, foundPair->second);
+                messages_.back().body = std::move(message.body);
+                ++counters_.collapsed;
+                metrics_.collapsed.Increment();
+                return true;
+            }
+        }
+
+        if (messages_.size() >= settings_.capacity)
+        {
+            switch (settings_.overflowPolicy)
+            {
+            case OutboundQueueOverflowPolicy::Block:
+                if (!isBlockingAllowed)
+                {
+                    ++counters_.droppedNewest;
+                    metrics_.droppedNewest.Increment();
+                    return false;
+                }
+                ++counters_.blockedPushes;
+                metrics_.blockedPushes.Increment();
+                notFullCondition_.wait(lock, [this] { return isClosed_ || messages_.size() < settings_.capacity; });
+                if (isClosed_)
+                {
+                    ++counters_.droppedNewest;
+                    metrics_.droppedNewest.Increment();
+                    return false;
+                }
+                break;
+            case OutboundQueueOverflowPolicy::DropNewest:
+                ++counters_.droppedNewest;
+                metrics_.droppedNewest.Increment();
+                LogDropLocked("newest", message, counters_.droppedNewest);
+                return false;
+            case OutboundQueueOverflowPolicy::DropOldest:
+            case OutboundQueueOverflowPolicy::CollapsePerDevice:
+                ++counters_.droppedOldest;
+                metrics_.droppedOldest.Increment();
+                LogDropLocked("oldest", messages_.front(), counters_.droppedOldest);
+                EraseFrontLocked();
+                break;
+            }
+        }
+
+        const auto insertedIt = messages_.insert(messages_.end(), std::move(message));
+        metrics_.depth.Add(1);
+        if (isCollapsing)
+        {
+            collapseKeyToMessageMap_.emplace(insertedIt->collapseKey, insertedIt);
+        }
+        ++counters_.enqueued;
+        metrics_.enqueued.Increment();
+        crossed = UpdateWatermarkLocked();
+    }
+    notEmptyCondition_.notify_one();
+    NotifyWatermark(crossed);
+    return true;
+}
+
+void OutboundQueue::PushFront(OutboundMessage message)
+{
+    int crossed;
+    {
+        std::lock_guard lock(guard_);
+        // Never dropped, even if a newer message with the same key is queued: the retried message may have been
+        // sent before messages of the device queued in between. The newer one stays the one collapsed into.
+        const auto insertedIt = messages_.insert(messages_.begin(), std::move(message));
+        metrics_.depth.Add(1);
+        if (IsCollapsingLocked() && !insertedIt->collapseKey.empty())
+        {
+            collapseKeyToMessageMap_.emplace(insertedIt->collapseKey, insertedIt);
+        }
+        crossed = UpdateWatermarkLocked();
+    }
+    notEmptyCondition_.notify_one();
+    NotifyWatermark(crossed);
+}
+
+bool OutboundQueue::WaitAndPop(OutboundMessage& message, std::chrono::milliseconds timeout)
+{
+    int crossed;
+    {
+        std::unique_lock lock(guard_);
+        if (!notEmptyCondition_.wait_for(lock, timeout, [this] { return isClosed_ || !messages_.empty(); })
+            || messages_.empty())
+        {
+            return false;
+        }
+
+        message = std::move(messages_.front());
+        EraseFrontLocked();
+        crossed = UpdateWatermarkLocked();
+    }
+    notFullCondition_.notify_one();
+    NotifyWatermark(crossed);
+    return true;
+}
+
+void OutboundQueue::Close()
+{
+    {
+        std::lock_guard lock(guard_);
+        isClosed_ = true;
+    }
+    notEmptyCondition_.notify_all();
+    notFullCondition_.notify_all();
+}
+
+bool OutboundQueue::IsClosed() const
+{
+    std::lock_guard lock(guard_);
+    return isClosed_;
+}
+
+size_t OutboundQueue::GetSize() const
+{
+    std::lock_guard lock(guard_);
+    return messages_.size();
+}
+
+bool OutboundQueue::IsAboveHighWatermark() const
+{
+    std::lock_guard lock(guard_);
+    return isAboveHighWatermark_;
+}
+
+OutboundQueueCounters OutboundQueue::GetCounters() const
+{
+    std::lock_guard lock(guard_);
+    return counters_;
+}
+
+void OutboundQueue::LogDropLocked(const char* which, const OutboundMessage& message, uint64_t dropCount) const
+{
+    // The key names the request kind and the device; the body would flood the log under sustained overflow
+    if (dropCount % DROP_LOG_INTERVAL == 1)
+    {
+        spdlog::warn("Outbound queue is full ({} messages), dropping the {} ({}); {} dropped so far.",
+                     settings_.capacity, which, message.collapseKey.empty() ? "no key" : message.collapseKey,
+                     dropCount);
+    }
+}
+
+bool OutboundQueue::IsCollapsingLocked() const
+{
+    return settings_.overflowPolicy == OutboundQueueOverflowPolicy::CollapsePerDevice;
+}
+
+void OutboundQueue::EraseFrontLocked()
+{
+    if (const auto& front = messages_.front();
+        !front.collapseKey.empty())
+    {
+        if (const auto foundPair = collapseKeyToMessageMap_.find(front.collapseKey);
+            foundPair != collapseKeyToMessageMap_.end() && foundPair->second == messages_.begin())
+        {
+            collapseKeyToMessageMap_.erase(foundPair);
+        }
+    }
+    messages_.pop_front();
+    metrics_.depth.Add(-1);
+}
+
+int OutboundQueue::UpdateWatermarkLocked()
+{
+    if (!isAboveHighWatermark_ && messages_.size() >= settings_.highWatermark)
+    {
+        isAboveHighWatermark_ = true;
+        return 1;
+    }
+    if (isAboveHighWatermark_ && messages_.size() <= settings_.lowWatermark)
+    {
+        isAboveHighWatermark_ = false;
+        return 0;
+    }
+    return WATERMARK_NOT_CROSSED;
+}
+
+void OutboundQueue::NotifyWatermark(int crossed) const
+{
+    if (crossed == WATERMARK_NOT_CROSSED)
+    {
+        return;
+    }
+
+    size_t watermark;
+    {
+        // The settings may be updated concurrently
+        std::lock_guard lock(guard_);
+        watermark = crossed == 1 ? settings_.highWatermark : settings_.lowWatermark;
+    }
+    if (crossed == 1)
+    {
+        spdlog::warn("Outbound queue reached the high watermark ({} messages).", watermark);
+    }
+    else
+    {
+        spdlog::info("Outbound queue fell back to the low watermark ({} messages).", watermark);
+    }
+
+    if (watermarkCallback_)
+    {
+        watermarkCallback_(crossed == 1);
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "internal/ClassDefHelper.h"
+#include "internal/EventTrace.h"
+#include "internal/Metrics.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+enum class OutboundQueueOverflowPolicy : uint8_t {
+    Block = 0,        // The producing thread waits until there is room
+    DropOldest,       // The oldest queued message is discarded
+    DropNewest,       // The message being pushed is discarded
+    CollapsePerDevice // A queued message with the same collapse key is replaced and moved to the back; if still full, drop the oldest
+};
+
+struct OutboundQueueSettings
+{
+    size_t capacity = 10000;
+    OutboundQueueOverflowPolicy overflowPolicy = OutboundQueueOverflowPolicy::DropOldest;
+    size_t highWatermark = 8000;
+    size_t lowWatermark = 2000;
+};
+
+struct OutboundMessage
+{
+    std::string collapseKey; // Empty: never collapsed
+    std::string body;
+    ed::tracing::EventTrace trace; // Not traced if the message was not caused by a PulseAudio event
+};
+
+struct OutboundQueueCounters
+{
+    uint64_t enqueued = 0;
+    uint64_t droppedOldest = 0;
+    uint64_t droppedNewest = 0;
+    uint64_t collapsed = 0;
+    uint64_t blockedPushes = 0;
+};
+
+// Bounded, thread-safe FIFO in front of the RabbitMQ producer.
+// The watermark callback is invoked (outside the lock) when the size crosses the high watermark
+// and again when it falls back to the low watermark, so upstream stages can shed optional work.
+class OutboundQueue final
+{
+public:
+    explicit OutboundQueue(const OutboundQueueSettings& settings);
+
+    DISALLOW_COPY_MOVE(OutboundQueue);
+    ~OutboundQueue();
+
+    void SetWatermarkCallback(std::function<void(bool isAboveHighWatermark)> watermarkCallback);
+    // Applied atomically to the queued messages; a smaller capacity drops nothing, the queue shrinks as it drains
+    void UpdateSettings(const OutboundQueueSettings& settings);
+
+    // Returns false if the message has been dropped
+    bool Push(OutboundMessage message);
+    // As Push, but never waits: with the Block policy a full queue drops the message
+    bool TryPush(OutboundMessage message);
+    // Returns a message that could not be sent back to the head of the queue, bypassing the overflow policy;
+    // it is never collapsed away
+    void PushFront(OutboundMessage message);
+    // Returns false on timeout or if the queue is closed and empty
+    bool WaitAndPop(OutboundMessage& message, std::chrono::milliseconds timeout);
+
+    void Close();
+    [[nodiscard]] bool IsClosed() const;
+
+    [[nodiscard]] size_t GetSize() const;
+    [[nodiscard]] bool IsAboveHighWatermark() const;
+    [[nodiscard]] OutboundQueueCounters GetCounters() const;
+
+private:
+    static OutboundQueueSettings NormalizeSettings(OutboundQueueSettings settings);
+    bool PushBack(OutboundMessage message, bool isBlockingAllowed);
+    [[nodiscard]] bool IsCollapsingLocked() const;
+    void EraseFrontLocked();
+    void LogDropLocked(const char* which, const OutboundMessage& message, uint64_t dropCount) const;
+    // Returns the callback argument if a watermark was crossed
+    [[nodiscard]] int UpdateWatermarkLocked();
+    void NotifyWatermark(int crossed) const;
+
+    // Process-wide metrics, recorded next to the per-queue counters
+    struct Metrics
+    {
+        ed::metrics::Counter& enqueued;
+        ed::metrics::Counter& droppedOldest;
+        ed::metrics::Counter& droppedNewest;
+        ed::metrics::Counter& collapsed;
+        ed::metrics::Counter& blockedPushes;
+        ed::metrics::Gauge& depth;
+    };
+    static Metrics GetMetrics();
+
+private:
+    OutboundQueueSettings settings_;
+    std::function<void(bool)> watermarkCallback_;
+
+    mutable std::mutex guard_;
+    std::condition_variable notEmptyCondition_;
+    std::condition_variable notFullCondition_;
+    std::list<OutboundMessage> messages_;
+    std::unordered_map<std::string, std::list<OutboundMessage>::iterator> collapseKeyToMessageMap_;
+    bool isClosed_ = false;
+    bool isAboveHighWatermark_ = false;
+    OutboundQueueCounters counters_;
+    Metrics metrics_;
+};
@@ -0,0 +1,184 @@
+#include "os-dependencies.h"
+
+#include "OutboundSpillFile.h"
+
+#include <cerrno>
+#include <charconv>
+#include <filesystem>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+
+namespace
+{
+    std::string ErrorText()
+    {
+        return std::generic_category().message(errno);
+    }
+
+    bool WriteAll(int fd, const std::string& data)
+    {
+        for (size_t writtenBytes = 0; writtenBytes < data.size();)
+        {
+            const auto written = ::write(fd, data.data() + writtenBytes, data.size() - writtenBytes);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            writtenBytes += static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    // Parses "<number> " or "<number>\n" at the position and moves past it
+    bool ParseSize(const std::string& data, size_t& position, char separator, size_t& value)
+    {
+        const auto* begin = data.data() + position;
+        const auto* end = data.data() + data.size();
+        const auto [next, errorCode] = std::from_chars(begin, end, value);
+        if (errorCode != std::errc() || next == begin || next == end || *next != separator)
+        {
+            return false;
+        }
+        position = static_cast<size_t>(next - data.data()) + 1;
+        return true;
+    }
+}
+
+OutboundSpillFile::OutboundSpillFile(std::string path)
+    : path_(std::move(path))
+{
+}
+
+bool OutboundSpillFile::Write(const std::vector<OutboundMessage>& messages) const
+{
+    std::string content;
+    for (const auto& message : messages)
+    {
+        content += std::to_string(message.collapseKey.size()) + ' ' + std::to_string(message.body.size()) + '\n';
+        content += message.collapseKey;
+        content += message.body;
+        content += '\n';
+    }
+
+    // Never opens a file planted under the temporary name: a leftover (or a link) is unlinked, then created anew
+    const auto temporaryPath = path_ + ".tmp";
+    constexpr auto openFlags = O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC;
+    auto fd = ::open(temporaryPath.c_str(), openFlags, 0600);
+    if (fd < 0 && errno == EEXIST && ::unlink(temporaryPath.c_str()) == 0)
+    {
+        fd = ::open(temporaryPath.c_str(), openFlags, 0600);
+    }
+    if (fd < 0)
+    {
+        spdlog::error("Can not create the spill file {}: {}", temporaryPath, ErrorText());
+        return false;
+    }
+
+    // Durable before the rename, so a crash leaves either the old or the complete new file
+    const bool isWritten = WriteAll(fd, content) && ::fsync(fd) == 0;
+    const auto writeErrorText = ErrorText();
+    ::close(fd);
+    if (!isWritten)
+    {
+        spdlog::error("Can not write the spill file {}: {}", temporaryPath, writeErrorText);
+        ::unlink(temporaryPath.c_str());
+        return false;
+    }
+
+    if (::rename(temporaryPath.c_str(), path_.c_str()) != 0)
+    {
+        spdlog::error("Can not move the spill file to {}: {}", path_, ErrorText());
+        ::unlink(temporaryPath.c_str());
+        return false;
+    }
+
+    auto directoryPath = std::filesystem::path(path_).parent_path();
+    if (directoryPath.empty())
+    {
+        directoryPath = ".";
+    }
+    if (const auto directoryFd = ::open(directoryPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC); directoryFd >= 0)
+    {
+        ::fsync(directoryFd);
+        ::close(directoryFd);
+    }
+    return true;
+}
+
+std::vector<OutboundMessage> OutboundSpillFile::Take() const
+{
+    std::vector<OutboundMessage> messages;
+    const auto fd = ::open(path_.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+        {
+            spdlog::error("Can not open the spill file {}: {}", path_, ErrorText());
+        }
+        return messages;
+    }
+
+    // Only a file this user wrote and nobody else can change is published
+    struct stat fileStat{};
+    if (::fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) || fileStat.st_uid != ::geteuid()
+        || (fileStat.st_mode & 022) != 0 || static_cast<uint64_t>(fileStat.st_size) > MAX_FILE_SIZE)
+    {
+        ::close(fd);
+        spdlog::error("The spill file {} is not a private file of this user or too large; not replayed.", path_);
+        return messages;
+    }
+
+    std::string content(static_cast<size_t>(fileStat.st_size), '\0');
+    size_t readBytes = 0;
+    while (readBytes < content.size())
+    {
+        const auto n = ::read(fd, content.data() + readBytes, content.size() - readBytes);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        readBytes += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    content.resize(readBytes);
+
+    size_t position = 0;
+    while (position < content.size())
+    {
+        size_t keySize = 0;
+        size_t bodySize = 0;
+        if (!ParseSize(content, position, ' ', keySize) || !ParseSize(content, position, '\n', bodySize)
+            || keySize > MAX_COLLAPSE_KEY_SIZE || bodySize > MAX_BODY_SIZE
+            || content.size() - position < keySize + bodySize + 1 || content[position + keySize + bodySize] != '\n')
+        {
+            spdlog::warn("The spill file {} ends with a truncated or corrupt record, dropping the rest.", path_);
+            break;
+        }
+
+        OutboundMessage message;
+        message.collapseKey.assign(content, position, keySize);
+        message.body.assign(content, position + keySize, bodySize);
+        position += keySize + bodySize + 1;
+        messages.push_back(std::move(message));
+    }
+
+    if (::unlink(path_.c_str()) != 0)
+    {
+        spdlog::error("Can not remove the spill file {}: {}", path_, ErrorText());
+    }
+    return messages;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "OutboundQueue.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Outbound messages not sent before shutdown, kept on disk for the next start.
+// A record is "<collapse key size> <body size>\n<collapse key><body>\n"; traces are not kept.
+// The file is created with mode 0600 and only replayed if it is a regular file of this user nobody else can write.
+class OutboundSpillFile final
+{
+public:
+    explicit OutboundSpillFile(std::string path);
+
+    // Replaces the file atomically (written and synced next to it, then renamed); returns false on I/O errors
+    bool Write(const std::vector<OutboundMessage>& messages) const;
+    // Reads and removes the file; a truncated or oversized record and the rest after it are dropped
+    [[nodiscard]] std::vector<OutboundMessage> Take() const;
+
+    [[nodiscard]] const std::string& GetPath() const { return path_; }
+
+private:
+    static constexpr uint64_t MAX_FILE_SIZE = 256 * 1024 * 1024;
+    static constexpr size_t MAX_COLLAPSE_KEY_SIZE = 4096;
+    static constexpr size_t MAX_BODY_SIZE = 1024 * 1024;
+
+    std::string path_;
+};
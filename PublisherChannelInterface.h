@@ -0,0 +1,30 @@
+#pragma once
+
+#include "internal/ClassDefHelper.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// One producer (channel) of the RequestPublisher pool, as its sender lane uses it:
+// implemented on an rmqcpp producer, or by a stand-in without a broker (see benchmarks/)
+class PublisherChannelInterface
+{
+public:
+    enum class SendResult : uint8_t
+    {
+        Sending,  // The producer has the message; the confirm callback follows
+        TimedOut, // Too many unconfirmed messages; retry
+        Failed    // The channel is broken
+    };
+
+    // The callback is invoked once, on any thread, with true if the broker confirmed the message
+    virtual SendResult Send(const std::string& body, std::function<void(bool isAcked)> onConfirm,
+                            std::chrono::milliseconds timeout) = 0;
+    // Returns false with a reason if the outstanding confirms did not arrive in time
+    virtual bool WaitForConfirms(std::chrono::milliseconds timeout, std::string& reason) = 0;
+
+    AS_INTERFACE(PublisherChannelInterface);
+    DISALLOW_COPY_MOVE(PublisherChannelInterface);
+};
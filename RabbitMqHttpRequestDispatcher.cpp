@@ -4,7 +4,6 @@
 
 #include "RequestPublisher.h"
 
-#include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 
 
@@ -14,18 +13,33 @@ using namespace BloombergLP;
 RabbitMqHttpRequestDispatcher::RabbitMqHttpRequestDispatcher(
     const std::string& host,
     const std::string& user,
-    const std::string& password
+    const std::string& password,
+    const RequestPublisherSettings& requestPublisherSettings
 )
-    : requestPublisher_(std::make_unique<RequestPublisher>(host, "/", user, password))
+    : requestPublisher_(std::make_unique<RequestPublisher>(host, "/", user, password, requestPublisherSettings))
 {
 }
 
 RabbitMqHttpRequestDispatcher::~RabbitMqHttpRequestDispatcher() = default;
 
-void RabbitMqHttpRequestDispatcher::EnqueueRequest(bool postOrPut, const std::string& urlSuffix,
+void RabbitMqHttpRequestDispatcher::EnqueueRequest(bool postOrPut, const std::string& devicePnpId, const std::string& urlSuffix,
                                           const std::string& payload, const std::string& hint)
 {
     spdlog::info("Publishing to the RabbitMQ queue: {}...", hint);
-    const nlohmann::json jsonPayload = nlohmann::json::parse(payload);
-    requestPublisher_->Publish(jsonPayload, postOrPut ? "POST" : "PUT", urlSuffix);
+    requestPublisher_->Publish(payload, postOrPut ? "POST" : "PUT", urlSuffix, devicePnpId);
+}
+
+bool RabbitMqHttpRequestDispatcher::IsUnderBackpressure() const
+{
+    return requestPublisher_->IsUnderBackpressure();
+}
+
+void RabbitMqHttpRequestDispatcher::Drain(std::chrono::steady_clock::time_point deadline)
+{
+    requestPublisher_->Drain(deadline);
+}
+
+void RabbitMqHttpRequestDispatcher::UpdateSettings(const RequestPublisherSettings& requestPublisherSettings)
+{
+    requestPublisher_->UpdateSettings(requestPublisherSettings);
 }
@@ -3,6 +3,7 @@
 #include "internal/ClassDefHelper.h"
 
 #include "HttpRequestDispatcherInterface.h"
+#include "RequestPublisherSettings.h"
 
 #include <memory>
 #include <string>
@@ -15,7 +16,8 @@ public:
     RabbitMqHttpRequestDispatcher(
         const std::string& host,
         const std::string& user,
-        const std::string& password
+        const std::string& password,
+        const RequestPublisherSettings& requestPublisherSettings
     );
 
     DISALLOW_COPY_MOVE(RabbitMqHttpRequestDispatcher);
@@ -24,11 +26,18 @@ public:
 
     void EnqueueRequest(
         bool postOrPut,
+        const std::string& devicePnpId,
         const std::string& urlSuffix,
         const std::string& payload,
         const std::string& hint
     ) override;
 
+    [[nodiscard]] bool IsUnderBackpressure() const override;
+    void Drain(std::chrono::steady_clock::time_point deadline) override;
+
+    // Configuration reload, see RequestPublisher::UpdateSettings
+    void UpdateSettings(const RequestPublisherSettings& requestPublisherSettings);
+
 private:
     std::unique_ptr<RequestPublisher> requestPublisher_;
 };
@@ -0,0 +1,194 @@
+#include "os-dependencies.h"
+
+#include "RelayHttpRequestDispatcher.h"
+
+#include <Poco/Net/NetException.h>
+#include <Poco/Net/SocketAddress.h>
+#include <Poco/Net/StreamSocket.h>
+#include <Poco/Timespan.h>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <vector>
+
+
+RelayHttpRequestDispatcher::RelayHttpRequestDispatcher(const std::string& socketPath)
+    : socketPath_(socketPath)
+{
+    forwardingThread_ = std::thread(&RelayHttpRequestDispatcher::ForwardingThreadFunction, this);
+}
+
+RelayHttpRequestDispatcher::~RelayHttpRequestDispatcher()
+{
+    if (forwardingThread_.joinable())
+    {
+        Drain(std::chrono::steady_clock::now());
+    }
+}
+
+void RelayHttpRequestDispatcher::Drain(std::chrono::steady_clock::time_point deadline)
+{
+    {
+        std::lock_guard lock(guard_);
+        isStopping_ = true;
+        drainDeadline_ = deadline;
+    }
+    condition_.notify_all();
+    if (forwardingThread_.joinable())
+    {
+        forwardingThread_.join();
+    }
+
+    std::lock_guard lock(guard_);
+    if (!requests_.empty() || droppedRequestCount_ > 0)
+    {
+        spdlog::warn("Relay: {} request(s) not forwarded, {} dropped.", requests_.size(), droppedRequestCount_);
+    }
+}
+
+void RelayHttpRequestDispatcher::EnqueueRequest(bool postOrPut, const std::string& devicePnpId,
+                                                const std::string& urlSuffix,
+                                                const std::string& payload, const std::string& hint)
+{
+    spdlog::info("Forwarding to the relay: {}...", hint);
+    {
+        std::lock_guard lock(guard_);
+        if (requests_.size() >= MAX_QUEUED_REQUESTS)
+        {
+            ++droppedRequestCount_;
+            spdlog::error("Relay queue is full ({} requests), dropping the oldest: {}",
+                          MAX_QUEUED_REQUESTS, requests_.front().hint);
+            requests_.pop_front();
+        }
+        requests_.push_back({postOrPut, devicePnpId, urlSuffix, payload, hint});
+        isUnderBackpressure_.store(requests_.size() >= HIGH_WATERMARK, std::memory_order_relaxed);
+    }
+    condition_.notify_one();
+}
+
+bool RelayHttpRequestDispatcher::IsUnderBackpressure() const
+{
+    return isUnderBackpressure_.load(std::memory_order_relaxed);
+}
+
+void RelayHttpRequestDispatcher::ForwardingThreadFunction()
+{
+    std::vector<relay_protocol::Request> batch;
+    std::string buffer;
+    std::vector<size_t> frameEnds; // The end offset of each request's frame in the buffer
+
+    while (true)
+    {
+        {
+            std::unique_lock lock(guard_);
+            condition_.wait(lock, [this] { return isStopping_ || !requests_.empty(); });
+            if (isStopping_
+                && (requests_.empty() || socket_ == nullptr || std::chrono::steady_clock::now() >= drainDeadline_))
+            {
+                break;
+            }
+
+            while (!requests_.empty() && batch.size() < MAX_BATCH_SIZE)
+            {
+                batch.push_back(std::move(requests_.front()));
+                requests_.pop_front();
+            }
+            isUnderBackpressure_.store(requests_.size() >= HIGH_WATERMARK, std::memory_order_relaxed);
+        }
+
+        buffer.clear();
+        frameEnds.clear();
+        for (const auto& request : batch)
+        {
+            relay_protocol::AppendFrame(buffer, request);
+            frameEnds.push_back(buffer.size());
+        }
+
+        size_t sentBytes = 0;
+        if (EnsureConnected())
+        {
+            try
+            {
+                while (sentBytes < buffer.size())
+                {
+                    sentBytes += socket_->sendBytes(buffer.data() + sentBytes,
+                                                    static_cast<int>(buffer.size() - sentBytes));
+                }
+                spdlog::debug("Relay: {} request(s) forwarded in one write.", batch.size());
+            }
+            catch (const Poco::Exception& ex)
+            {
+                spdlog::warn("Relay: forwarding failed after {} of {} bytes: {}",
+                             sentBytes, buffer.size(), ex.displayText());
+                // The relay drops a partially received frame with the connection; that request is resent whole
+                Disconnect();
+            }
+        }
+
+        // Only the requests whose frames were sent completely are forwarded
+        const auto sentRequestCount = static_cast<size_t>(
+            std::upper_bound(frameEnds.begin(), frameEnds.end(), sentBytes) - frameEnds.begin());
+        if (sentRequestCount == batch.size())
+        {
+            batch.clear();
+            continue;
+        }
+
+        // Put the rest of the batch back in front and retry later, unless stopping
+        std::unique_lock lock(guard_);
+        for (auto it = batch.rbegin(); it != batch.rend() - static_cast<std::ptrdiff_t>(sentRequestCount); ++it)
+        {
+            requests_.push_front(std::move(*it));
+        }
+        batch.clear();
+        condition_.wait_for(lock, std::chrono::milliseconds(RECONNECT_DELAY_IN_MILLISECONDS),
+                            [this] { return isStopping_; });
+        if (isStopping_)
+        {
+            break;
+        }
+    }
+
+    Disconnect();
+}
+
+bool RelayHttpRequestDispatcher::EnsureConnected()
+{
+    if (socket_)
+    {
+        return true;
+    }
+
+    try
+    {
+        auto socket = std::make_unique<Poco::Net::StreamSocket>();
+        socket->connect(Poco::Net::SocketAddress(Poco::Net::SocketAddress::UNIX_LOCAL, socketPath_));
+        socket->setSendTimeout(Poco::Timespan(SEND_TIMEOUT_IN_MILLISECONDS * Poco::Timespan::MILLISECONDS));
+        socket_ = std::move(socket);
+        spdlog::info("Relay: connected to {}.", socketPath_);
+        return true;
+    }
+    catch (const Poco::Exception& ex)
+    {
+        spdlog::warn("Relay: can not connect to {}: {}", socketPath_, ex.displayText());
+        return false;
+    }
+}
+
+void RelayHttpRequestDispatcher::Disconnect()
+{
+    if (!socket_)
+    {
+        return;
+    }
+
+    try
+    {
+        socket_->close();
+    }
+    catch (const Poco::Exception&)
+    {
+    }
+    socket_.reset();
+}
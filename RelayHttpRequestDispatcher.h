@@ -0,0 +1,70 @@
+#pragma once
+
+#include "internal/ClassDefHelper.h"
+
+#include "HttpRequestDispatcherInterface.h"
+#include "RelayProtocol.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace Poco::Net
+{
+    class StreamSocket;
+}
+
+// Forwards requests over a local (Unix domain) socket to a relaying LinuxSoundScanner,
+// which publishes the requests of all its clients via one broker connection.
+class RelayHttpRequestDispatcher final : public HttpRequestDispatcherInterface
+{
+public:
+    explicit RelayHttpRequestDispatcher(const std::string& socketPath);
+
+    DISALLOW_COPY_MOVE(RelayHttpRequestDispatcher);
+
+    ~RelayHttpRequestDispatcher() override;
+
+    void EnqueueRequest(
+        bool postOrPut,
+        const std::string& devicePnpId,
+        const std::string& urlSuffix,
+        const std::string& payload,
+        const std::string& hint
+    ) override;
+
+    [[nodiscard]] bool IsUnderBackpressure() const override;
+    void Drain(std::chrono::steady_clock::time_point deadline) override;
+
+private:
+    static constexpr size_t MAX_QUEUED_REQUESTS = 10000;
+    static constexpr size_t HIGH_WATERMARK = MAX_QUEUED_REQUESTS * 4 / 5;
+    static constexpr size_t MAX_BATCH_SIZE = 256;
+    static constexpr int RECONNECT_DELAY_IN_MILLISECONDS = 1000;
+    // Bounds a write to a stuck relay, so a drain can keep its deadline
+    static constexpr int SEND_TIMEOUT_IN_MILLISECONDS = 1000;
+
+    // Runs in the forwarding thread: batches the queued requests into one write
+    void ForwardingThreadFunction();
+    [[nodiscard]] bool EnsureConnected();
+    void Disconnect();
+
+private:
+    std::string socketPath_;
+    std::unique_ptr<Poco::Net::StreamSocket> socket_;
+
+    mutable std::mutex guard_;
+    std::condition_variable condition_;
+    std::deque<relay_protocol::Request> requests_;
+    bool isStopping_ = false;
+    std::chrono::steady_clock::time_point drainDeadline_ = std::chrono::steady_clock::time_point::max();
+    uint64_t droppedRequestCount_ = 0;
+
+    std::atomic<bool> isUnderBackpressure_{false};
+    std::thread forwardingThread_;
+};
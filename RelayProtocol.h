@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+// Frames exchanged between relay clients (RelayHttpRequestDispatcher) and the relay (RelayServer):
+// a 4-byte big-endian body length, followed by a JSON body carrying one EnqueueRequest call.
+namespace relay_protocol
+{
+    inline constexpr size_t FRAME_HEADER_SIZE = 4;
+    inline constexpr uint32_t MAX_FRAME_BODY_SIZE = 1024 * 1024;
+
+    struct Request
+    {
+        bool postOrPut = true;
+        std::string devicePnpId;
+        std::string urlSuffix;
+        std::string payload;
+        std::string hint;
+    };
+
+    inline void AppendFrame(std::string& buffer, const Request& request)
+    {
+        const nlohmann::json body = {
+            {"postOrPut", request.postOrPut},
+            {"pnpId", request.devicePnpId},
+            {"urlSuffix", request.urlSuffix},
+            {"payload", request.payload},
+            {"hint", request.hint}
+        };
+        const auto bodyString = body.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+        const auto bodySize = static_cast<uint32_t>(bodyString.size());
+
+        buffer.push_back(static_cast<char>((bodySize >> 24) & 0xFF));
+        buffer.push_back(static_cast<char>((bodySize >> 16) & 0xFF));
+        buffer.push_back(static_cast<char>((bodySize >> 8) & 0xFF));
+        buffer.push_back(static_cast<char>(bodySize & 0xFF));
+        buffer += bodyString;
+    }
+
+    inline uint32_t DecodeFrameHeader(const unsigned char (&header)[FRAME_HEADER_SIZE])
+    {
+        return static_cast<uint32_t>(header[0]) << 24
+            | static_cast<uint32_t>(header[1]) << 16
+            | static_cast<uint32_t>(header[2]) << 8
+            | static_cast<uint32_t>(header[3]);
+    }
+
+    // Throws nlohmann::json::exception on a malformed body
+    inline Request DecodeFrameBody(const std::string& bodyString)
+    {
+        const auto body = nlohmann::json::parse(bodyString);
+        return {
+            body.at("postOrPut").get<bool>(),
+            body.at("pnpId").get<std::string>(),
+            body.at("urlSuffix").get<std::string>(),
+            body.at("payload").get<std::string>(),
+            body.at("hint").get<std::string>()
+        };
+    }
+}
@@ -0,0 +1,384 @@
+#include "os-dependencies.h"
+
+#include "RelayServer.h"
+
+#include "HttpRequestDispatcherInterface.h"
+#include "RelayProtocol.h"
+
+#include <Poco/Net/NetException.h>
+#include <Poco/Net/ServerSocket.h>
+#include <Poco/Net/SocketAddress.h>
+#include <Poco/Net/StreamSocket.h>
+#include <Poco/Net/TCPServer.h>
+#include <Poco/Net/TCPServerConnection.h>
+#include <Poco/Net/TCPServerConnectionFactory.h>
+#include <Poco/Net/TCPServerParams.h>
+#include <Poco/Exception.h>
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+#include <grp.h>
+#include <pwd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace
+{
+    // A name, or a number taken as the id itself
+    template <typename ID_T_>
+    std::optional<ID_T_> ParseId(const std::string& nameOrId)
+    {
+        ID_T_ id{};
+        const auto* end = nameOrId.data() + nameOrId.size();
+        if (const auto [ptr, errorCode] = std::from_chars(nameOrId.data(), end, id);
+            errorCode == std::errc() && ptr == end)
+        {
+            return id;
+        }
+        return std::nullopt;
+    }
+
+    size_t GetLookupBufferSize(int name)
+    {
+        const auto size = ::sysconf(name);
+        return size > 0 ? static_cast<size_t>(size) : 16384;
+    }
+
+    gid_t ResolveGroupId(const std::string& nameOrId)
+    {
+        if (const auto id = ParseId<gid_t>(nameOrId))
+        {
+            return *id;
+        }
+        group groupEntry{};
+        group* result = nullptr;
+        std::vector<char> buffer(GetLookupBufferSize(_SC_GETGR_R_SIZE_MAX));
+        if (::getgrnam_r(nameOrId.c_str(), &groupEntry, buffer.data(), buffer.size(), &result) != 0 || !result)
+        {
+            throw std::runtime_error(fmt::format("The relay group {} does not exist", nameOrId));
+        }
+        return result->gr_gid;
+    }
+
+    uid_t ResolveUserId(const std::string& nameOrId)
+    {
+        if (const auto id = ParseId<uid_t>(nameOrId))
+        {
+            return *id;
+        }
+        passwd userEntry{};
+        passwd* result = nullptr;
+        std::vector<char> buffer(GetLookupBufferSize(_SC_GETPW_R_SIZE_MAX));
+        if (::getpwnam_r(nameOrId.c_str(), &userEntry, buffer.data(), buffer.size(), &result) != 0 || !result)
+        {
+            throw std::runtime_error(fmt::format("The relay user {} does not exist", nameOrId));
+        }
+        return result->pw_uid;
+    }
+
+    // SO_PEERCRED has the primary group only; the supplementary groups come from the user's account
+    bool IsUserInGroup(uid_t uid, gid_t groupId)
+    {
+        passwd userEntry{};
+        passwd* result = nullptr;
+        std::vector<char> buffer(GetLookupBufferSize(_SC_GETPW_R_SIZE_MAX));
+        if (::getpwuid_r(uid, &userEntry, buffer.data(), buffer.size(), &result) != 0 || !result)
+        {
+            return false;
+        }
+
+        std::vector<gid_t> groupIds(32);
+        auto groupCount = static_cast<int>(groupIds.size());
+        while (::getgrouplist(result->pw_name, result->pw_gid, groupIds.data(), &groupCount) < 0)
+        {
+            // groupCount now holds the number needed
+            groupIds.resize(std::max(static_cast<size_t>(groupCount), groupIds.size() * 2));
+            groupCount = static_cast<int>(groupIds.size());
+        }
+        groupIds.resize(static_cast<size_t>(groupCount));
+        return std::ranges::find(groupIds, groupId) != groupIds.end();
+    }
+}
+
+
+class RelayServer::ClientConnection final : public Poco::Net::TCPServerConnection
+{
+public:
+    ClientConnection(const Poco::Net::StreamSocket& socket, HttpRequestDispatcherInterface& requestDispatcher,
+                     const std::atomic<bool>& isStopping, const AllowedPeers& allowedPeers)
+        : TCPServerConnection(socket)
+        , requestDispatcher_(requestDispatcher)
+        , isStopping_(isStopping)
+        , allowedPeers_(allowedPeers)
+    {
+    }
+
+    void run() override
+    {
+        // The socket file mode keeps out whom it can; the peer credentials decide, also for listed users
+        // the file mode can not express and for a socket path in a shared directory
+        ucred peerCredentials{};
+        socklen_t peerCredentialsSize = sizeof(peerCredentials);
+        if (getsockopt(socket().impl()->sockfd(), SOL_SOCKET, SO_PEERCRED, &peerCredentials, &peerCredentialsSize) != 0
+            || !allowedPeers_.IsAllowed(peerCredentials.uid, peerCredentials.gid))
+        {
+            spdlog::error("Relay: rejected a client not allowed to relay (uid {}, gid {}, pid {}).",
+                          peerCredentials.uid, peerCredentials.gid, peerCredentials.pid);
+            return;
+        }
+
+        spdlog::info("Relay: client connected (uid {}, pid {}).", peerCredentials.uid, peerCredentials.pid);
+        uint64_t forwardedCount = 0;
+        try
+        {
+            // Wake up regularly, so a stopping relay does not wait for idle clients
+            socket().setReceiveTimeout(Poco::Timespan(RECEIVE_TIMEOUT_IN_SECONDS, 0));
+
+            std::string body;
+            while (true)
+            {
+                unsigned char header[relay_protocol::FRAME_HEADER_SIZE];
+                if (!ReceiveExactly(reinterpret_cast<char*>(header), sizeof(header)))
+                {
+                    break;
+                }
+
+                const auto bodySize = relay_protocol::DecodeFrameHeader(header);
+                if (bodySize > relay_protocol::MAX_FRAME_BODY_SIZE)
+                {
+                    spdlog::error("Relay: frame of {} bytes exceeds the limit, closing the client connection.", bodySize);
+                    break;
+                }
+
+                body.resize(bodySize);
+                if (!ReceiveExactly(body.data(), bodySize))
+                {
+                    break;
+                }
+
+                const auto request = relay_protocol::DecodeFrameBody(body);
+                requestDispatcher_.EnqueueRequest(request.postOrPut, request.devicePnpId, request.urlSuffix, request.payload,
+                                                  "(relayed) " + request.hint);
+                ++forwardedCount;
+            }
+        }
+        catch (const std::exception& ex)
+        {
+            spdlog::error("Relay: client connection failed: {}", ex.what());
+        }
+        spdlog::info("Relay: client disconnected after {} request(s).", forwardedCount);
+    }
+
+private:
+    // Returns false on end of stream or when the relay is stopping
+    bool ReceiveExactly(char* buffer, size_t size)
+    {
+        for (size_t receivedBytes = 0; receivedBytes < size;)
+        {
+            if (isStopping_.load())
+            {
+                return false;
+            }
+
+            int n;
+            try
+            {
+                n = socket().receiveBytes(buffer + receivedBytes, static_cast<int>(size - receivedBytes));
+            }
+            catch (const Poco::TimeoutException&)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+            receivedBytes += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+private:
+    static constexpr int RECEIVE_TIMEOUT_IN_SECONDS = 1;
+
+    HttpRequestDispatcherInterface& requestDispatcher_;
+    const std::atomic<bool>& isStopping_;
+    const AllowedPeers& allowedPeers_;
+};
+
+class RelayServer::ClientConnectionFactory final : public Poco::Net::TCPServerConnectionFactory
+{
+public:
+    ClientConnectionFactory(HttpRequestDispatcherInterface& requestDispatcher, const std::atomic<bool>& isStopping,
+                            const AllowedPeers& allowedPeers)
+        : requestDispatcher_(requestDispatcher)
+        , isStopping_(isStopping)
+        , allowedPeers_(allowedPeers)
+    {
+    }
+
+    Poco::Net::TCPServerConnection* createConnection(const Poco::Net::StreamSocket& socket) override
+    {
+        return new ClientConnection(socket, requestDispatcher_, isStopping_, allowedPeers_);
+    }
+
+private:
+    HttpRequestDispatcherInterface& requestDispatcher_;
+    const std::atomic<bool>& isStopping_;
+    const AllowedPeers& allowedPeers_;
+};
+
+
+bool RelayServer::AllowedPeers::IsAllowed(uid_t uid, gid_t gid) const
+{
+    if (uid == ::geteuid() || std::ranges::find(userIds, uid) != userIds.end())
+    {
+        return true;
+    }
+    return groupId.has_value() && (gid == *groupId || IsUserInGroup(uid, *groupId));
+}
+
+RelayServer::RelayServer(HttpRequestDispatcherInterface& requestDispatcher, const std::string& socketPath,
+                         RelayAccessSettings accessSettings)
+    : requestDispatcher_(requestDispatcher)
+    , socketPath_(socketPath)
+    , accessSettings_(std::move(accessSettings))
+{
+}
+
+RelayServer::AllowedPeers RelayServer::ResolveAllowedPeers(const RelayAccessSettings& accessSettings)
+{
+    AllowedPeers allowedPeers;
+    if (!accessSettings.allowedGroup.empty())
+    {
+        allowedPeers.groupId = ResolveGroupId(accessSettings.allowedGroup);
+    }
+    for (const auto& user : accessSettings.allowedUsers)
+    {
+        allowedPeers.userIds.push_back(ResolveUserId(user));
+    }
+    return allowedPeers;
+}
+
+RelayServer::~RelayServer()
+{
+    Stop();
+}
+
+void RelayServer::Start()
+{
+    if (tcpServer_)
+    {
+        return;
+    }
+
+    allowedPeers_ = ResolveAllowedPeers(accessSettings_);
+    RemoveStaleSocket();
+
+    const Poco::Net::ServerSocket serverSocket(
+        Poco::Net::SocketAddress(Poco::Net::SocketAddress::UNIX_LOCAL, socketPath_));
+    ApplySocketModes();
+
+    auto* params = new Poco::Net::TCPServerParams;
+    params->setMaxThreads(16);
+    params->setMaxQueued(64);
+
+    isStopping_.store(false);
+    tcpServer_ = std::make_unique<Poco::Net::TCPServer>(
+        new ClientConnectionFactory(requestDispatcher_, isStopping_, allowedPeers_), serverSocket, params);
+    tcpServer_->start();
+    spdlog::info("Relay listening on {}.", socketPath_);
+}
+
+void RelayServer::ApplySocketModes() const
+{
+    const bool isOpenToUsers = !allowedPeers_.userIds.empty();
+    const bool isOpenToGroup = !isOpenToUsers && allowedPeers_.groupId.has_value();
+    if (isOpenToGroup && ::chown(socketPath_.c_str(), static_cast<uid_t>(-1), *allowedPeers_.groupId) != 0)
+    {
+        throw std::runtime_error(fmt::format("Can not hand the relay socket {} to group {}",
+                                             socketPath_, *allowedPeers_.groupId));
+    }
+    const mode_t socketMode = isOpenToUsers ? 0666 : isOpenToGroup ? 0660 : 0600;
+    if (::chmod(socketPath_.c_str(), socketMode) != 0)
+    {
+        throw std::runtime_error(fmt::format("Can not set the access to the relay socket {}", socketPath_));
+    }
+    if (!isOpenToUsers && !isOpenToGroup)
+    {
+        return;
+    }
+
+    // Search permission only: the peers can reach the socket by its path but not list the directory.
+    // A directory of another owner, e.g. a shared one, is left as it is.
+    const auto directory = std::filesystem::path(socketPath_).parent_path();
+    struct stat directoryStat{};
+    if (directory.empty() || ::stat(directory.c_str(), &directoryStat) != 0 || directoryStat.st_uid != ::geteuid())
+    {
+        return;
+    }
+    const mode_t directoryMode = (directoryStat.st_mode & 07777) | S_IXGRP | S_IXOTH;
+    if (directoryMode != (directoryStat.st_mode & 07777) && ::chmod(directory.c_str(), directoryMode) != 0)
+    {
+        throw std::runtime_error(fmt::format("Can not open the relay socket directory {}", directory.string()));
+    }
+}
+
+void RelayServer::RemoveStaleSocket() const
+{
+    struct stat fileStat{};
+    if (::lstat(socketPath_.c_str(), &fileStat) != 0)
+    {
+        return;
+    }
+    if (!S_ISSOCK(fileStat.st_mode))
+    {
+        throw std::runtime_error(fmt::format("{} exists and is not a socket", socketPath_));
+    }
+
+    // Only a socket file left behind by a crashed relay may be taken over, not the one of a running relay
+    try
+    {
+        Poco::Net::StreamSocket probeSocket;
+        probeSocket.connect(Poco::Net::SocketAddress(Poco::Net::SocketAddress::UNIX_LOCAL, socketPath_));
+        probeSocket.close();
+    }
+    catch (const Poco::Exception&)
+    {
+        std::error_code errorCode;
+        std::filesystem::remove(socketPath_, errorCode);
+        spdlog::info("Relay: removed the stale socket {}.", socketPath_);
+        return;
+    }
+    throw std::runtime_error(fmt::format("Another relay already listens on {}", socketPath_));
+}
+
+void RelayServer::Stop()
+{
+    if (!tcpServer_)
+    {
+        return;
+    }
+
+    // Client connections reference the dispatcher; let them finish before it goes away
+    isStopping_.store(true);
+    tcpServer_->stop();
+    for (int i = 0; i < CONNECTION_SHUTDOWN_POLL_COUNT && tcpServer_->currentConnections() > 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    tcpServer_.reset();
+
+    std::error_code errorCode;
+    std::filesystem::remove(socketPath_, errorCode);
+    spdlog::info("Relay stopped.");
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "internal/ClassDefHelper.h"
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+class HttpRequestDispatcherInterface;
+
+namespace Poco::Net
+{
+    class TCPServer;
+}
+
+// Who may use the relay besides its own user; by default nobody, e.g. on a multi-seat host the agents of the seat users
+struct RelayAccessSettings
+{
+    std::string allowedGroup;              // Group name or gid; its members may connect. Empty: none
+    std::vector<std::string> allowedUsers; // User names or uids
+};
+
+// Accepts relay clients (RelayHttpRequestDispatcher) on a local (Unix domain) socket
+// and hands their requests to this process' dispatcher, i.e. to its single broker connection.
+class RelayServer final
+{
+    class ClientConnection;
+    class ClientConnectionFactory;
+
+public:
+    RelayServer(HttpRequestDispatcherInterface& requestDispatcher, const std::string& socketPath,
+                RelayAccessSettings accessSettings = {});
+
+    DISALLOW_COPY_MOVE(RelayServer);
+    ~RelayServer();
+
+    // Throws if another relay listens on the socket path or an allowed group or user does not exist
+    void Start();
+    void Stop();
+
+private:
+    struct AllowedPeers
+    {
+        std::optional<gid_t> groupId;
+        std::vector<uid_t> userIds;
+
+        // The relay's own user, a listed user or a member of the group (primary or supplementary)
+        [[nodiscard]] bool IsAllowed(uid_t uid, gid_t gid) const;
+    };
+
+    // Throws if a name can not be resolved
+    [[nodiscard]] static AllowedPeers ResolveAllowedPeers(const RelayAccessSettings& accessSettings);
+    // The socket is opened to the allowed peers (0660 for a group, 0666 for listed users, otherwise 0600);
+    // its directory, if ours, only gets the search permission they need to reach it
+    void ApplySocketModes() const;
+    // Throws if the path is taken by something else than the socket of a crashed relay
+    void RemoveStaleSocket() const;
+
+    HttpRequestDispatcherInterface& requestDispatcher_;
+    std::string socketPath_;
+    RelayAccessSettings accessSettings_;
+    AllowedPeers allowedPeers_;
+    std::atomic<bool> isStopping_{false};
+    std::unique_ptr<Poco::Net::TCPServer> tcpServer_;
+
+    static constexpr int CONNECTION_SHUTDOWN_POLL_COUNT = 30; // 100 ms each
+};
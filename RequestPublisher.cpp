@@ -5,6 +5,11 @@
 #include "RequestPublisher.h"
 
 #include "Contracts.h"
+#include "internal/AllocationAccounting.h"
+#include "internal/JsonUtils.h"
+#include "internal/SpdLogger/DeferredLog.h"
+#include "internal/StallWatchdog.h"
+#include "internal/StartupTrace.h"
 
 #include <rmqa_topology.h>
 #include <rmqa_producer.h>
@@ -18,69 +23,308 @@
 #include <stdexcept>
 
 #include <future>
-#include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 #include <thread>
 #include <chrono>
 #include <algorithm>
+#include <random>
+#include <mutex>
+#include <numeric>
 
 
 using namespace BloombergLP;
 
 
+namespace
+{
+    // The collapse key is "<http request>|<message type>|<PnP id>", see RequestPublisher::Publish
+    std::string GetDevicePnpId(const std::string& collapseKey)
+    {
+        const auto typeEnd = collapseKey.find('|', collapseKey.find('|') + 1);
+        return typeEnd == std::string::npos ? std::string() : collapseKey.substr(typeEnd + 1);
+    }
+
+    bsls::TimeInterval ToTimeInterval(std::chrono::milliseconds duration)
+    {
+        bsls::TimeInterval interval;
+        interval.addMilliseconds(duration.count());
+        return interval;
+    }
+
+    // A lane's channel on an rmqcpp producer
+    class RabbitMqChannel final : public PublisherChannelInterface
+    {
+    public:
+        RabbitMqChannel(bsl::shared_ptr<rmqa::Producer> producer, const char* routingKey)
+            : producer_(std::move(producer))
+            , routingKey_(routingKey)
+        {
+        }
+
+        DISALLOW_COPY_MOVE(RabbitMqChannel);
+        ~RabbitMqChannel() override = default;
+
+        SendResult Send(const std::string& body, std::function<void(bool isAcked)> onConfirm,
+                        std::chrono::milliseconds timeout) override
+        {
+            const auto vecPtr = bsl::make_shared<bsl::vector<uint8_t>>(body.begin(), body.end());
+            const rmqt::Message message(vecPtr);
+
+            const rmqp::Producer::SendStatus sendResult = producer_->send(
+                message,
+                routingKey_,
+                [onConfirm = std::move(onConfirm)](const rmqt::Message&,
+                                                   const bsl::string&,
+                                                   const rmqt::ConfirmResponse& confirm)
+                {
+                    onConfirm(confirm.status() == rmqt::ConfirmResponse::Status::ACK);
+                },
+                ToTimeInterval(timeout));
+            if (sendResult == rmqp::Producer::TIMEOUT)
+            {
+                return SendResult::TimedOut;
+            }
+            return sendResult == rmqp::Producer::SENDING ? SendResult::Sending : SendResult::Failed;
+        }
+
+        bool WaitForConfirms(std::chrono::milliseconds timeout, std::string& reason) override
+        {
+            const auto confirmsResult = producer_->waitForConfirms(ToTimeInterval(timeout));
+            if (!confirmsResult)
+            {
+                reason = fmt::format("{}", confirmsResult.error());
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        bsl::shared_ptr<rmqa::Producer> producer_;
+        const char* routingKey_;
+    };
+}
+
+
 RequestPublisher::~RequestPublisher() noexcept
 {
-    ResetRabbitResources();
+    Drain(std::chrono::steady_clock::now());
+}
+
+void RequestPublisher::Drain(std::chrono::steady_clock::time_point deadline)
+{
+    if (isDrainStarted_.exchange(true))
+    {
+        return;
+    }
+    const auto startTime = std::chrono::steady_clock::now();
+
+    // Stop intake: closed queues drop new messages; the senders keep emptying them while the producers are healthy
+    for (auto& lane : lanes_)
+    {
+        lane.outboundQueue->Close();
+    }
+
+    // Flush: the senders exit once their queue is empty or the producers are broken, or are stopped at the deadline
+    {
+        std::unique_lock lock(supervisorGuard_);
+        supervisorCondition_.wait_until(lock, deadline, [this] { return runningSenderCount_ == 0; });
+        isSendingAborted_.store(true);
+    }
+    supervisorCondition_.notify_all();
+    for (auto& lane : lanes_)
+    {
+        if (lane.senderThread.joinable())
+        {
+            lane.senderThread.join();
+        }
+    }
+    const auto flushedTime = std::chrono::steady_clock::now();
+
+    isStopping_.store(true);
+    supervisorCondition_.notify_all();
+    if (supervisorThread_.joinable())
+    {
+        supervisorThread_.join();
+    }
+
+    // Confirms: whatever time is left; then the connection is closed
+    if (std::chrono::steady_clock::now() >= deadline)
+    {
+        spdlog::warn("Shutdown deadline reached, not waiting for outstanding RabbitMQ confirms.");
+    }
+    {
+        std::unique_lock lock(resourcesGuard_);
+        ReleaseRabbitResources(resources_, deadline);
+    }
+
+    OutboundQueueCounters counters;
+    for (const auto& lane : lanes_)
+    {
+        const auto laneCounters = lane.outboundQueue->GetCounters();
+        counters.enqueued += laneCounters.enqueued;
+        counters.collapsed += laneCounters.collapsed;
+        counters.droppedOldest += laneCounters.droppedOldest;
+        counters.droppedNewest += laneCounters.droppedNewest;
+        counters.blockedPushes += laneCounters.blockedPushes;
+    }
+    spdlog::info("Outbound queue: {} enqueued, {} collapsed, {} dropped oldest, {} dropped newest, {} blocked pushes.",
+                 counters.enqueued, counters.collapsed, counters.droppedOldest, counters.droppedNewest,
+                 counters.blockedPushes);
+    SpillUnsentMessages();
+
+    const auto stopTime = std::chrono::steady_clock::now();
+    spdlog::info("RabbitMQ publisher drained in {} ms ({} ms flushing the queues).",
+                 std::chrono::duration_cast<std::chrono::milliseconds>(stopTime - startTime).count(),
+                 std::chrono::duration_cast<std::chrono::milliseconds>(flushedTime - startTime).count());
+}
+
+void RequestPublisher::ReplaySpilledMessages()
+{
+    if (spillFile_.GetPath().empty())
+    {
+        return;
+    }
+
+    // Ahead of the new inventory, which supersedes them if the queue collapses per device.
+    // The file may hold more than a lane takes if the pool size or the capacity changed since; runs before
+    // the senders, so a full lane must not block.
+    auto spilledMessages = spillFile_.Take();
+    size_t droppedCount = 0;
+    for (auto& message : spilledMessages)
+    {
+        if (!lanes_[GetLaneIndex(GetDevicePnpId(message.collapseKey))].outboundQueue->TryPush(std::move(message)))
+        {
+            ++droppedCount;
+        }
+    }
+    if (!spilledMessages.empty())
+    {
+        spdlog::info("{} message(s) unsent at the previous shutdown replayed from {}.",
+                     spilledMessages.size() - droppedCount, spillFile_.GetPath());
+    }
+    if (droppedCount != 0)
+    {
+        spdlog::warn("{} replayed message(s) dropped, the outbound queue is full.", droppedCount);
+    }
+}
+
+void RequestPublisher::SpillUnsentMessages()
+{
+    std::vector<OutboundMessage> unsentMessages;
+    OutboundMessage message;
+    for (const auto& lane : lanes_)
+    {
+        while (lane.outboundQueue->WaitAndPop(message, std::chrono::milliseconds::zero()))
+        {
+            unsentMessages.push_back(std::move(message));
+        }
+    }
+    if (unsentMessages.empty())
+    {
+        return;
+    }
+
+    if (spillFile_.GetPath().empty())
+    {
+        spdlog::warn("{} queued RabbitMQ message(s) were not sent before shutdown.", unsentMessages.size());
+    }
+    else if (spillFile_.Write(unsentMessages))
+    {
+        spdlog::info("{} queued RabbitMQ message(s) not sent before shutdown, spilled to {}.",
+                     unsentMessages.size(), spillFile_.GetPath());
+    }
+    else
+    {
+        spdlog::warn("{} queued RabbitMQ message(s) were not sent before shutdown and could not be spilled.",
+                     unsentMessages.size());
+    }
 }
 
 
-void RequestPublisher::ResetRabbitResources() noexcept
+void RequestPublisher::ReleaseRabbitResources(RabbitResources& resources,
+                                              std::chrono::steady_clock::time_point confirmsDeadline) noexcept
 {
-    if (producer_)
+    if (!resources.channels.empty())
     {
         spdlog::info("Starting RabbitMQ producer shutdown...");
-        try
+        for (const auto& channel : resources.channels)
         {
-            const auto confirmsResult = producer_->waitForConfirms(
-                bsls::TimeInterval(CONNECTION_THRESHOLD_IN_SECONDS, 0));
-            if (!confirmsResult)
+            // A zero timeout would wait for ever
+            const auto remainingTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                confirmsDeadline - std::chrono::steady_clock::now());
+            if (remainingTime <= std::chrono::milliseconds::zero())
             {
-                spdlog::warn("Timed out waiting for RabbitMQ confirms during shutdown: {}",
-                             confirmsResult.error());
+                break;
+            }
+            try
+            {
+                if (std::string reason; !channel->WaitForConfirms(remainingTime, reason))
+                {
+                    spdlog::warn("Timed out waiting for RabbitMQ confirms during shutdown: {}", reason);
+                }
+            }
+            catch (const std::exception& ex)
+            {
+                spdlog::warn("Failed to flush RabbitMQ producer during shutdown: {}", ex.what());
             }
-        }
-        catch (const std::exception& ex)
-        {
-            spdlog::warn("Failed to flush RabbitMQ producer during shutdown: {}", ex.what());
         }
 
-        producer_.reset();
+        resources.channels.clear();
     }
 
-    if (vHostSmartPtr_)
+    if (resources.vHostSmartPtr)
     {
         spdlog::info("Starting RabbitMQ vhost shutdown...");
         try
         {
-            vHostSmartPtr_->close();
+            resources.vHostSmartPtr->close();
         }
         catch (const std::exception& ex)
         {
             spdlog::warn("Failed to close RabbitMQ vhost during shutdown: {}", ex.what());
         }
 
-        vHostSmartPtr_.reset();
+        resources.vHostSmartPtr.reset();
     }
 
     spdlog::info("Starting freeing RabbitMQ context...");
-    contextSmartPtr_.reset();
+    resources.contextSmartPtr.reset();
     spdlog::info("RabbitMQ resources freed.");
 }
 
 
 RequestPublisher::RequestPublisher(const std::string& host, const std::string& vhost, const std::string& user,
-    const std::string& pass) :
-    contextOptionsSmartPtr_(bsl::make_shared<rmqa::RabbitContextOptions>())
+    const std::string& pass, const RequestPublisherSettings& settings) :
+    RequestPublisher(host, vhost, user, pass, settings, nullptr)
+{
+}
+
+RequestPublisher::RequestPublisher(const RequestPublisherSettings& settings, ChannelFactory channelFactory) :
+    RequestPublisher({}, {}, {}, {}, settings, std::move(channelFactory))
+{
+}
+
+RequestPublisher::RequestPublisher(const std::string& host, const std::string& vhost, const std::string& user,
+    const std::string& pass, const RequestPublisherSettings& settings, ChannelFactory channelFactory) :
+    host_(host)
+    , vhost_(vhost)
+    , user_(user)
+    , pass_(pass)
+    , creationTime_(std::chrono::steady_clock::now())
+    , maxUnconfirmed_(settings.maxUnconfirmed)
+    , contextOptionsSmartPtr_(bsl::make_shared<rmqa::RabbitContextOptions>())
+    , channelFactory_(std::move(channelFactory))
+    , spillFile_(settings.spillFilePath)
+    , publishedCounter_(ed::metrics::Registry::Inst().GetCounter(
+        "soundscanner_rabbitmq_published_total", "Messages handed to a RabbitMQ producer."))
+    , ackedCounter_(ed::metrics::Registry::Inst().GetCounter(
+        "soundscanner_rabbitmq_confirms_total", "Publisher confirms by result.", R"(result="ack")"))
+    , nackedCounter_(ed::metrics::Registry::Inst().GetCounter(
+        "soundscanner_rabbitmq_confirms_total", "Publisher confirms by result.", R"(result="nack")"))
+    , reconnectCounter_(ed::metrics::Registry::Inst().GetCounter(
+        "soundscanner_rabbitmq_reconnects_total", "Attempts to recreate a broken RabbitMQ connection."))
+    , connectedGauge_(ed::metrics::Registry::Inst().GetGauge(
+        "soundscanner_rabbitmq_connected", "1 while the RabbitMQ producers are ready, otherwise 0."))
 {
     contextOptionsSmartPtr_->setConnectionErrorThreshold(
                                bsls::TimeInterval(CONNECTION_THRESHOLD_IN_SECONDS, 0)) // 20 seconds
@@ -89,70 +333,100 @@ RequestPublisher::RequestPublisher(const std::string& host, const std::string& v
                                HandleConnectionError(errorText, errorCode);
                            });
 
-    std::chrono::milliseconds delay(DELAY_BETWEEN_RECONNECTION_ATTEMPTS_IN_MILLISECONDS);
+    const size_t laneCount = std::max<uint16_t>(settings.producerPoolSize, 1);
+    const auto laneQueueSettings = GetLaneQueueSettings(settings.outboundQueue, laneCount);
 
-    for (int attempt = 1; attempt <= MAX_RECONNECTION_ATTEMPTS; ++attempt)
+    lanes_.resize(laneCount);
+    for (auto& lane : lanes_)
     {
-        try
+        lane.outboundQueue = std::make_unique<OutboundQueue>(laneQueueSettings);
+        lane.outboundQueue->SetWatermarkCallback([this](bool isAboveHighWatermark)
         {
-            contextSmartPtr_ = bsl::make_shared<rmqa::RabbitContext>(*contextOptionsSmartPtr_);
+            lanesUnderBackpressure_.fetch_add(isAboveHighWatermark ? 1 : -1);
+        });
+    }
 
-            vHostSmartPtr_ = contextSmartPtr_->createVHostConnection(
-                "sdr-publisher",
-                bsl::make_shared<rmqt::SimpleEndpoint>(host, vhost, 5672),
-                bsl::make_shared<rmqt::PlainCredentials>(user, pass)
-            );
-            if (!vHostSmartPtr_)
-            {
-                throw std::runtime_error("VHost connection failed");
-            }
+    ReplaySpilledMessages();
 
-            rmqa::Topology topology;
-            const auto exchange = topology.addExchange(RQM_EXCHANGE_NAME);
-            const auto queue = topology.addQueue(RQM_QUEUE_NAME);
-            topology.bind(exchange, queue, RQM_ROUTING_KEY);
+    // Connecting blocks for up to CONNECTION_THRESHOLD_IN_SECONDS per attempt; do it in the supervisor thread,
+    // so device monitoring starts immediately and publishes are buffered until the producers are ready
+    isBroken_.store(true);
+    supervisorThread_ = std::thread(&RequestPublisher::SupervisorThreadFunction, this);
+    runningSenderCount_ = lanes_.size();
+    for (size_t laneIndex = 0; laneIndex < lanes_.size(); ++laneIndex)
+    {
+        lanes_[laneIndex].senderThread = std::thread(&RequestPublisher::SenderThreadFunction, this, laneIndex);
+    }
+}
 
-            constexpr unsigned short maxUnconfirmed = 10;
-            spdlog::info("Initializing the RabbitMQ producer on attempt {}/{}.", attempt, MAX_RECONNECTION_ATTEMPTS);
-            auto prodFuture = vHostSmartPtr_->createProducerAsync(topology, exchange, maxUnconfirmed);
+void RequestPublisher::CreateRabbitResources(RabbitResources& resources, int attempt) const
+{
+    if (channelFactory_)
+    {
+        spdlog::info("Creating {} publisher channel(s) on attempt {}.", lanes_.size(), attempt);
+        resources.channels = channelFactory_(lanes_.size());
+        if (resources.channels.size() != lanes_.size())
+        {
+            throw std::runtime_error("The channel factory did not create a channel per lane");
+        }
+        return;
+    }
 
-            // Wait with a timeout so we can break out if host is unreachable
-            spdlog::info("Waiting for RabbitMQ producer (up to {} seconds)...", CONNECTION_THRESHOLD_IN_SECONDS + 5);
-            const auto prodRes = prodFuture.waitResult(
-                bsls::TimeInterval(CONNECTION_THRESHOLD_IN_SECONDS + 5, 0));
-            if (!prodRes)
-            {
-                const auto errorString = fmt::format(
-                    "Producer creation failed: {}. Host: {}, VHost: {}, User: {}",
-                    prodRes.error(), host, vhost, user);
-                spdlog::error(errorString);
-                
-                throw std::runtime_error(errorString);
-            }
+    resources.contextSmartPtr = bsl::make_shared<rmqa::RabbitContext>(*contextOptionsSmartPtr_);
 
-            producer_ = prodRes.value();
+    resources.vHostSmartPtr = resources.contextSmartPtr->createVHostConnection(
+        "sdr-publisher",
+        bsl::make_shared<rmqt::SimpleEndpoint>(host_, vhost_, 5672),
+        bsl::make_shared<rmqt::PlainCredentials>(user_, pass_)
+    );
+    if (!resources.vHostSmartPtr)
+    {
+        throw std::runtime_error("VHost connection failed");
+    }
 
-            spdlog::info("RabbitMQ producer initialized on attempt {}.", attempt);
-            break;
-        }
-        catch (const std::exception& ex)
-        {
-            ResetRabbitResources();
+    rmqa::Topology topology;
+    const auto exchange = topology.addExchange(RQM_EXCHANGE_NAME);
+    const auto queue = topology.addQueue(RQM_QUEUE_NAME);
+    topology.bind(exchange, queue, RQM_ROUTING_KEY);
 
-            if (attempt == MAX_RECONNECTION_ATTEMPTS)
-            {
-                spdlog::error("RabbitMQ initialization failed after {} attempts: {}", MAX_RECONNECTION_ATTEMPTS, ex.what());
-                throw;
-            }
+    spdlog::info("Initializing {} RabbitMQ producer(s) on attempt {} (max. {} unconfirmed each).",
+                 lanes_.size(), attempt, maxUnconfirmed_);
+
+    // Each producer gets its own channel on the vhost connection
+    std::vector<rmqt::Future<rmqa::Producer>> prodFutures;
+    prodFutures.reserve(lanes_.size());
+    for (size_t laneIndex = 0; laneIndex < lanes_.size(); ++laneIndex)
+    {
+        prodFutures.push_back(resources.vHostSmartPtr->createProducerAsync(topology, exchange, maxUnconfirmed_));
+    }
 
-            spdlog::warn(
-                "RabbitMQ init attempt {}/{} failed: {}. Retrying in {} ms...",
-                attempt, MAX_RECONNECTION_ATTEMPTS, ex.what(), delay.count());
+    // Wait with a timeout so we can break out if host is unreachable; in slices, so a drain need not wait.
+    // A slice ending early is a failure rather than a timeout.
+    spdlog::info("Waiting for RabbitMQ producer(s) (up to {} seconds)...", CONNECTION_THRESHOLD_IN_SECONDS + 5);
+    const auto waitDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(CONNECTION_THRESHOLD_IN_SECONDS + 5);
+    constexpr std::chrono::milliseconds waitSlice(PRODUCER_WAIT_SLICE_IN_MILLISECONDS);
+    for (auto& prodFuture : prodFutures)
+    {
+        auto sliceStartTime = std::chrono::steady_clock::now();
+        auto prodRes = prodFuture.waitResult(ToTimeInterval(waitSlice));
+        while (!prodRes && !isStopping_.load()
+            && std::chrono::steady_clock::now() - sliceStartTime >= waitSlice
+            && std::chrono::steady_clock::now() < waitDeadline)
+        {
+            sliceStartTime = std::chrono::steady_clock::now();
+            prodRes = prodFuture.waitResult(ToTimeInterval(waitSlice));
+        }
+        if (!prodRes)
+        {
+            const auto errorString = fmt::format(
+                "Producer creation failed: {}. Host: {}, VHost: {}, User: {}",
+                prodRes.error(), host_, vhost_, user_);
+            spdlog::error(errorString);
 
-            std::this_thread::sleep_for(delay);
-            
-            delay = std::min(delay * 2, std::chrono::milliseconds(MAX_DELAY_BETWEEN_RECONNECTION_ATTEMPTS_IN_MILLISECONDS)); // Exponential
+            throw std::runtime_error(errorString);
         }
+
+        resources.channels.push_back(std::make_unique<RabbitMqChannel>(prodRes.value(), RQM_ROUTING_KEY));
     }
 }
 
@@ -163,47 +437,319 @@ void RequestPublisher::HandleConnectionError(const bsl::string& errorText, int e
                   errorCode,
                   errorText);
 
+    // Called on an rmqcpp thread: only flag the supervisor, never block here
+    connectedGauge_.Set(0);
+    isBroken_.store(true);
+    supervisorCondition_.notify_all();
 }
 
-void RequestPublisher::Publish(const nlohmann::json& payload, const std::string& httpRequest,
-                               const std::string& urlSuffix) const
+void RequestPublisher::SupervisorThreadFunction()
 {
-    // Prepare message
-    nlohmann::json payloadExtended(payload);
-    payloadExtended[std::string(contracts::message_fields::HTTP_REQUEST)] = httpRequest;
-    payloadExtended[std::string(contracts::message_fields::URL_SUFFIX)] = urlSuffix;
+    while (!isStopping_.load())
+    {
+        {
+            std::unique_lock lock(supervisorGuard_);
+            supervisorCondition_.wait_for(lock, std::chrono::seconds(1), [this]
+            {
+                return isStopping_.load() || isBroken_.load();
+            });
+        }
 
-    const std::string msgStr = payloadExtended.dump();
-    const auto vecPtr = bsl::make_shared<bsl::vector<uint8_t>>(msgStr.begin(), msgStr.end());
-    const rmqt::Message message(vecPtr);
+        if (!isStopping_.load() && isBroken_.load())
+        {
+            RecreateRabbitResources();
+        }
+    }
+}
 
+void RequestPublisher::RecreateRabbitResources()
+{
+    const bool isInitialConnection = !hasBeenConnected_.load();
+    if (isInitialConnection)
+    {
+        spdlog::info("Connecting to RabbitMQ in the background...");
+    }
+    else
+    {
+        spdlog::warn("RabbitMQ connection is broken, recreating the producer(s) in the background...");
+    }
 
-    const rmqp::Producer::SendStatus sendResult =
-        producer_->send(
-            message,
-            RQM_ROUTING_KEY,
-            [msgStr](const rmqt::Message&,
-                     const bsl::string& routingKey,
-                     const rmqt::ConfirmResponse& confirm)
+    RabbitResources brokenResources;
+    {
+        std::unique_lock lock(resourcesGuard_);
+        std::swap(brokenResources, resources_);
+    }
+    // Confirms of a broken producer never arrive; do not wait for them
+    ReleaseRabbitResources(brokenResources, std::chrono::steady_clock::time_point{});
+
+    std::chrono::milliseconds delay(DELAY_BETWEEN_RECONNECTION_ATTEMPTS_IN_MILLISECONDS);
+    for (int attempt = 1; !isStopping_.load(); ++attempt)
+    {
+        RabbitResources newResources;
+        try
+        {
+            if (!isInitialConnection)
             {
-                if (confirm.status() == rmqt::ConfirmResponse::Status::ACK)
-                {
-                    spdlog::info("Message ACKed ({}): {}", routingKey, msgStr);
-                }
-                else
+                reconnectCounter_.Increment();
+            }
+            CreateRabbitResources(newResources, attempt);
+
+            {
+                std::unique_lock lock(resourcesGuard_);
+                resources_ = std::move(newResources);
+            }
+            // Only now: the senders wait while the flag is set, instead of spinning on missing producers
+            isBroken_.store(false);
+            connectedGauge_.Set(1);
+            if (isInitialConnection)
+            {
+                hasBeenConnected_.store(true);
+                spdlog::info("RabbitMQ producer(s) ready {} ms after start (attempt {}), {} message(s) queued.",
+                             std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 std::chrono::steady_clock::now() - creationTime_).count(),
+                             attempt, GetQueuedMessageCount());
+            }
+            else
+            {
+                spdlog::info("RabbitMQ producer(s) recreated on attempt {}, {} message(s) queued.",
+                             attempt, GetQueuedMessageCount());
+            }
+            supervisorCondition_.notify_all();
+            return;
+        }
+        catch (const std::exception& ex)
+        {
+            isBroken_.store(true);
+            ReleaseRabbitResources(newResources, std::chrono::steady_clock::time_point{});
+
+            const auto jitteredDelay = NextJitteredDelay(delay);
+            spdlog::warn("RabbitMQ reconnect attempt {} failed: {}. Retrying in {} ms...",
+                         attempt, ex.what(), jitteredDelay.count());
+
+            std::unique_lock lock(supervisorGuard_);
+            supervisorCondition_.wait_for(lock, jitteredDelay, [this] { return isStopping_.load(); });
+        }
+    }
+}
+
+std::chrono::milliseconds RequestPublisher::NextJitteredDelay(std::chrono::milliseconds& delay) const
+{
+    thread_local std::mt19937 generator{std::random_device{}()};
+
+    // "Equal jitter": half of the delay is fixed, the other half random, so restarted agents spread out
+    std::uniform_int_distribution<std::chrono::milliseconds::rep> distribution(0, delay.count() / 2);
+    const auto jitteredDelay = std::chrono::milliseconds(delay.count() / 2 + distribution(generator));
+
+    delay = std::min(delay * 2, std::chrono::milliseconds(MAX_DELAY_BETWEEN_RECONNECTION_ATTEMPTS_IN_MILLISECONDS));
+    return jitteredDelay;
+}
+
+void RequestPublisher::Publish(const std::string& payload, const std::string& httpRequest,
+                               const std::string& urlSuffix, const std::string& devicePnpId)
+{
+    ALLOCATION_SCOPE(RequestPublisher);
+    WATCHDOG_SCOPE();
+
+    // Splice the routing fields in front of the payload's closing brace instead of re-serializing it
+    const auto closingBracePos = payload.find_last_of('}');
+    if (closingBracePos == std::string::npos)
+    {
+        spdlog::error("Dropping a payload that is not a JSON object: {}", payload);
+        return;
+    }
+    const bool isEmptyObject = payload.find_first_not_of(" \t\r\n", payload.find('{') + 1) == closingBracePos;
+
+    std::string message;
+    message.reserve(payload.size() + httpRequest.size() + urlSuffix.size() + 32);
+    message.append(payload, 0, closingBracePos);
+    if (!isEmptyObject)
+    {
+        message.push_back(',');
+    }
+    ed::AppendJsonString(message, contracts::message_fields::HTTP_REQUEST);
+    message.push_back(':');
+    ed::AppendJsonString(message, httpRequest);
+    message.push_back(',');
+    ed::AppendJsonString(message, contracts::message_fields::URL_SUFFIX);
+    message.push_back(':');
+    ed::AppendJsonString(message, urlSuffix);
+    message.append(payload, closingBracePos);
+
+    // Messages of the same request kind, message type and device supersede each other.
+    // The key ends with the raw PnP id, which a replayed message is routed by as well (see GetDevicePnpId).
+    auto collapseKey = fmt::format("{}|{}|{}",
+        httpRequest,
+        ed::FindJsonNumberField(payload, contracts::message_fields::DEVICE_MESSAGE_TYPE),
+        devicePnpId);
+
+    auto trace = ed::tracing::CurrentEventTrace();
+    trace.CompleteStage(ed::tracing::EventStage::Encode);
+
+    lanes_[GetLaneIndex(devicePnpId)].outboundQueue->Push({std::move(collapseKey), std::move(message), trace});
+}
+
+bool RequestPublisher::IsUnderBackpressure() const
+{
+    return lanesUnderBackpressure_.load(std::memory_order_relaxed) > 0;
+}
+
+void RequestPublisher::UpdateSettings(const RequestPublisherSettings& settings)
+{
+    const auto laneQueueSettings = GetLaneQueueSettings(settings.outboundQueue, lanes_.size());
+    for (const auto& lane : lanes_)
+    {
+        lane.outboundQueue->UpdateSettings(laneQueueSettings);
+    }
+
+    if (std::max<uint16_t>(settings.producerPoolSize, 1) != lanes_.size() || settings.maxUnconfirmed != maxUnconfirmed_
+        || settings.spillFilePath != spillFile_.GetPath())
+    {
+        spdlog::warn("The producer pool size, the unconfirmed limit and the spill file take effect after a restart.");
+    }
+}
+
+OutboundQueueSettings RequestPublisher::GetLaneQueueSettings(OutboundQueueSettings settings, size_t laneCount)
+{
+    settings.capacity = std::max<size_t>(settings.capacity / laneCount, 1);
+    settings.highWatermark = settings.highWatermark / laneCount;
+    settings.lowWatermark = settings.lowWatermark / laneCount;
+    return settings;
+}
+
+size_t RequestPublisher::GetLaneIndex(const std::string& devicePnpId) const
+{
+    return lanes_.size() == 1 ? 0 : std::hash<std::string>{}(devicePnpId) % lanes_.size();
+}
+
+bool RequestPublisher::IsLaneReady(size_t laneIndex) const
+{
+    if (isBroken_.load())
+    {
+        return false;
+    }
+    std::shared_lock lock(resourcesGuard_);
+    return laneIndex < resources_.channels.size();
+}
+
+size_t RequestPublisher::GetQueuedMessageCount() const
+{
+    return std::accumulate(lanes_.begin(), lanes_.end(), size_t{0}, [](size_t sum, const ProducerLane& lane)
+    {
+        return sum + lane.outboundQueue->GetSize();
+    });
+}
+
+void RequestPublisher::SenderThreadFunction(size_t laneIndex)
+{
+    const ed::watchdog::ScopedThreadRegistration watchdogRegistration(fmt::format("publisher-lane-{}", laneIndex));
+    auto& outboundQueue = *lanes_[laneIndex].outboundQueue;
+
+    OutboundMessage message;
+    while (true)
+    {
+        if (!outboundQueue.WaitAndPop(message, std::chrono::seconds(1)))
+        {
+            if (outboundQueue.IsClosed())
+            {
+                break;
+            }
+            continue;
+        }
+        if (isSendingAborted_.load())
+        {
+            outboundQueue.PushFront(std::move(message));
+            break;
+        }
+
+        // Wait for the lane's producer, also through the reconnect backoff; on shutdown give up if there is none
+        while (!IsLaneReady(laneIndex) && !outboundQueue.IsClosed())
+        {
+            std::unique_lock lock(supervisorGuard_);
+            supervisorCondition_.wait_for(lock, std::chrono::milliseconds(200), [this, laneIndex, &outboundQueue]
+            {
+                return IsLaneReady(laneIndex) || outboundQueue.IsClosed();
+            });
+        }
+
+        bool isSent = false;
+        if (!isBroken_.load())
+        {
+            std::shared_lock lock(resourcesGuard_);
+            isSent = laneIndex < resources_.channels.size() && SendLocked(laneIndex, message.body, message.trace);
+        }
+
+        if (!isSent)
+        {
+            // A send that timed out is retried while draining; a broken producer ends the flush
+            outboundQueue.PushFront(std::move(message));
+            if (isSendingAborted_.load() || (outboundQueue.IsClosed() && !IsLaneReady(laneIndex)))
+            {
+                break;
+            }
+        }
+    }
+
+    {
+        std::lock_guard lock(supervisorGuard_);
+        --runningSenderCount_;
+    }
+    supervisorCondition_.notify_all();
+}
+
+bool RequestPublisher::SendLocked(size_t laneIndex, const std::string& msgStr, ed::tracing::EventTrace trace)
+{
+    ALLOCATION_SCOPE(RequestPublisher);
+    WATCHDOG_SCOPE();
+    // The confirm may arrive on another thread before send() returns, so its stage starts before the call
+    const auto sendTime = ed::tracing::Clock::now();
+    auto ackTrace = trace;
+    ackTrace.stageStartTime = sendTime;
+
+    const auto sendResult = resources_.channels[laneIndex]->Send(
+        msgStr,
+        [this, msgStr, ackTrace](bool isAcked) mutable
+        {
+            ALLOCATION_SCOPE(RequestPublisher);
+            if (isAcked)
+            {
+                ackTrace.CompleteStage(ed::tracing::EventStage::Ack);
+                ackTrace.CompleteEndToEnd();
+                if (ackTrace.inventoryMessageNumber != 0)
                 {
-                    spdlog::error("Message NOT ACKed ({}): {}", routingKey, msgStr);
+                    ed::StartupTrace::Inst().ConfirmInventoryMessage(ackTrace.inventoryMessageNumber);
                 }
+                ackedCounter_.Increment();
+                // Full-payload logging is optional work, shed under backpressure
+                ed::model::DeferredLog::Inst().Log(
+                    IsUnderBackpressure() ? spdlog::level::debug : spdlog::level::info,
+                    "Message ACKed ({}): {}", RQM_ROUTING_KEY, msgStr);
             }
-        );
-    if (sendResult != rmqp::Producer::SENDING)
+            else
+            {
+                nackedCounter_.Increment();
+                spdlog::error("Message NOT ACKed ({}): {}", RQM_ROUTING_KEY, msgStr);
+            }
+        },
+        std::chrono::milliseconds(SEND_TIMEOUT_IN_MILLISECONDS));
+    if (sendResult == PublisherChannelInterface::SendResult::TimedOut)
     {
-        spdlog::error("Unable to enqueue message {}.", msgStr);
+        spdlog::debug("Sending on lane {} timed out waiting for confirms, retrying.", laneIndex);
+        return false;
     }
-    else
+    if (sendResult != PublisherChannelInterface::SendResult::Sending)
     {
-        spdlog::debug("Message enqueued: {}.", msgStr);
+        spdlog::error("Unable to enqueue message {}, marking the producer as broken.", msgStr);
+        connectedGauge_.Set(0);
+        isBroken_.store(true);
+        supervisorCondition_.notify_all();
+        return false;
     }
+
+    // A failed send is retried, so the stage is recorded only once the producer has the message
+    trace.CompleteStage(ed::tracing::EventStage::Send, sendTime);
+    publishedCounter_.Increment();
+    spdlog::debug("Message enqueued on lane {}: {}.", laneIndex, msgStr);
+    return true;
 }
 
 //TODO: why these 3 are unresolved and I need this ugly code?
@@ -2,42 +2,146 @@
 
 #include <rmqa_rabbitcontext.h>
 #include <rmqa_vhost.h>
-#include <nlohmann/json_fwd.hpp>
 
+#include "OutboundSpillFile.h"
+#include "PublisherChannelInterface.h"
+#include "RequestPublisherSettings.h"
+#include "internal/Metrics.h"
+
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 class RequestPublisher
 {
 public:
+    // Creates the channels of one connection attempt, one per lane; throws if they can not be established
+    using ChannelFactory = std::function<std::vector<std::unique_ptr<PublisherChannelInterface>>(size_t channelCount)>;
+
     RequestPublisher(
         const std::string& host,
         const std::string& vhost,
         const std::string& user,
-        const std::string& pass);
+        const std::string& pass,
+        const RequestPublisherSettings& settings);
+    // Publishes through the factory's channels instead of a RabbitMQ connection, e.g. to benchmark the lanes
+    RequestPublisher(const RequestPublisherSettings& settings, ChannelFactory channelFactory);
 
     ~RequestPublisher() noexcept;
 
+    // The payload must be a serialized JSON object; httpRequest and urlSuffix are spliced into it.
+    // The raw (unescaped) PnP id picks the producer lane, so all messages of a device keep their order.
     void Publish(
-        const nlohmann::json& payload,
+        const std::string& payload,
         const std::string& httpRequest,
-        const std::string& urlSuffix) const;
+        const std::string& urlSuffix,
+        const std::string& devicePnpId);
+
+    // True while any producer lane's outbound queue is above its high watermark
+    [[nodiscard]] bool IsUnderBackpressure() const;
+
+    // Configuration reload: the outbound queue settings are applied to the lanes at once;
+    // the producer settings and the spill file need new producers, they take effect after a restart
+    void UpdateSettings(const RequestPublisherSettings& settings);
+
+    // Phased shutdown against one deadline: stop intake, flush the queues, wait for the confirms,
+    // then spill what is left. Once only; the destructor drains with no time left if not called before.
+    void Drain(std::chrono::steady_clock::time_point deadline);
 
     void HandleConnectionError(const bsl::string& errorText, int errorCode);
 
 private:
+    // The context and the vhost stay empty with a channel factory
+    struct RabbitResources
+    {
+        bsl::shared_ptr<BloombergLP::rmqa::RabbitContext> contextSmartPtr;
+        bsl::shared_ptr<BloombergLP::rmqa::VHost> vHostSmartPtr;
+        std::vector<std::unique_ptr<PublisherChannelInterface>> channels;
+    };
+
+    // One producer (channel) with its own queue and sender thread; a device always maps to the same lane,
+    // so its messages stay in order while independent devices are published in parallel
+    struct ProducerLane
+    {
+        std::unique_ptr<OutboundQueue> outboundQueue;
+        std::thread senderThread;
+    };
+
     static constexpr auto RQM_EXCHANGE_NAME = "sdr_exchange";
     static constexpr auto RQM_QUEUE_NAME = "sdr_queue";
     static constexpr auto RQM_ROUTING_KEY = "sdr_bind";
 
     static constexpr int CONNECTION_THRESHOLD_IN_SECONDS = 20;
-    static constexpr int MAX_RECONNECTION_ATTEMPTS = 8;
     static constexpr int DELAY_BETWEEN_RECONNECTION_ATTEMPTS_IN_MILLISECONDS = 2000;
     static constexpr int MAX_DELAY_BETWEEN_RECONNECTION_ATTEMPTS_IN_MILLISECONDS = 30000;
+    // Blocking waits are sliced, so a drain is not held up by a full producer or an unreachable host
+    static constexpr int SEND_TIMEOUT_IN_MILLISECONDS = 1000;
+    static constexpr int PRODUCER_WAIT_SLICE_IN_MILLISECONDS = 250;
+
+    RequestPublisher(const std::string& host, const std::string& vhost, const std::string& user,
+                     const std::string& pass, const RequestPublisherSettings& settings, ChannelFactory channelFactory);
 
-    void ResetRabbitResources() noexcept;
+    // Throws if the vhost connection or a producer can not be established
+    void CreateRabbitResources(RabbitResources& resources, int attempt) const;
+    // Waits for the outstanding confirms until the deadline; a past deadline does not wait at all
+    static void ReleaseRabbitResources(RabbitResources& resources,
+                                       std::chrono::steady_clock::time_point confirmsDeadline) noexcept;
+
+    // Runs in the supervisor thread: rebuilds a broken context / vhost / producers in the background
+    void SupervisorThreadFunction();
+    void RecreateRabbitResources();
+    [[nodiscard]] std::chrono::milliseconds NextJitteredDelay(std::chrono::milliseconds& delay) const;
+
+    // Runs in a lane's sender thread: drains the lane's outbound queue into the lane's producer
+    void SenderThreadFunction(size_t laneIndex);
+    // Requires resourcesGuard_ to be locked (shared)
+    bool SendLocked(size_t laneIndex, const std::string& msgStr, ed::tracing::EventTrace trace);
+
+    [[nodiscard]] size_t GetLaneIndex(const std::string& devicePnpId) const;
+    // The channels are installed and not reported broken
+    [[nodiscard]] bool IsLaneReady(size_t laneIndex) const;
+    // The queue settings are split evenly across the lanes
+    [[nodiscard]] static OutboundQueueSettings GetLaneQueueSettings(OutboundQueueSettings settings, size_t laneCount);
+    [[nodiscard]] size_t GetQueuedMessageCount() const;
+    void ReplaySpilledMessages();
+    void SpillUnsentMessages();
+
+    std::string host_;
+    std::string vhost_;
+    std::string user_;
+    std::string pass_;
+    std::chrono::steady_clock::time_point creationTime_;
+    uint16_t maxUnconfirmed_;
 
     bsl::shared_ptr<BloombergLP::rmqa::RabbitContextOptions> contextOptionsSmartPtr_;
-    bsl::shared_ptr<BloombergLP::rmqa::RabbitContext> contextSmartPtr_;
-    bsl::shared_ptr<BloombergLP::rmqa::VHost> vHostSmartPtr_;
-    bsl::shared_ptr<BloombergLP::rmqa::Producer> producer_;
+    ChannelFactory channelFactory_; // Empty: channels on a RabbitMQ connection
+
+    mutable std::shared_mutex resourcesGuard_;
+    RabbitResources resources_;
+
+    std::vector<ProducerLane> lanes_;
+    std::atomic<int> lanesUnderBackpressure_{0};
+    OutboundSpillFile spillFile_;
+
+    ed::metrics::Counter& publishedCounter_;
+    ed::metrics::Counter& ackedCounter_;
+    ed::metrics::Counter& nackedCounter_;
+    ed::metrics::Counter& reconnectCounter_;
+    ed::metrics::Gauge& connectedGauge_;
+
+    std::atomic<bool> isBroken_{false};
+    std::atomic<bool> hasBeenConnected_{false};
+    std::atomic<bool> isStopping_{false};
+    std::atomic<bool> isDrainStarted_{false};
+    std::atomic<bool> isSendingAborted_{false};
+    std::mutex supervisorGuard_;
+    std::condition_variable supervisorCondition_;
+    size_t runningSenderCount_ = 0; // Guarded by supervisorGuard_
+    std::thread supervisorThread_;
 };
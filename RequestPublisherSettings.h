@@ -0,0 +1,14 @@
+#pragma once
+
+#include "OutboundQueue.h"
+
+#include <cstdint>
+#include <string>
+
+struct RequestPublisherSettings
+{
+    OutboundQueueSettings outboundQueue; // Split evenly across the producer lanes
+    uint16_t maxUnconfirmed = 10;        // Per producer (channel)
+    uint16_t producerPoolSize = 1;       // Producers (channels) on the one vhost connection
+    std::string spillFilePath;           // Messages unsent at shutdown, replayed on start; empty: dropped
+};
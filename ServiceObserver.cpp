@@ -2,7 +2,12 @@
 
 #include <iostream>
 
-#include "AudioDeviceApiClient.h"
+#include "HttpRequestDispatcherInterface.h"
+#include "internal/AllocationAccounting.h"
+#include "internal/EventTrace.h"
+#include "internal/SpdLogger/DeferredLog.h"
+#include "internal/StallWatchdog.h"
+#include "internal/StartupTrace.h"
 
 #include <spdlog/spdlog.h>
 #include "magic_enum/magic_enum.hpp"
@@ -18,29 +23,40 @@ ServiceObserver::ServiceObserver(SoundDeviceCollectionInterface& collection,
                                  )
     : collection_(collection)
     , requestProcessorInterface_(requestProcessor)
+    , apiClient_(requestProcessor, GetHostName(), GetOperationSystemName())
+    , creationTime_(std::chrono::steady_clock::now())
 {
 }
 
-void ServiceObserver::PostDeviceToApi(const SoundDeviceEventType messageType, const SoundDeviceInterface* devicePtr, const std::string & hintPrefix) const
+void ServiceObserver::PostDeviceToApi(const SoundDeviceEventType messageType, const DeviceRecord& device, const std::string & hintPrefix) const
 {
-    const AudioDeviceApiClient apiClient(requestProcessorInterface_, GetHostName, GetOperationSystemName);
-    apiClient.PostDeviceToApi(messageType, devicePtr, hintPrefix);
+    apiClient_.PostDeviceToApi(messageType, device, hintPrefix);
 }
 
 void ServiceObserver::PutVolumeChangeToApi(const std::string & pnpId, bool renderOrCapture, uint16_t volume, const std::string & hintPrefix) const
 {
-	const AudioDeviceApiClient apiClient(requestProcessorInterface_, GetHostName, GetOperationSystemName);
-	apiClient.PutVolumeChangeToApi(pnpId, renderOrCapture, volume, hintPrefix);
+	apiClient_.PutVolumeChangeToApi(pnpId, renderOrCapture, volume, hintPrefix);
 }
 
 void ServiceObserver::OnCollectionChanged(SoundDeviceEventType event, const std::string & devicePnpId)
 {
-    spdlog::info("Event caught: {}, device PnP id: {}.", magic_enum::enum_name(event), devicePnpId);
+    ALLOCATION_SCOPE(ServiceObserver);
+    WATCHDOG_SCOPE();
+    // Per-event info logging is optional work, shed while the dispatcher is congested
+    ed::model::DeferredLog::Inst().Log(
+        requestProcessorInterface_.IsUnderBackpressure() ? spdlog::level::debug : spdlog::level::info,
+        "Event caught: {}, device PnP id: {}.", magic_enum::enum_name(event), devicePnpId);
+    if (!isFirstEventReported_)
+    {
+        isFirstEventReported_ = true;
+        spdlog::info("First device captured {} ms after start.",
+                     std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - creationTime_).count());
+    }
 
-    const auto soundDeviceInterface = collection_.CreateItem(devicePnpId);
-    if (!soundDeviceInterface)
+    if (!collection_.TryFind(devicePnpId, deviceRecord_))
     {
-        spdlog::warn("Sound device with PnP id cannot be initialized.", devicePnpId);
+        spdlog::warn("Sound device with PnP id {} cannot be found.", devicePnpId);
         return;
     }
 
@@ -48,12 +64,19 @@ void ServiceObserver::OnCollectionChanged(SoundDeviceEventType event, const std:
     if (event == SoundDeviceEventType::Discovered || event == SoundDeviceEventType::Confirmed)
     {
 		const bool discoveredOrConfirmed = event == SoundDeviceEventType::Discovered;
-        PostDeviceToApi(event, soundDeviceInterface.get(), discoveredOrConfirmed ? "(by device discovery) " : "(by device inventory) ");
+        // The number travels with the message to the broker confirm, see StartupTrace::ConfirmInventoryMessage
+        auto trace = ed::tracing::CurrentEventTrace();
+        if (!discoveredOrConfirmed)
+        {
+            trace.inventoryMessageNumber = ed::StartupTrace::Inst().AddInventoryMessage();
+        }
+        const ed::tracing::ScopedEventTrace eventTrace(trace);
+        PostDeviceToApi(event, deviceRecord_, discoveredOrConfirmed ? "(by device discovery) " : "(by device inventory) ");
     }
     else if (event == SoundDeviceEventType::VolumeRenderChanged || event == SoundDeviceEventType::VolumeCaptureChanged)
     {
 		const bool renderOrCapture = event == SoundDeviceEventType::VolumeRenderChanged;
-        PutVolumeChangeToApi(devicePnpId, renderOrCapture, renderOrCapture ? soundDeviceInterface->GetCurrentRenderVolume() : soundDeviceInterface->GetCurrentCaptureVolume());
+        PutVolumeChangeToApi(devicePnpId, renderOrCapture, renderOrCapture ? deviceRecord_.renderVolume : deviceRecord_.captureVolume);
     }
     else if (event == SoundDeviceEventType::Detached)
     {
@@ -66,7 +89,7 @@ void ServiceObserver::OnCollectionChanged(SoundDeviceEventType event, const std:
 
 }
 
-std::string ServiceObserver::GetHostName()
+const std::string& ServiceObserver::GetHostName()
 {
     // ReSharper disable once CppInconsistentNaming
     constexpr size_t MAX_COMPUTER_NAME_LENGTH = 256;
@@ -90,7 +113,7 @@ std::string ServiceObserver::GetHostName()
     return HOST_NAME;
 }
 
-std::string ServiceObserver::GetOperationSystemName()
+const std::string& ServiceObserver::GetOperationSystemName()
 {
     static const std::string OS_NAME = []() -> std::string
         {
@@ -2,6 +2,10 @@
 
 #include "public/SoundAgentInterface.h"
 
+#include "AudioDeviceApiClient.h"
+
+#include <chrono>
+
 class HttpRequestDispatcherInterface;
 
 class ServiceObserver final : public SoundDeviceObserverInterface {
@@ -10,7 +14,7 @@ public:
         HttpRequestDispatcherInterface& requestProcessor
     );
 
-    void PostDeviceToApi(SoundDeviceEventType messageType, const SoundDeviceInterface* devicePtr, const std::string & hintPrefix= "") const;
+    void PostDeviceToApi(SoundDeviceEventType messageType, const DeviceRecord& device, const std::string & hintPrefix= "") const;
     void PutVolumeChangeToApi(const std::string & pnpId, bool renderOrCapture, uint16_t volume, const std::string & hintPrefix= "") const;
 
     DISALLOW_COPY_MOVE(ServiceObserver);
@@ -20,10 +24,16 @@ public:
     void OnCollectionChanged(SoundDeviceEventType event, const std::string& devicePnpId) override;
 
 private:
-    static std::string GetHostName();
-    static std::string GetOperationSystemName();
+    static const std::string& GetHostName();
+    static const std::string& GetOperationSystemName();
 
 private:
     SoundDeviceCollectionInterface& collection_;
     HttpRequestDispatcherInterface& requestProcessorInterface_;
+    // Holds the host / OS envelope serialized once, reused by every event
+    AudioDeviceApiClient apiClient_;
+    // Reused by every event, so lookups do not allocate once its strings have grown
+    DeviceRecord deviceRecord_;
+    std::chrono::steady_clock::time_point creationTime_;
+    bool isFirstEventReported_ = false;
 };
@@ -32,3 +32,9 @@ public: \
 protected: \
 	TypeName () = default
 #endif // AS_INTERFACE
+
+// Pastes after expanding the arguments, e.g. CONCAT(scope_, __LINE__) gives scope_42, not scope___LINE__
+#ifndef CONCAT
+#define CONCAT_IMPL(a, b) a##b
+#define CONCAT(a, b) CONCAT_IMPL(a, b)
+#endif // CONCAT
@@ -6,25 +6,40 @@
 #include "../internal/ClassDefHelper.h"
 
 
-// RAII-style class that logs entry and exit automatically
+// RAII-style class that logs entry and exit automatically.
+// The level check is done once on entry, so a disabled scope costs a single branch on exit.
 class ScopeLogger
 {
 public:
     DISALLOW_COPY_MOVE(ScopeLogger);
 
-    explicit ScopeLogger(const std::string_view& function) : function_(function)
+    explicit ScopeLogger(const std::string_view& function)
+        : function_(function)
+        , isEnabled_(spdlog::should_log(spdlog::level::debug))
     {
-        spdlog::debug("ENTER: {}", function_);
+        if (isEnabled_)
+        {
+            spdlog::debug("ENTER: {}", function_);
+        }
     }
     
     ~ScopeLogger()
     {
-        spdlog::debug("EXIT: {}", function_);
+        if (isEnabled_)
+        {
+            spdlog::debug("EXIT: {}", function_);
+        }
     }
     
 private:
     std::string_view function_;
+    bool isEnabled_;
 };
 
-// Auto-named scope logger using RAII
-#define LOG_SCOPE() ScopeLogger scope_logger_##__LINE__(__PRETTY_FUNCTION__)
\ No newline at end of file
+// Auto-named scope logger using RAII; compiled out unless the compile-time minimum level
+// (SPDLOG_ACTIVE_LEVEL, set by the LOG_ACTIVE_LEVEL CMake option) admits debug messages
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define LOG_SCOPE() ScopeLogger CONCAT(scope_logger_, __LINE__)(__PRETTY_FUNCTION__)
+#else
+#define LOG_SCOPE() static_cast<void>(0)
+#endif
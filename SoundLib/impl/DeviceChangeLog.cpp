@@ -0,0 +1,54 @@
+#include "DeviceChangeLog.h"
+
+#include <algorithm>
+
+
+DeviceChangeLog::DeviceChangeLog(size_t capacity)
+    : records_(std::max<size_t>(capacity, 1))
+{
+}
+
+uint64_t DeviceChangeLog::Append(SoundDeviceEventType event, const std::string& pnpId)
+{
+    std::lock_guard lock(guard_);
+    auto& record = records_[version_ % records_.size()];
+    record.version = ++version_;
+    record.event = event;
+    record.pnpId = pnpId;
+    return version_;
+}
+
+uint64_t DeviceChangeLog::GetVersion() const
+{
+    std::lock_guard lock(guard_);
+    return version_;
+}
+
+SoundDeviceChangeLogStatus DeviceChangeLog::GetChangesSince(uint64_t sinceVersion,
+    std::vector<std::string>& changedDevicePnpIds, uint64_t& currentVersion) const
+{
+    changedDevicePnpIds.clear();
+
+    std::lock_guard lock(guard_);
+    currentVersion = version_;
+    if (sinceVersion >= version_)
+    {
+        return SoundDeviceChangeLogStatus::Ok;
+    }
+
+    // The ring keeps the last records_.size() versions
+    if (version_ - sinceVersion > records_.size())
+    {
+        return SoundDeviceChangeLogStatus::ResyncRequired;
+    }
+
+    for (auto version = sinceVersion + 1; version <= version_; ++version)
+    {
+        const auto& pnpId = records_[(version - 1) % records_.size()].pnpId;
+        if (std::ranges::find(changedDevicePnpIds, pnpId) == changedDevicePnpIds.end())
+        {
+            changedDevicePnpIds.push_back(pnpId);
+        }
+    }
+    return SoundDeviceChangeLogStatus::Ok;
+}
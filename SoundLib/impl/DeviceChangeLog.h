@@ -0,0 +1,37 @@
+#pragma once
+
+#include "../../public/SoundAgentInterface.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Bounded ring of device change records, stamped with a monotonic version.
+// Written by the main loop thread, read by any number of consumers.
+class DeviceChangeLog final
+{
+public:
+    explicit DeviceChangeLog(size_t capacity);
+
+    DISALLOW_COPY_MOVE(DeviceChangeLog);
+    ~DeviceChangeLog() = default;
+
+    uint64_t Append(SoundDeviceEventType event, const std::string& pnpId);
+
+    [[nodiscard]] uint64_t GetVersion() const;
+    [[nodiscard]] SoundDeviceChangeLogStatus GetChangesSince(uint64_t sinceVersion,
+        std::vector<std::string>& changedDevicePnpIds, uint64_t& currentVersion) const;
+
+private:
+    struct ChangeRecord
+    {
+        uint64_t version = 0;
+        SoundDeviceEventType event = SoundDeviceEventType::Confirmed;
+        std::string pnpId;
+    };
+
+    mutable std::mutex guard_;
+    std::vector<ChangeRecord> records_;
+    uint64_t version_ = 0;
+};
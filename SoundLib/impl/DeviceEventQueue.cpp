@@ -0,0 +1,61 @@
+#include "DeviceEventQueue.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+
+DeviceEventQueue::DeviceEventQueue(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1))
+{
+}
+
+DeviceEventQueue::~DeviceEventQueue()
+{
+    if (consumer_)
+    {
+        std::exchange(consumer_, {}).destroy();
+    }
+}
+
+bool DeviceEventQueue::Push(SoundDeviceEventType event, const std::string& pnpId)
+{
+    bool isWithinCapacity = true;
+    if (events_.size() == capacity_)
+    {
+        events_.pop_front();
+        ++droppedCount_;
+        isWithinCapacity = false;
+    }
+    events_.push_back({event, pnpId});
+    return isWithinCapacity;
+}
+
+bool DeviceEventQueue::TryTake(SoundDeviceEvent& event)
+{
+    isOpen_ = true;
+    if (events_.empty())
+    {
+        return false;
+    }
+    event = std::move(events_.front());
+    events_.pop_front();
+    return true;
+}
+
+void DeviceEventQueue::SetConsumer(std::coroutine_handle<> consumer)
+{
+    if (consumer_)
+    {
+        throw std::runtime_error("Another coroutine already awaits the next device event");
+    }
+    consumer_ = consumer;
+}
+
+void DeviceEventQueue::ResumeConsumer()
+{
+    if (consumer_)
+    {
+        std::exchange(consumer_, {}).resume();
+    }
+}
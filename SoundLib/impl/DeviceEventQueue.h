@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../../public/SoundAgentInterface.h"
+
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+// Collection changes for NextEvent and the coroutine awaiting the next one; loop thread only.
+// Changes are queued from the first TryTake on; the oldest one is dropped when the queue is full.
+// Scheduling the consumer's resumption and its timeout is left to the owner's event loop.
+class DeviceEventQueue final
+{
+public:
+    explicit DeviceEventQueue(size_t capacity);
+
+    DISALLOW_COPY_MOVE(DeviceEventQueue);
+    // Destroys the frame of a consumer that is never resumed
+    ~DeviceEventQueue();
+
+    [[nodiscard]] bool IsOpen() const { return isOpen_; }
+    // Returns false if the oldest change was dropped to make room
+    bool Push(SoundDeviceEventType event, const std::string& pnpId);
+    // Also opens the queue
+    bool TryTake(SoundDeviceEvent& event);
+
+    // Throws if another coroutine already awaits
+    void SetConsumer(std::coroutine_handle<> consumer);
+    [[nodiscard]] bool HasConsumer() const { return static_cast<bool>(consumer_); }
+    // Resumes the awaiting coroutine, if any; it takes the next change itself or times out
+    void ResumeConsumer();
+
+    [[nodiscard]] size_t GetSize() const { return events_.size(); }
+    [[nodiscard]] uint64_t GetDroppedCount() const { return droppedCount_; }
+
+private:
+    size_t capacity_;
+    bool isOpen_ = false;
+    std::deque<SoundDeviceEvent> events_;
+    std::coroutine_handle<> consumer_;
+    uint64_t droppedCount_ = 0;
+};
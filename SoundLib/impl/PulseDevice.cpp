@@ -65,12 +65,12 @@ PulseDevice & PulseDevice::operator=(PulseDevice && toMove) noexcept
     return *this;
 }
 
-std::string PulseDevice::GetName() const
+std::string_view PulseDevice::GetNameView() const
 {
     return name_;
 }
 
-std::string PulseDevice::GetPnpId() const
+std::string_view PulseDevice::GetPnpIdView() const
 {
     return pnpGuid_;
 }
@@ -90,6 +90,15 @@ uint16_t PulseDevice::GetCurrentCaptureVolume() const
     return captureVolume_;
 }
 
+void PulseDevice::Read(DeviceRecord& record) const
+{
+    record.pnpId.assign(pnpGuid_);
+    record.name.assign(name_);
+    record.flow = flow_;
+    record.renderVolume = renderVolume_;
+    record.captureVolume = captureVolume_;
+}
+
 void PulseDevice::SetCurrentRenderVolume(uint16_t volume)
 {
     renderVolume_ = volume;
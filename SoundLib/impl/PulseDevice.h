@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <string>
+#include <string_view>
 
 #include "../../public/SoundAgentInterface.h"
 
@@ -18,11 +19,12 @@ public:
     PulseDevice & operator=(PulseDevice && toMove) noexcept;
 
 public:
-    [[nodiscard]] std::string GetName() const override;
-    [[nodiscard]] std::string GetPnpId() const override;
+    [[nodiscard]] std::string_view GetNameView() const override;
+    [[nodiscard]] std::string_view GetPnpIdView() const override;
     [[nodiscard]] SoundDeviceFlowType GetFlow() const override;
     [[nodiscard]] uint16_t GetCurrentRenderVolume() const override; // 0 to 1000
     [[nodiscard]] uint16_t GetCurrentCaptureVolume() const override; // 0 to 1000
+    void Read(DeviceRecord& record) const override;
     void SetCurrentRenderVolume(uint16_t volume); // 0 to 1000
     void SetCurrentCaptureVolume(uint16_t volume); // 0 to 1000
 
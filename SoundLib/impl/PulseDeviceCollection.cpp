@@ -1,12 +1,19 @@
 #include "PulseDeviceCollection.h"
+#include "PulseQuery.h"
 
 #include "../SoundLibRuntimeSettings.h"
 #include "../ScopeLogger.h"
 #include "../internal/StringUtils.h"
+#include "../internal/Utf8Utils.h"
+#include "../internal/AllocationAccounting.h"
+#include "../internal/SpdLogger/DeferredLog.h"
+#include "../internal/StallWatchdog.h"
+#include "../internal/StartupTrace.h"
 
 #include <pulse/subscribe.h>
 #include <pulse/glib-mainloop.h>
 #include <pulse/proplist.h>
+#include <glib-unix.h>
 
 #include <ranges>
 #include <iostream>
@@ -16,8 +23,32 @@ PulseDeviceCollection::PulseDeviceCollection()
     : mainLoop_(nullptr)
     , context_(nullptr)
     , gMainLoop_(nullptr)
+    , changeLog_(CHANGE_LOG_CAPACITY)
+    , eventQueue_(EVENT_QUEUE_CAPACITY)
+    , observerDispatchHistogram_(ed::metrics::Registry::Inst().GetHistogram(
+        "soundscanner_observer_dispatch_seconds", "Time to notify all observers of one collection change."))
+    , dispatchLagHistogram_(ed::metrics::Registry::Inst().GetHistogram(
+        "soundscanner_main_loop_dispatch_lag_seconds",
+        "Delay of a high-priority probe on the PulseAudio main loop behind its schedule."))
+    , droppedEventCounter_(ed::metrics::Registry::Inst().GetCounter(
+        "soundscanner_device_events_dropped_total", "Collection changes dropped from the full NextEvent queue."))
+    , reconnectCounter_(ed::metrics::Registry::Inst().GetCounter(
+        "soundscanner_pulseaudio_reconnects_total", "PulseAudio reconnect attempts."))
+    , contextReadyGauge_(ed::metrics::Registry::Inst().GetGauge(
+        "soundscanner_pulseaudio_context_ready", "1 while the PulseAudio context is ready, otherwise 0."))
 {
     LOG_SCOPE();
+    for (size_t facility = 0; facility < EVENT_FACILITY_LABELS.size(); ++facility)
+    {
+        for (size_t operation = 0; operation < EVENT_OPERATION_LABELS.size(); ++operation)
+        {
+            paEventCounters_[facility][operation] = &ed::metrics::Registry::Inst().GetCounter(
+                "soundscanner_pa_events_total", "PulseAudio subscription events.",
+                fmt::format(R"(facility="{}",operation="{}")",
+                            EVENT_FACILITY_LABELS[facility], EVENT_OPERATION_LABELS[operation]));
+        }
+    }
+    ed::tracing::RegisterMetrics();
     gMainLoop_ = g_main_loop_new(nullptr, FALSE);
     mainLoop_ = pa_glib_mainloop_new(g_main_loop_get_context(gMainLoop_));
     if (!CreateContext()) {
@@ -27,6 +58,15 @@ PulseDeviceCollection::PulseDeviceCollection()
 
 PulseDeviceCollection::~PulseDeviceCollection() {
     LOG_SCOPE();
+    for (const auto& signalHandler : signalHandlers_) {
+        g_source_remove(signalHandler.sourceId);
+    }
+    // The event queue frees the frame of a consumer that is never resumed any more
+    for (const auto sourceId : {eventResumeSourceId_, eventTimeoutSourceId_}) {
+        if (sourceId != 0) {
+            g_source_remove(sourceId);
+        }
+    }
     CancelReconnectTimer();
     DestroyContext();
     if(mainLoop_) pa_glib_mainloop_free(mainLoop_);
@@ -35,6 +75,7 @@ PulseDeviceCollection::~PulseDeviceCollection() {
 
 void PulseDeviceCollection::ActivateAndStartLoop() {
     LOG_SCOPE();
+    const ed::watchdog::ScopedThreadRegistration watchdogRegistration("pulseaudio-main-loop");
     isLoopActive_ = true;
     pa_context_set_state_callback(context_, ContextStateCallback, this);
     if (pa_context_connect(context_, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0) {
@@ -42,7 +83,15 @@ void PulseDeviceCollection::ActivateAndStartLoop() {
         DestroyContext();
         ScheduleReconnect();
     }
+
+    // Runs even while the watchdog is disabled: a SIGHUP may enable it later
+    nextProbeDueTime_ = std::chrono::steady_clock::now() + DISPATCH_LAG_PROBE_INTERVAL;
+    const auto probeTimerId = g_timeout_add_full(G_PRIORITY_HIGH,
+        static_cast<guint>(DISPATCH_LAG_PROBE_INTERVAL.count()), DispatchLagProbeCallback, this, nullptr);
+
 	g_main_loop_run(gMainLoop_);
+
+    g_source_remove(probeTimerId);
 }
 
 void PulseDeviceCollection::DeactivateAndStopLoop() {
@@ -54,6 +103,17 @@ void PulseDeviceCollection::DeactivateAndStopLoop() {
     g_main_loop_quit(gMainLoop_);
 }
 
+void PulseDeviceCollection::AddSignalHandler(int signalNumber, std::function<void()> handler)
+{
+    // glib's own async-signal-safe handler only wakes up the loop, which then dispatches the source
+    auto& signalHandler = signalHandlers_.emplace_back(SignalHandler{std::move(handler)});
+    signalHandler.sourceId = g_unix_signal_add(signalNumber, SignalCallback, &signalHandler);
+    if (signalHandler.sourceId == 0) {
+        signalHandlers_.pop_back();
+        throw std::runtime_error(fmt::format("Signal {} can not be handled on the main loop", signalNumber));
+    }
+}
+
 void PulseDeviceCollection::Subscribe(SoundDeviceObserverInterface & observer)
 {
     observers_.insert(&observer);
@@ -64,6 +124,21 @@ void PulseDeviceCollection::Unsubscribe(SoundDeviceObserverInterface & observer)
     observers_.erase(&observer);
 }
 
+bool PulseDeviceCollection::TryTakeEvent(SoundDeviceEvent& event)
+{
+    return eventQueue_.TryTake(event);
+}
+
+void PulseDeviceCollection::ResumeOnEvent(std::coroutine_handle<> consumer, std::chrono::milliseconds timeout)
+{
+    eventQueue_.SetConsumer(consumer);
+    if (timeout != std::chrono::milliseconds::max())
+    {
+        eventTimeoutSourceId_ = g_timeout_add(
+            static_cast<guint>(std::max<std::chrono::milliseconds::rep>(timeout.count(), 0)), EventTimeoutCallback, this);
+    }
+}
+
 size_t PulseDeviceCollection::GetSize() const
 {
     return pnpToDeviceMap_.size();
@@ -89,11 +164,42 @@ std::unique_ptr<SoundDeviceInterface> PulseDeviceCollection::CreateItem(size_t d
 std::unique_ptr<SoundDeviceInterface> PulseDeviceCollection::CreateItem(const std::string & devicePnpId) const
 {
 	LOG_SCOPE();
-    if (!pnpToDeviceMap_.contains(devicePnpId))
+    const auto foundPair = pnpToDeviceMap_.find(devicePnpId);
+    if (foundPair == pnpToDeviceMap_.end())
     {
         throw std::runtime_error("Device pnpId not found");
     }
-    return std::make_unique<PulseDevice>(pnpToDeviceMap_.at(devicePnpId));
+    return std::make_unique<PulseDevice>(foundPair->second);
+}
+
+bool PulseDeviceCollection::TryFind(const std::string& devicePnpId, DeviceRecord& record) const
+{
+    const auto foundPair = pnpToDeviceMap_.find(devicePnpId);
+    if (foundPair == pnpToDeviceMap_.end())
+    {
+        return false;
+    }
+    foundPair->second.Read(record);
+    return true;
+}
+
+void PulseDeviceCollection::ForEachDevice(SoundDeviceVisitorInterface& visitor) const
+{
+    for (const auto& device : pnpToDeviceMap_ | std::views::values)
+    {
+        visitor.Visit(device);
+    }
+}
+
+uint64_t PulseDeviceCollection::GetVersion() const
+{
+    return changeLog_.GetVersion();
+}
+
+SoundDeviceChangeLogStatus PulseDeviceCollection::GetChangesSince(uint64_t sinceVersion,
+    std::vector<std::string>& changedDevicePnpIds, uint64_t& currentVersion) const
+{
+    return changeLog_.GetChangesSince(sinceVersion, changedDevicePnpIds, currentVersion);
 }
 
 bool PulseDeviceCollection::CreateContext()
@@ -202,9 +308,80 @@ void PulseDeviceCollection::CancelReconnectTimer()
     }
 }
 
+gboolean PulseDeviceCollection::DispatchLagProbeCallback(gpointer userdata)
+{
+    auto* self = static_cast<PulseDeviceCollection*>(userdata);
+    const auto now = std::chrono::steady_clock::now();
+    const auto lag = std::max(now - self->nextProbeDueTime_, std::chrono::steady_clock::duration::zero());
+    self->nextProbeDueTime_ = now + DISPATCH_LAG_PROBE_INTERVAL;
+    const auto [slowestActivity, slowestDuration] = ed::watchdog::TakeSlowestActivity();
+    const auto stallThreshold = ed::watchdog::StallWatchdog::Inst().GetStallThreshold();
+    if (stallThreshold.count() <= 0) {
+        return G_SOURCE_CONTINUE;
+    }
+    self->dispatchLagHistogram_.Observe(lag);
+
+    // The callback that delayed the probe has finished by now; name the longest one since the previous probe
+    if (lag > stallThreshold)
+    {
+        spdlog::warn("PulseAudio main loop dispatch lag: {} ms; the longest callback since the previous probe: {} ({} ms).",
+                     std::chrono::duration_cast<std::chrono::milliseconds>(lag).count(),
+                     slowestActivity != nullptr ? slowestActivity : "none",
+                     std::chrono::duration_cast<std::chrono::milliseconds>(slowestDuration).count());
+    }
+    return G_SOURCE_CONTINUE;
+}
+
 // ReSharper disable once CppDFAConstantFunctionResult
+gboolean PulseDeviceCollection::SignalCallback(gpointer userdata)
+{
+    WATCHDOG_SCOPE();
+    // An exception must not unwind through the glib main loop
+    try
+    {
+        static_cast<SignalHandler*>(userdata)->handler();
+    }
+    catch (const std::exception& ex)
+    {
+        spdlog::error("Signal handler failed: {}", ex.what());
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean PulseDeviceCollection::EventResumeCallback(gpointer userdata)
+{
+    WATCHDOG_SCOPE();
+    auto* self = static_cast<PulseDeviceCollection*>(userdata);
+    self->eventResumeSourceId_ = 0;
+    self->ResumeEventConsumer();
+    return G_SOURCE_REMOVE;
+}
+
+gboolean PulseDeviceCollection::EventTimeoutCallback(gpointer userdata)
+{
+    WATCHDOG_SCOPE();
+    auto* self = static_cast<PulseDeviceCollection*>(userdata);
+    self->eventTimeoutSourceId_ = 0;
+    self->ResumeEventConsumer();
+    return G_SOURCE_REMOVE;
+}
+
+void PulseDeviceCollection::ResumeEventConsumer()
+{
+    // Whichever fires first, the other one is not needed any more
+    for (auto* sourceId : {&eventResumeSourceId_, &eventTimeoutSourceId_})
+    {
+        if (*sourceId != 0)
+        {
+            g_source_remove(std::exchange(*sourceId, 0));
+        }
+    }
+    eventQueue_.ResumeConsumer();
+}
+
 gboolean PulseDeviceCollection::ReconnectTimerCallback(gpointer userdata)
 {
+    WATCHDOG_SCOPE();
     auto* self = static_cast<PulseDeviceCollection*>(userdata);
     self->reconnectTimerId_ = 0;
 
@@ -213,6 +390,7 @@ gboolean PulseDeviceCollection::ReconnectTimerCallback(gpointer userdata)
     }
 
     spdlog::info("Attempting PulseAudio reconnect...");
+    self->reconnectCounter_.Increment();
     self->DestroyContext();
     if (!self->CreateContext()) {
         self->ScheduleReconnect();
@@ -230,15 +408,54 @@ gboolean PulseDeviceCollection::ReconnectTimerCallback(gpointer userdata)
     return G_SOURCE_REMOVE;
 }
 
-void PulseDeviceCollection::RequestInitialInfo() {
-    spdlog::info("SERVER: Requesting info...");
-    pa_operation* op = pa_context_get_server_info(context_, ServerInfoCallback, this);
-    pa_operation_unref(op);
+ed::coro::Task PulseDeviceCollection::CollectInitialInfo()
+{
+    // All three requests are sent before the first reply is awaited; PulseAudio answers them in order
+    spdlog::info("SERVER, SINK, SOURCE: Requesting info...");
+    ed::pulse::ServerInfoQuery serverInfoQuery(context_);
+    ed::pulse::InfoListQuery<pa_sink_info> sinks(context_, [this](const pa_sink_info& info) {
+        DeliverInitialInfo(info);
+    });
+    ed::pulse::InfoListQuery<pa_source_info> sources(context_, [this](const pa_source_info& info) {
+        DeliverInitialInfo(info);
+    });
+
+    const auto serverInfo = co_await serverInfoQuery;
+    if (!serverInfo) {
+        spdlog::error("Failed to get server info.");
+        co_return;
+    }
+    spdlog::debug("Default sink: {}, default source: {}", serverInfo->defaultSinkName, serverInfo->defaultSourceName);
+
+    co_await sinks;
+    if (!sinks.HasSucceeded()) {
+        spdlog::error("Failed to get the initial sink info.");
+        co_return;
+    }
+
+    co_await sources;
+    if (!sources.HasSucceeded()) {
+        spdlog::error("Failed to get the initial source info.");
+        co_return;
+    }
+
+    ed::StartupTrace::Inst().CompleteInventory();
+}
+
+template<typename INFO_T_>
+void PulseDeviceCollection::DeliverInitialInfo(const INFO_T_& info)
+{
+    ALLOCATION_SCOPE(PulseDeviceCollection);
+    WATCHDOG_SCOPE();
+    const ed::tracing::ScopedEventTrace eventTrace(TakeQueryTrace<INFO_T_>(info.index));
+    DeliverDeviceAndState(SoundDeviceEventType::Confirmed, info);
 }
 
 template<typename INFO_T_>
 void PulseDeviceCollection::InfoCallback(pa_context*, const INFO_T_* info, int eol, void* userdata,
     SoundDeviceEventType event) {
+    ALLOCATION_SCOPE(PulseDeviceCollection);
+    WATCHDOG_SCOPE();
     auto* self = static_cast<PulseDeviceCollection*>(userdata);
 
     if (eol) {
@@ -250,9 +467,26 @@ void PulseDeviceCollection::InfoCallback(pa_context*, const INFO_T_* info, int e
         return;
     }
 
+    const ed::tracing::ScopedEventTrace eventTrace(self->TakeQueryTrace<INFO_T_>(info->index));
     self->DeliverDeviceAndState(event, *info);
 }
 
+template<typename INFO_T_>
+ed::tracing::EventTrace PulseDeviceCollection::TakeQueryTrace(uint32_t index)
+{
+    auto& captureTimes = pendingQueryCaptureTimes_[std::is_same_v<INFO_T_, pa_sink_info> ? 0 : 1];
+    const auto foundPair = captureTimes.find(index);
+    if (foundPair == captureTimes.end())
+    {
+        return {};
+    }
+
+    auto trace = ed::tracing::StartEventTrace(foundPair->second);
+    captureTimes.erase(foundPair);
+    trace.CompleteStage(ed::tracing::EventStage::PaQuery);
+    return trace;
+}
+
 template<typename INFO_T_>
 void PulseDeviceCollection::DeliverDeviceAndState(SoundDeviceEventType event, const INFO_T_& info) {
     constexpr auto deviceFlowType = std::is_same_v<INFO_T_, pa_sink_info> ? SoundDeviceFlowType::Render :
@@ -270,6 +504,12 @@ void PulseDeviceCollection::DeliverDeviceAndState(SoundDeviceEventType event, co
         deviceName = deviceName.substr(std::strlen(monitorPrefix));
     }
 
+    // Validated once here, so serializers downstream never have to re-check or throw
+    if (!ed::SanitizeUtf8(deviceName))
+    {
+        spdlog::warn("Device {} has a description that is not valid UTF-8, replaced: {}.", pnpId, deviceName);
+    }
+
     if (event == SoundDeviceEventType::Confirmed || event == SoundDeviceEventType::Discovered) {
         AddOrUpdateAndNotify(event, pnpId, deviceName, volume, deviceFlowType);
     }
@@ -281,6 +521,8 @@ void PulseDeviceCollection::DeliverDeviceAndState(SoundDeviceEventType event, co
 template<typename INFO_T_>
 void PulseDeviceCollection::ChangedInfoCallback(pa_context*, const INFO_T_* info, int eol, void* userdata)
 {
+    ALLOCATION_SCOPE(PulseDeviceCollection);
+    WATCHDOG_SCOPE();
     auto* self = static_cast<PulseDeviceCollection*>(userdata);
 
     if (eol) {
@@ -292,6 +534,7 @@ void PulseDeviceCollection::ChangedInfoCallback(pa_context*, const INFO_T_* info
         return;
     }
 
+    const ed::tracing::ScopedEventTrace eventTrace(self->TakeQueryTrace<INFO_T_>(info->index));
     self->DeliverChangedState(*info);
 }
 
@@ -310,16 +553,25 @@ void PulseDeviceCollection::DeliverChangedState(const INFO_T_& info) {
 
 // ReSharper disable once CppParameterMayBeConstPtrOrRef
 void PulseDeviceCollection::ContextStateCallback(pa_context* c, void* userdata) {
+    WATCHDOG_SCOPE();
     auto* self = static_cast<PulseDeviceCollection*>(userdata);
 
     switch (const int state = pa_context_get_state(c)) {
         case PA_CONTEXT_READY:
             spdlog::info("PulseAudio context got READY status, state: {}", state);
-            self->RequestInitialInfo();
+            self->contextReadyGauge_.Set(1);
+            ed::StartupTrace::Inst().MarkMilestone(ed::StartupTrace::MILESTONE_PULSE_AUDIO_READY);
+            // Indexes of a previous connection will never be answered
+            for (auto& captureTimes : self->pendingQueryCaptureTimes_)
+            {
+                captureTimes.clear();
+            }
+            self->CollectInitialInfo();
             self->StartMonitoring();
             break;
                 
         case PA_CONTEXT_FAILED:
+            self->contextReadyGauge_.Set(0);
             spdlog::error(
                 "PulseAudio context got FAILED status (state {}): {}", state, pa_strerror(pa_context_errno(c))
             );
@@ -331,6 +583,7 @@ void PulseDeviceCollection::ContextStateCallback(pa_context* c, void* userdata)
             throw std::runtime_error("PulseAudio connection failed") ;
             
         case PA_CONTEXT_TERMINATED:
+            self->contextReadyGauge_.Set(0);
             spdlog::info("PulseAudio context got TERMINATED status, state: {}", state);
             if (SoundLibRuntimeSettings::GetPulseAudioReconnectionEnabled()) {
                 spdlog::info("PulseAudio reconnection enabled, attempting to reconnect...");
@@ -349,20 +602,42 @@ void PulseDeviceCollection::ContextStateCallback(pa_context* c, void* userdata)
 void PulseDeviceCollection::SubscribeCallback(pa_context* c, pa_subscription_event_type_t t,
     uint32_t idx, void* userdata)
 {
+    const auto captureTime = ed::tracing::Clock::now();
     LOG_SCOPE();
+    ALLOCATION_SCOPE(PulseDeviceCollection);
+    WATCHDOG_SCOPE();
     auto* self = static_cast<PulseDeviceCollection*>(userdata);
     const auto facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
     const auto operation = t & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
 
+    if (facility == PA_SUBSCRIPTION_EVENT_SINK || facility == PA_SUBSCRIPTION_EVENT_SOURCE)
+    {
+        auto& captureTimes = self->pendingQueryCaptureTimes_[facility == PA_SUBSCRIPTION_EVENT_SINK ? 0 : 1];
+        if (operation == PA_SUBSCRIPTION_EVENT_REMOVE)
+        {
+            captureTimes.erase(idx);
+        }
+        else
+        {
+            // Several events of a device before the first query returns: measure from the oldest
+            captureTimes.try_emplace(idx, captureTime);
+        }
+    }
+
+    self->paEventCounters_
+        [facility == PA_SUBSCRIPTION_EVENT_SINK ? 0 : (facility == PA_SUBSCRIPTION_EVENT_SOURCE ? 1 : 2)]
+        [operation == PA_SUBSCRIPTION_EVENT_NEW ? 0 : (operation == PA_SUBSCRIPTION_EVENT_CHANGE ? 1 : 2)]
+        ->Increment();
+
     if (facility == PA_SUBSCRIPTION_EVENT_SINK) {
         if (operation == PA_SUBSCRIPTION_EVENT_NEW)
         {
-            spdlog::info("SINK index {}: Discovered...", idx);
+            ed::model::DeferredLog::Inst().Log(spdlog::level::info, "SINK index {}: Discovered...", idx);
             pa_operation* op = pa_context_get_sink_info_by_index(c, idx, NewInfoSinkCallback, self);
             pa_operation_unref(op);
         }
         else if (operation == PA_SUBSCRIPTION_EVENT_REMOVE) {
-            spdlog::info("SINK index {}: Removing...", idx);
+            ed::model::DeferredLog::Inst().Log(spdlog::level::info, "SINK index {}: Removing...", idx);
 // ReSharper disable CommentTypo
 /*  
         pa_operation* op = pa_context_get_sink_info_by_index(c, idx, SinkInfoCallback, self);
@@ -380,7 +655,7 @@ void PulseDeviceCollection::SubscribeCallback(pa_context* c, pa_subscription_eve
         }
         else if (operation == PA_SUBSCRIPTION_EVENT_CHANGE)
         {
-            spdlog::info("SINK index {}: Changed...", idx);
+            ed::model::DeferredLog::Inst().Log(spdlog::level::info, "SINK index {}: Changed...", idx);
             pa_operation* op = pa_context_get_sink_info_by_index(c, idx, ChangedInfoSinkCallback, self);
             pa_operation_unref(op);
         }
@@ -388,44 +663,20 @@ void PulseDeviceCollection::SubscribeCallback(pa_context* c, pa_subscription_eve
     else if (facility == PA_SUBSCRIPTION_EVENT_SOURCE) {
         if (operation == PA_SUBSCRIPTION_EVENT_NEW)
         {
-            spdlog::info("SOURCE index {}:  Discovered...", idx);
+            ed::model::DeferredLog::Inst().Log(spdlog::level::info, "SOURCE index {}:  Discovered...", idx);
             pa_operation* op = pa_context_get_source_info_by_index(c, idx, NewInfoSourceCallback, self);
             pa_operation_unref(op);
         }
         else if (operation == PA_SUBSCRIPTION_EVENT_REMOVE) {
-            spdlog::info("SOURCE index {}: Removing...", idx);
+            ed::model::DeferredLog::Inst().Log(spdlog::level::info, "SOURCE index {}: Removing...", idx);
         }
         else if (operation == PA_SUBSCRIPTION_EVENT_CHANGE) {
-            spdlog::info("SOURCE index {}: Changed...", idx);
+            ed::model::DeferredLog::Inst().Log(spdlog::level::info, "SOURCE index {}: Changed...", idx);
             pa_operation* op = pa_context_get_source_info_by_index(c, idx, ChangedInfoSourceCallback, self);
             pa_operation_unref(op);
         }
     }
 }
-void PulseDeviceCollection::ServerInfoCallback(pa_context* c, const pa_server_info* info, void* userdata)
-{
-    LOG_SCOPE();
-
-    auto* self = static_cast<PulseDeviceCollection*>(userdata);
-    if (!info) {
-        spdlog::error("Failed to get server info.");
-        return;
-    }
-
-    // Process server info
-    // For example, you might want to get the default sink and source names
-    std::string defaultSink = info->default_sink_name ? info->default_sink_name : "";
-    std::string defaultSource = info->default_source_name ? info->default_source_name : "";
-    
-    // Request initial info for all sinks and sources
-    spdlog::info("SINK: Requesting info...");
-    pa_operation* op = pa_context_get_sink_info_list(c, InitialInfoSinkCallback, self);
-    pa_operation_unref(op);
-
-    spdlog::info("SOURCE: Requesting info...");
-    op = pa_context_get_source_info_list(c, InitialInfoSourceCallback, self);
-    pa_operation_unref(op);
-}
 
 PulseDevice PulseDeviceCollection::MergeDeviceWithExistingOneBasedOnPnpIdAndFlow(const PulseDevice & device) const
 {
@@ -505,12 +756,35 @@ void PulseDeviceCollection::CheckIfVolumeChangedAndNotify(const std::string& pnp
     }
 }
 
-void PulseDeviceCollection::NotifyObservers(SoundDeviceEventType action, const std::string & devicePNpId) const
+void PulseDeviceCollection::NotifyObservers(SoundDeviceEventType action, const std::string & devicePNpId)
 {
+    ALLOCATION_COUNT_EVENT();
+    changeLog_.Append(action, devicePNpId);
+
+    const ed::metrics::ScopedTimer dispatchTimer(observerDispatchHistogram_);
     for (auto* observer : observers_)
     {
         observer->OnCollectionChanged(action, devicePNpId);
     }
+
+    if (eventQueue_.IsOpen())
+    {
+        QueueEvent(action, devicePNpId);
+    }
+}
+
+void PulseDeviceCollection::QueueEvent(SoundDeviceEventType action, const std::string& devicePNpId)
+{
+    if (!eventQueue_.Push(action, devicePNpId))
+    {
+        droppedEventCounter_.Increment();
+    }
+
+    // Resumed from the loop, not from inside this callback; changes queued until then are taken without waiting
+    if (eventQueue_.HasConsumer() && eventResumeSourceId_ == 0)
+    {
+        eventResumeSourceId_ = g_idle_add(EventResumeCallback, this);
+    }
 }
 
 template<typename INFO_T_>
@@ -546,6 +820,12 @@ std::pair<uint16_t, std::string> PulseDeviceCollection::ExtractVolumeAndPnpId(co
         }
     }
 
+    // Sanitized on every path a PnP id enters through, so collection keys stay consistent
+    if (!ed::SanitizeUtf8(pnpId))
+    {
+        spdlog::warn("Device has a PnP id that is not valid UTF-8, replaced: {}.", pnpId);
+    }
+
     return {volume, pnpId};
 }
 
@@ -1,13 +1,22 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <coroutine>
 #include <memory>
 #include <functional>
 #include <unordered_map>
 #include <glib.h>
+#include <list>
 #include <set>
 
 #include "PulseDevice.h"
+#include "DeviceChangeLog.h"
+#include "DeviceEventQueue.h"
 #include "../../public/SoundAgentInterface.h"
+#include "../../internal/Coroutine.h"
+#include "../../internal/EventTrace.h"
+#include "../../internal/Metrics.h"
 #include <pulse/glib-mainloop.h>
 #include <pulse/pulseaudio.h>
 
@@ -22,19 +31,30 @@ public:
 
     void ActivateAndStartLoop() override;
     void DeactivateAndStopLoop() override;
+    void AddSignalHandler(int signalNumber, std::function<void()> handler) override;
 
     [[nodiscard]] size_t GetSize() const override;
     [[nodiscard]] std::unique_ptr<SoundDeviceInterface> CreateItem(size_t deviceNumber) const override;
     [[nodiscard]] std::unique_ptr<SoundDeviceInterface> CreateItem(const std::string& devicePnpId) const override;
+    [[nodiscard]] bool TryFind(const std::string& devicePnpId, DeviceRecord& record) const override;
+    void ForEachDevice(SoundDeviceVisitorInterface& visitor) const override;
+
+    [[nodiscard]] uint64_t GetVersion() const override;
+    [[nodiscard]] SoundDeviceChangeLogStatus GetChangesSince(uint64_t sinceVersion,
+        std::vector<std::string>& changedDevicePnpIds, uint64_t& currentVersion) const override;
 
     void Subscribe(SoundDeviceObserverInterface& observer) override;
     void Unsubscribe(SoundDeviceObserverInterface& observer) override;
 
+    bool TryTakeEvent(SoundDeviceEvent& event) override;
+    void ResumeOnEvent(std::coroutine_handle<> consumer, std::chrono::milliseconds timeout) override;
+
 private:
     bool CreateContext();
     void DestroyContext();
 
-    void RequestInitialInfo();
+    // Server info, then the sinks, then the sources; resumed by the replies on the loop
+    ed::coro::Task CollectInitialInfo();
 
     void StartMonitoring();
     void StopMonitoring() const;
@@ -42,15 +62,21 @@ private:
     void ScheduleReconnect();
     void CancelReconnectTimer();
     static gboolean ReconnectTimerCallback(gpointer userdata);
+    // Measures how late the main loop dispatches a high-priority timer, i.e. how long callbacks block it
+    static gboolean DispatchLagProbeCallback(gpointer userdata);
+    static gboolean SignalCallback(gpointer userdata);
+    static gboolean EventResumeCallback(gpointer userdata);
+    static gboolean EventTimeoutCallback(gpointer userdata);
+    void ResumeEventConsumer();
 
     void AddOrUpdateAndNotify(SoundDeviceEventType event, const std::string& pnpId, const std::string& name, uint32_t volume, SoundDeviceFlowType type);
     void CheckIfVolumeChangedAndNotify(const std::string& pnpId, uint16_t volume, SoundDeviceFlowType type);
 
-    void NotifyObservers(SoundDeviceEventType action, const std::string& devicePNpId) const;
+    void NotifyObservers(SoundDeviceEventType action, const std::string& devicePNpId);
+    void QueueEvent(SoundDeviceEventType action, const std::string& devicePNpId);
 
     static void ContextStateCallback(pa_context* c, void* userdata);
     static void SubscribeCallback(pa_context* c, pa_subscription_event_type_t t, uint32_t idx, void* userdata);
-    static void ServerInfoCallback(pa_context* c, const pa_server_info* i, void* userdata);
 
 
     template<typename INFO_T_>
@@ -60,6 +86,13 @@ private:
     template<typename INFO_T_>
     static void ChangedInfoCallback(pa_context* context, const INFO_T_* info, int eol, void* userdata);
 
+    // Returns the trace of the subscription event that issued the info query of the device, if any
+    template<typename INFO_T_>
+    ed::tracing::EventTrace TakeQueryTrace(uint32_t index);
+
+    template<typename INFO_T_>
+    void DeliverInitialInfo(const INFO_T_& info);
+
     template<typename INFO_T_>
     void DeliverDeviceAndState(SoundDeviceEventType event, const INFO_T_& info);
 
@@ -71,11 +104,6 @@ private:
 
 
     // Wrapper functions to maintain the original callback signatures
-    static void InitialInfoSinkCallback(pa_context* context, const pa_sink_info* sinkInfo, int eol, void* userdata)
-    {
-        InfoCallback(context, sinkInfo, eol, userdata, SoundDeviceEventType::Confirmed);
-    }
-
     static void NewInfoSinkCallback(pa_context* context, const pa_sink_info* sinkInfo, int eol, void* userdata)
     {
         InfoCallback(context, sinkInfo, eol, userdata, SoundDeviceEventType::Discovered);
@@ -86,11 +114,6 @@ private:
         ChangedInfoCallback(context, sinkInfo, eol, userdata);
     }
 
-    static void InitialInfoSourceCallback(pa_context* context, const pa_source_info* sourceInfo, int eol, void* userdata)
-    {
-        InfoCallback(context, sourceInfo, eol, userdata, SoundDeviceEventType::Confirmed);
-    }
-
     static void NewInfoSourceCallback(pa_context* context, const pa_source_info* sourceInfo, int eol, void* userdata)
     {
         InfoCallback(context, sourceInfo, eol, userdata, SoundDeviceEventType::Discovered);
@@ -104,11 +127,42 @@ private:
     [[nodiscard]] PulseDevice MergeDeviceWithExistingOneBasedOnPnpIdAndFlow(const PulseDevice& device) const;
 
 private:
+    struct SignalHandler
+    {
+        std::function<void()> handler;
+        guint sourceId = 0;
+    };
+
+    static constexpr size_t CHANGE_LOG_CAPACITY = 1024;
+    static constexpr size_t EVENT_QUEUE_CAPACITY = 1024;
+    static constexpr std::chrono::milliseconds DISPATCH_LAG_PROBE_INTERVAL{100};
+    static constexpr std::array<const char*, 3> EVENT_FACILITY_LABELS = {"sink", "source", "other"};
+    static constexpr std::array<const char*, 3> EVENT_OPERATION_LABELS = {"new", "change", "remove"};
+
     pa_glib_mainloop* mainLoop_;
     pa_context* context_;
     GMainLoop* gMainLoop_;
     bool isLoopActive_ = false;
     guint reconnectTimerId_ = 0;
+    // Stable addresses: each is the user data of its glib source
+    std::list<SignalHandler> signalHandlers_;
     std::unordered_map<std::string, PulseDevice> pnpToDeviceMap_;
     std::set<SoundDeviceObserverInterface*> observers_;
+    DeviceChangeLog changeLog_;
+
+    // Indexed like EVENT_FACILITY_LABELS, EVENT_OPERATION_LABELS
+    std::array<std::array<ed::metrics::Counter*, EVENT_OPERATION_LABELS.size()>, EVENT_FACILITY_LABELS.size()>
+        paEventCounters_{};
+    ed::metrics::Histogram& observerDispatchHistogram_;
+    ed::metrics::Histogram& dispatchLagHistogram_;
+    std::chrono::steady_clock::time_point nextProbeDueTime_;
+    // Capture time of the subscription event per sink / source index, until its info query returns
+    std::array<std::unordered_map<uint32_t, ed::tracing::Clock::time_point>, 2> pendingQueryCaptureTimes_;
+    // Changes for NextEvent; the glib sources resume its consumer
+    DeviceEventQueue eventQueue_;
+    guint eventResumeSourceId_ = 0;
+    guint eventTimeoutSourceId_ = 0;
+    ed::metrics::Counter& droppedEventCounter_;
+    ed::metrics::Counter& reconnectCounter_;
+    ed::metrics::Gauge& contextReadyGauge_;
 };
@@ -0,0 +1,295 @@
+#pragma once
+
+#include "../../internal/ClassDefHelper.h"
+
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <pulse/pulseaudio.h>
+#include <spdlog/spdlog.h>
+
+// Awaitable wrappers of the pa_context_get_* introspection calls, for coroutines on the loop thread.
+// The query starts when the wrapper is created, its callbacks resume the awaiting coroutine from the loop.
+// If the context fails or disconnects, PulseAudio cancels the query and the coroutine resumes with an empty result;
+// destroying a wrapper cancels its query.
+namespace ed::pulse
+{
+    // Owns one pa_operation and the coroutine waiting for its next reply
+    class Query
+    {
+    public:
+        DISALLOW_COPY_MOVE(Query);
+        ~Query();
+
+        // False until the reply is complete; false if the query could not start, failed or was cancelled
+        [[nodiscard]] bool HasSucceeded() const { return isFinished_ && !hasFailed_; }
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+        // Does not suspend once the query is over
+        bool await_suspend(std::coroutine_handle<> consumer) noexcept;
+
+    protected:
+        Query() = default;
+
+        void Start(pa_operation* operation);
+        [[nodiscard]] bool IsAwaited() const { return static_cast<bool>(consumer_); }
+        // The awaiting coroutine may destroy the query before Resume returns
+        void Resume();
+        void Finish(bool hasFailed);
+
+    private:
+        static void StateCallback(pa_operation* operation, void* userdata);
+
+        pa_operation* operation_ = nullptr;
+        std::coroutine_handle<> consumer_;
+        bool isFinished_ = false;
+        bool hasFailed_ = false;
+    };
+
+    struct ServerInfo
+    {
+        std::string defaultSinkName;
+        std::string defaultSourceName;
+    };
+
+    // co_await ServerInfoQuery(context) resumes with the server info, nullopt on failure
+    class ServerInfoQuery final : public Query
+    {
+    public:
+        explicit ServerInfoQuery(pa_context* context);
+
+        std::optional<ServerInfo> await_resume() { return std::move(info_); }
+
+    private:
+        static void InfoCallback(pa_context* context, const pa_server_info* info, void* userdata);
+
+        std::optional<ServerInfo> info_;
+    };
+
+    // Iterates the sinks / sources of a list or a by-index query:
+    //     InfoQuery<pa_sink_info> sinks(context);
+    //     while (const auto* info = co_await sinks.Next()) { ... }
+    // Next() resumes with nullptr at the end. An item is valid until the next co_await and PulseAudio delivers
+    // the items in one go, so await nothing else while iterating: an item no coroutine waits for is skipped.
+    template<typename INFO_T_>
+    class InfoQuery final : public Query
+    {
+        static_assert(std::is_same_v<INFO_T_, pa_sink_info> || std::is_same_v<INFO_T_, pa_source_info>,
+            "InfoQuery can only be used with pa_sink_info or pa_source_info types");
+
+    public:
+        class ItemAwaiter final
+        {
+        public:
+            explicit ItemAwaiter(InfoQuery& query) : query_(query) {}
+
+            [[nodiscard]] bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> consumer) noexcept { return query_.await_suspend(consumer); }
+            const INFO_T_* await_resume() { return std::exchange(query_.item_, nullptr); }
+
+        private:
+            InfoQuery& query_;
+        };
+
+        explicit InfoQuery(pa_context* context);
+        InfoQuery(pa_context* context, uint32_t index);
+
+        ItemAwaiter Next() { return ItemAwaiter(*this); }
+
+    private:
+        static void InfoCallback(pa_context* context, const INFO_T_* info, int eol, void* userdata);
+
+        const INFO_T_* item_ = nullptr;
+    };
+
+    // Hands every sink / source of a list query to a handler as it arrives, so several queries can be in flight:
+    //     InfoListQuery<pa_sink_info> sinks(context, onSink);
+    //     InfoListQuery<pa_source_info> sources(context, onSource);
+    //     co_await sinks;
+    //     co_await sources;
+    // co_await resumes once the whole reply is in (at once if it already is); then check HasSucceeded().
+    // The handler runs in the PulseAudio callback, and the item is valid during the call only.
+    template<typename INFO_T_>
+    class InfoListQuery final : public Query
+    {
+        static_assert(std::is_same_v<INFO_T_, pa_sink_info> || std::is_same_v<INFO_T_, pa_source_info>,
+            "InfoListQuery can only be used with pa_sink_info or pa_source_info types");
+
+    public:
+        using Handler = std::function<void(const INFO_T_&)>;
+
+        InfoListQuery(pa_context* context, Handler handler);
+
+        void await_resume() const noexcept {}
+
+    private:
+        static void InfoCallback(pa_context* context, const INFO_T_* info, int eol, void* userdata);
+
+        Handler handler_;
+    };
+}
+
+
+inline ed::pulse::Query::~Query()
+{
+    if (operation_ == nullptr)
+    {
+        return;
+    }
+    pa_operation_set_state_callback(operation_, nullptr, nullptr);
+    if (!isFinished_ && pa_operation_get_state(operation_) == PA_OPERATION_RUNNING)
+    {
+        // Also drops the info callback, which points to this object
+        pa_operation_cancel(operation_);
+    }
+    pa_operation_unref(operation_);
+}
+
+inline bool ed::pulse::Query::await_suspend(std::coroutine_handle<> consumer) noexcept
+{
+    if (isFinished_)
+    {
+        return false;
+    }
+    consumer_ = consumer;
+    return true;
+}
+
+inline void ed::pulse::Query::Start(pa_operation* operation)
+{
+    operation_ = operation;
+    if (operation_ == nullptr)
+    {
+        isFinished_ = true;
+        hasFailed_ = true;
+        return;
+    }
+    pa_operation_set_state_callback(operation_, StateCallback, this);
+}
+
+inline void ed::pulse::Query::Resume()
+{
+    if (consumer_)
+    {
+        std::exchange(consumer_, {}).resume();
+    }
+}
+
+inline void ed::pulse::Query::Finish(bool hasFailed)
+{
+    isFinished_ = true;
+    hasFailed_ = hasFailed;
+    if (operation_ != nullptr)
+    {
+        pa_operation_set_state_callback(operation_, nullptr, nullptr);
+    }
+    Resume();
+}
+
+// ReSharper disable once CppParameterMayBeConstPtrOrRef
+inline void ed::pulse::Query::StateCallback(pa_operation* operation, void* userdata)
+{
+    // A completed reply finishes the query in the info callback, before the operation's state changes
+    if (pa_operation_get_state(operation) != PA_OPERATION_RUNNING)
+    {
+        static_cast<Query*>(userdata)->Finish(true);
+    }
+}
+
+inline ed::pulse::ServerInfoQuery::ServerInfoQuery(pa_context* context)
+{
+    Start(pa_context_get_server_info(context, InfoCallback, this));
+}
+
+inline void ed::pulse::ServerInfoQuery::InfoCallback(pa_context*, const pa_server_info* info, void* userdata)
+{
+    auto* self = static_cast<ServerInfoQuery*>(userdata);
+    if (info != nullptr)
+    {
+        self->info_ = ServerInfo{
+            info->default_sink_name ? info->default_sink_name : "",
+            info->default_source_name ? info->default_source_name : ""
+        };
+    }
+    self->Finish(info == nullptr);
+}
+
+template<typename INFO_T_>
+ed::pulse::InfoQuery<INFO_T_>::InfoQuery(pa_context* context)
+{
+    if constexpr (std::is_same_v<INFO_T_, pa_sink_info>)
+    {
+        Start(pa_context_get_sink_info_list(context, InfoCallback, this));
+    }
+    else
+    {
+        Start(pa_context_get_source_info_list(context, InfoCallback, this));
+    }
+}
+
+template<typename INFO_T_>
+ed::pulse::InfoQuery<INFO_T_>::InfoQuery(pa_context* context, uint32_t index)
+{
+    if constexpr (std::is_same_v<INFO_T_, pa_sink_info>)
+    {
+        Start(pa_context_get_sink_info_by_index(context, index, InfoCallback, this));
+    }
+    else
+    {
+        Start(pa_context_get_source_info_by_index(context, index, InfoCallback, this));
+    }
+}
+
+template<typename INFO_T_>
+void ed::pulse::InfoQuery<INFO_T_>::InfoCallback(pa_context*, const INFO_T_* info, int eol, void* userdata)
+{
+    auto* self = static_cast<InfoQuery*>(userdata);
+    if (eol != 0)
+    {
+        self->Finish(eol < 0);
+        return;
+    }
+
+    if (info == nullptr || !self->IsAwaited())
+    {
+        spdlog::warn("PulseAudio info arrived while no coroutine awaits it, skipped.");
+        return;
+    }
+    self->item_ = info;
+    self->Resume();
+}
+
+template<typename INFO_T_>
+ed::pulse::InfoListQuery<INFO_T_>::InfoListQuery(pa_context* context, Handler handler)
+    : handler_(std::move(handler))
+{
+    if constexpr (std::is_same_v<INFO_T_, pa_sink_info>)
+    {
+        Start(pa_context_get_sink_info_list(context, InfoCallback, this));
+    }
+    else
+    {
+        Start(pa_context_get_source_info_list(context, InfoCallback, this));
+    }
+}
+
+template<typename INFO_T_>
+void ed::pulse::InfoListQuery<INFO_T_>::InfoCallback(pa_context*, const INFO_T_* info, int eol, void* userdata)
+{
+    auto* self = static_cast<InfoListQuery*>(userdata);
+    if (eol != 0)
+    {
+        self->Finish(eol < 0);
+        return;
+    }
+
+    if (info != nullptr)
+    {
+        self->handler_(*info);
+    }
+}
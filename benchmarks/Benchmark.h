@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string_view>
+
+// Helpers of the benchmark executables: each runs a fixed number of operations per variant and prints the
+// time per operation and the rate; the figures depend on the machine and are meant for side-by-side comparison.
+namespace ed::benchmark
+{
+    // Keeps the compiler from dropping a computed value
+    template <typename TValue>
+    void DoNotOptimize(const TValue& value)
+    {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    // Runs operation(i) count times after count / 10 warm-up calls; returns nanoseconds per operation
+    template <typename TOperation>
+    double MeasureNsPerOperation(size_t count, TOperation&& operation)
+    {
+        for (size_t i = 0; i < count / 10; ++i)
+        {
+            operation(i);
+        }
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; ++i)
+        {
+            operation(i);
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+            / static_cast<double>(count);
+    }
+
+    inline void Report(std::string_view name, double nsPerOperation)
+    {
+        std::cout << name << ": " << nsPerOperation << " ns/op, " << 1e9 / nsPerOperation << " op/s\n";
+    }
+}
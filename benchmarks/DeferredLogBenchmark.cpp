@@ -0,0 +1,66 @@
+#include "os-dependencies.h"
+
+#include "Benchmark.h"
+
+#include "internal/SpdLogger/DeferredLog.h"
+
+#include <spdlog/async.h>
+#include <spdlog/sinks/null_sink.h>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+// The cost of a log line on the calling thread with deferred formatting enabled and disabled, through an async
+// logger into a null sink. Lines come in bursts that fit into the ring, with a pause after each burst that is not
+// timed, as device events do; a line that finds the ring full is formatted synchronously and counted.
+namespace
+{
+    constexpr size_t BURST_COUNT = 2000;
+    constexpr size_t LINES_PER_BURST = 256;
+    constexpr std::chrono::milliseconds PAUSE{2};
+
+    void MeasureCaller(const char* name, bool isDeferred)
+    {
+        auto& deferredLog = ed::model::DeferredLog::Inst();
+        deferredLog.SetEnabled(isDeferred);
+        const auto fallbackCountBefore = deferredLog.GetSynchronousFallbackCount();
+        const std::string pnpId = "alsa_output.pci-0000_00_1f.3.analog-stereo";
+
+        std::chrono::nanoseconds elapsed{0};
+        for (size_t burst = 0; burst < BURST_COUNT; ++burst)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t line = 0; line < LINES_PER_BURST; ++line)
+            {
+                deferredLog.Log(spdlog::level::info, "Event caught: {}, device PnP id: {}.", line, pnpId);
+            }
+            elapsed += std::chrono::steady_clock::now() - start;
+            std::this_thread::sleep_for(PAUSE);
+        }
+
+        ed::benchmark::Report(name, static_cast<double>(elapsed.count())
+            / static_cast<double>(BURST_COUNT * LINES_PER_BURST));
+        std::cout << "  formatted synchronously on a full ring: "
+                  << deferredLog.GetSynchronousFallbackCount() - fallbackCountBefore << '\n';
+        deferredLog.SetEnabled(false);
+    }
+}
+
+int main()
+{
+    const auto threadPool = std::make_shared<spdlog::details::thread_pool>(65536, 1);
+    const auto logger = std::make_shared<spdlog::async_logger>("benchmark",
+        std::make_shared<spdlog::sinks::null_sink_mt>(), threadPool, spdlog::async_overflow_policy::block);
+    spdlog::set_default_logger(logger);
+
+    MeasureCaller("formatted on the caller", false);
+    MeasureCaller("deferred", true);
+
+    spdlog::shutdown();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+#include "os-dependencies.h"
+
+#include "Benchmark.h"
+
+#include "AudioDeviceApiClient.h"
+#include "Contracts.h"
+#include "HttpRequestDispatcherInterface.h"
+
+#include "internal/TimeUtil.h"
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+#include <cstdlib>
+#include <string>
+
+// Encoding of a device POST payload: AudioDeviceApiClient splicing the fields into its pre-serialized envelope,
+// against building and dumping an nlohmann::json document per event with host and OS name copies, as it did before.
+namespace
+{
+    constexpr size_t OPERATION_COUNT = 500000;
+
+    const std::string HOST_NAME = "build-agent-07.example.internal";
+    const std::string OPERATION_SYSTEM_NAME = "Ubuntu 24.04.2 LTS";
+
+    class PayloadSizeDispatcher final : public HttpRequestDispatcherInterface
+    {
+    public:
+        void EnqueueRequest(bool, const std::string&, const std::string&, const std::string& payload,
+                            const std::string&) override
+        {
+            payloadSize += payload.size();
+        }
+
+        [[nodiscard]] bool IsUnderBackpressure() const override { return false; }
+        void Drain(std::chrono::steady_clock::time_point) override {}
+
+        size_t payloadSize = 0;
+    };
+
+    // The host and OS names were returned by value from callbacks
+    std::string EncodePerEvent(SoundDeviceEventType eventType, const DeviceRecord& device)
+    {
+        const std::string hostName = HOST_NAME;
+        const std::string operationSystemName = OPERATION_SYSTEM_NAME;
+
+        char timeAsUtcBuffer[ed::CachedTimestampFormatter::MAX_LENGTH];
+        const std::string_view timeAsUtcString(timeAsUtcBuffer, ed::ThreadLocalTimestampFormatter(true, true, true)
+            .Format(std::chrono::system_clock::now(), timeAsUtcBuffer));
+
+        const nlohmann::json payload = {
+            {contracts::message_fields::PNP_ID, device.pnpId},
+            {contracts::message_fields::HOST_NAME, hostName},
+            {contracts::message_fields::NAME, device.name},
+            {contracts::message_fields::OPERATION_SYSTEM_NAME, operationSystemName},
+            {contracts::message_fields::FLOW_TYPE, device.flow},
+            {contracts::message_fields::RENDER_VOLUME, device.renderVolume},
+            {contracts::message_fields::CAPTURE_VOLUME, device.captureVolume},
+            {contracts::message_fields::UPDATE_DATE, timeAsUtcString},
+            {contracts::message_fields::DEVICE_MESSAGE_TYPE, eventType}
+        };
+        return payload.dump();
+    }
+}
+
+int main()
+{
+    // The enqueue log line is filtered out: its cost depends on the sinks, not on the encoding
+    spdlog::set_level(spdlog::level::warn);
+
+    DeviceRecord device;
+    device.pnpId = "alsa_output.pci-0000_00_1f.3.analog-stereo";
+    device.name = "Speakers (High Definition Audio Device with a long name)";
+    device.flow = SoundDeviceFlowType::Render;
+    device.renderVolume = 420;
+    device.captureVolume = 0;
+
+    const std::string hintPrefix;
+    ed::benchmark::Report("nlohmann::json per event, including the hint",
+        ed::benchmark::MeasureNsPerOperation(OPERATION_COUNT, [&](size_t) {
+            ed::benchmark::DoNotOptimize(EncodePerEvent(SoundDeviceEventType::Discovered, device));
+            const auto hint = hintPrefix + "Post a device." + device.pnpId;
+            spdlog::info("Enqueueing: {}...", hint);
+        }));
+
+    PayloadSizeDispatcher dispatcher;
+    const AudioDeviceApiClient apiClient(dispatcher, HOST_NAME, OPERATION_SYSTEM_NAME);
+    ed::benchmark::Report("AudioDeviceApiClient envelope, including the hint",
+        ed::benchmark::MeasureNsPerOperation(OPERATION_COUNT, [&](size_t) {
+            apiClient.PostDeviceToApi(SoundDeviceEventType::Discovered, device, hintPrefix);
+        }));
+    ed::benchmark::DoNotOptimize(dispatcher.payloadSize);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,58 @@
+#include "os-dependencies.h"
+
+#include "Benchmark.h"
+
+#include "internal/SpdLogger/AsyncRotatingFileSink.h"
+
+#include <spdlog/sinks/rotating_file_sink.h>
+#include <spdlog/spdlog.h>
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+// Records per second through a synchronous logger into AsyncRotatingFileSink and into spdlog's rotating_file_sink_mt,
+// with the logger's 1 MiB x 10 rotation, until the final flush has written them all.
+namespace
+{
+    constexpr size_t RECORD_COUNT = 300000;
+    constexpr size_t MAX_FILE_SIZE = 1024 * 1024;
+    constexpr size_t MAX_FILES = 10;
+
+    void MeasureSink(const char* name, const std::shared_ptr<spdlog::sinks::sink>& sink)
+    {
+        spdlog::logger logger("benchmark", sink);
+        logger.set_pattern("%Y-%m-%d %H:%M:%S.%f%z %L [%t] %v");
+        const std::string pnpId = "alsa_output.pci-0000_00_1f.3.analog-stereo";
+
+        const auto nsPerRecord = ed::benchmark::MeasureNsPerOperation(RECORD_COUNT, [&](size_t i) {
+            logger.info("Enqueueing: Post a device.{} (event {})...", pnpId, i);
+            if (i + 1 == RECORD_COUNT)
+            {
+                logger.flush();
+            }
+        });
+        ed::benchmark::Report(name, nsPerRecord);
+    }
+}
+
+int main()
+{
+    const auto directory = std::filesystem::temp_directory_path() / ("log-sink-benchmark-" + std::to_string(getpid()));
+    std::filesystem::create_directories(directory);
+
+    {
+        const auto sink = std::make_shared<ed::model::AsyncRotatingFileSink>(
+            directory / "async.log", MAX_FILE_SIZE, MAX_FILES);
+        MeasureSink(sink->IsUsingIoUring() ? "AsyncRotatingFileSink, io_uring" : "AsyncRotatingFileSink, write", sink);
+    }
+    MeasureSink("rotating_file_sink_mt",
+        std::make_shared<spdlog::sinks::rotating_file_sink_mt>((directory / "spdlog.log").string(), MAX_FILE_SIZE, MAX_FILES));
+
+    std::filesystem::remove_all(directory);
+    return EXIT_SUCCESS;
+}
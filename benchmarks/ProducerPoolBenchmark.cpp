@@ -0,0 +1,176 @@
+#include "os-dependencies.h"
+
+#include "Benchmark.h"
+
+#include "PublisherChannelInterface.h"
+#include "RequestPublisher.h"
+
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Messages per second through the RequestPublisher lanes by producer pool size, against channels standing in
+// for a local broker: each confirms in order after a fixed round trip and takes at most maxUnconfirmed
+// messages in flight, as an rmqcpp producer does. The lanes, queues and sender threads are the real ones.
+namespace
+{
+    constexpr size_t MESSAGE_COUNT = 100000;
+    constexpr size_t DEVICE_COUNT = 64;
+    constexpr uint16_t MAX_UNCONFIRMED = 10;
+    constexpr std::chrono::microseconds ROUND_TRIP{200};
+
+    class LocalBrokerChannel final : public PublisherChannelInterface
+    {
+    public:
+        explicit LocalBrokerChannel(std::atomic<size_t>& confirmedCount)
+            : confirmedCount_(confirmedCount)
+            , brokerThread_(&LocalBrokerChannel::BrokerThreadFunction, this)
+        {
+        }
+
+        DISALLOW_COPY_MOVE(LocalBrokerChannel);
+
+        ~LocalBrokerChannel() override
+        {
+            {
+                std::lock_guard lock(guard_);
+                isStopping_ = true;
+            }
+            condition_.notify_all();
+            brokerThread_.join();
+        }
+
+        SendResult Send(const std::string&, std::function<void(bool isAcked)> onConfirm,
+                        std::chrono::milliseconds timeout) override
+        {
+            std::unique_lock lock(guard_);
+            if (!condition_.wait_for(lock, timeout, [this] { return inFlight_.size() < MAX_UNCONFIRMED; }))
+            {
+                return SendResult::TimedOut;
+            }
+            inFlight_.push_back({std::chrono::steady_clock::now() + ROUND_TRIP, std::move(onConfirm)});
+            condition_.notify_all();
+            return SendResult::Sending;
+        }
+
+        bool WaitForConfirms(std::chrono::milliseconds timeout, std::string& reason) override
+        {
+            std::unique_lock lock(guard_);
+            if (!condition_.wait_for(lock, timeout, [this] { return inFlight_.empty(); }))
+            {
+                reason = "confirms outstanding";
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        struct InFlightMessage
+        {
+            std::chrono::steady_clock::time_point confirmTime;
+            std::function<void(bool)> onConfirm;
+        };
+
+        void BrokerThreadFunction()
+        {
+            std::unique_lock lock(guard_);
+            while (true)
+            {
+                condition_.wait(lock, [this] { return isStopping_ || !inFlight_.empty(); });
+                if (inFlight_.empty())
+                {
+                    return;
+                }
+                const auto confirmTime = inFlight_.front().confirmTime;
+                if (std::chrono::steady_clock::now() < confirmTime)
+                {
+                    // Sleeps rather than waits: a send must not bring the confirm forward
+                    lock.unlock();
+                    std::this_thread::sleep_until(confirmTime);
+                    lock.lock();
+                    continue;
+                }
+                auto onConfirm = std::move(inFlight_.front().onConfirm);
+                inFlight_.pop_front();
+                condition_.notify_all();
+
+                lock.unlock();
+                onConfirm(true);
+                confirmedCount_.fetch_add(1);
+                lock.lock();
+            }
+        }
+
+        std::atomic<size_t>& confirmedCount_;
+        std::mutex guard_;
+        std::condition_variable condition_;
+        std::deque<InFlightMessage> inFlight_;
+        bool isStopping_ = false;
+        std::thread brokerThread_;
+    };
+
+    void MeasurePool(uint16_t poolSize)
+    {
+        std::atomic<size_t> confirmedCount{0};
+        RequestPublisherSettings settings;
+        settings.outboundQueue.overflowPolicy = OutboundQueueOverflowPolicy::Block;
+        settings.maxUnconfirmed = MAX_UNCONFIRMED;
+        settings.producerPoolSize = poolSize;
+
+        RequestPublisher publisher(settings, [&confirmedCount](size_t channelCount)
+        {
+            std::vector<std::unique_ptr<PublisherChannelInterface>> channels;
+            for (size_t i = 0; i < channelCount; ++i)
+            {
+                channels.push_back(std::make_unique<LocalBrokerChannel>(confirmedCount));
+            }
+            return channels;
+        });
+
+        std::vector<std::string> pnpIds;
+        for (size_t i = 0; i < DEVICE_COUNT; ++i)
+        {
+            pnpIds.push_back("alsa_output.pci-0000_00_1f.3.analog-stereo-" + std::to_string(i));
+        }
+        const std::string payload = R"({"pnpId":"alsa_output.pci-0000_00_1f.3.analog-stereo","renderVolume":420})";
+
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < MESSAGE_COUNT; ++i)
+        {
+            publisher.Publish(payload, "put", "/volume", pnpIds[i % DEVICE_COUNT]);
+        }
+        while (confirmedCount.load() < MESSAGE_COUNT)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        ed::benchmark::Report("producer pool of " + std::to_string(poolSize),
+            static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+            / static_cast<double>(MESSAGE_COUNT));
+        publisher.Drain(std::chrono::steady_clock::now() + std::chrono::seconds(5));
+    }
+}
+
+int main()
+{
+    // Per-message ACK lines would measure the sinks, and the Block policy reaches the watermarks by design
+    spdlog::set_level(spdlog::level::err);
+
+    std::cout << "Round trip " << ROUND_TRIP.count() << " us, " << MAX_UNCONFIRMED << " unconfirmed per channel\n";
+    for (const uint16_t poolSize : {1, 2, 4, 8})
+    {
+        MeasurePool(poolSize);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+#include "os-dependencies.h"
+
+#include "AllocationAccounting.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+// Counting replacements of the global allocation functions; built only with the ALLOCATION_ACCOUNTING option.
+// They allocate with malloc / posix_memalign, so every delete form simply frees.
+
+namespace
+{
+    void* Allocate(size_t size)
+    {
+        ed::allocation::RecordAllocation(size);
+        if (void* pointer = std::malloc(size == 0 ? 1 : size))
+        {
+            return pointer;
+        }
+        throw std::bad_alloc();
+    }
+
+    void* AllocateAligned(size_t size, std::align_val_t alignment)
+    {
+        ed::allocation::RecordAllocation(size);
+        void* pointer = nullptr;
+        if (posix_memalign(&pointer, std::max(static_cast<size_t>(alignment), sizeof(void*)), size == 0 ? 1 : size) == 0)
+        {
+            return pointer;
+        }
+        throw std::bad_alloc();
+    }
+
+    template<typename ALLOCATE_T_>
+    void* AllocateNoThrow(ALLOCATE_T_&& allocate) noexcept
+    {
+        try
+        {
+            return allocate();
+        }
+        catch (const std::bad_alloc&)
+        {
+            return nullptr;
+        }
+    }
+}
+
+void* operator new(size_t size) { return Allocate(size); }
+void* operator new[](size_t size) { return Allocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return AllocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return AllocateAligned(size, alignment); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return AllocateNoThrow([size] { return Allocate(size); });
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return AllocateNoThrow([size] { return Allocate(size); });
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return AllocateNoThrow([size, alignment] { return AllocateAligned(size, alignment); });
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return AllocateNoThrow([size, alignment] { return AllocateAligned(size, alignment); });
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { std::free(pointer); }
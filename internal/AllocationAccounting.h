@@ -0,0 +1,129 @@
+#pragma once
+
+#include "ClassDefHelper.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+// Allocation accounting for test and benchmark builds (CMake option ALLOCATION_ACCOUNTING).
+// The global operator new / delete are replaced by counting versions (AllocationAccounting.cpp);
+// each allocation is charged to the innermost ALLOCATION_SCOPE of the allocating thread,
+// and the totals are divided by the processed collection events (ALLOCATION_COUNT_EVENT).
+namespace ed::allocation
+{
+    enum class Stage : uint8_t
+    {
+        None = 0, // Outside any scope: start-up, log threads, libraries
+        PulseDeviceCollection,
+        ServiceObserver,
+        AudioDeviceApiClient,
+        RequestPublisher,
+        Count
+    };
+
+    inline constexpr std::array<std::string_view, static_cast<size_t>(Stage::Count)> STAGE_LABELS = {
+        "none", "pulse_device_collection", "service_observer", "audio_device_api_client", "request_publisher"
+    };
+
+    struct StageStats
+    {
+        uint64_t allocationCount = 0;
+        uint64_t allocatedBytes = 0;
+    };
+
+    namespace detail
+    {
+        struct StageCounters
+        {
+            std::atomic<uint64_t> allocationCount{0};
+            std::atomic<uint64_t> allocatedBytes{0};
+        };
+
+        // Constant-initialized, so usable from operator new before and after any dynamic initialization
+        inline std::array<StageCounters, static_cast<size_t>(Stage::Count)> stageCounters{};
+        inline std::atomic<uint64_t> processedEventCount{0};
+        inline thread_local Stage currentStage = Stage::None;
+    }
+
+    // Called by the replaced operator new; must not allocate
+    inline void RecordAllocation(size_t size) noexcept
+    {
+        auto& counters = detail::stageCounters[static_cast<size_t>(detail::currentStage)];
+        counters.allocationCount.fetch_add(1, std::memory_order_relaxed);
+        counters.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    inline void CountProcessedEvent() noexcept
+    {
+        detail::processedEventCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline StageStats GetStageStats(Stage stage)
+    {
+        const auto& counters = detail::stageCounters[static_cast<size_t>(stage)];
+        return {counters.allocationCount.load(std::memory_order_relaxed),
+                counters.allocatedBytes.load(std::memory_order_relaxed)};
+    }
+
+    inline uint64_t GetProcessedEventCount()
+    {
+        return detail::processedEventCount.load(std::memory_order_relaxed);
+    }
+
+    // Allocations and bytes per processed event, per stage
+    inline std::string RenderReport()
+    {
+        const auto eventCount = GetProcessedEventCount();
+        std::string report = fmt::format("Allocations over {} processed event(s):\n", eventCount);
+        for (size_t i = 0; i < STAGE_LABELS.size(); ++i)
+        {
+            const auto stats = GetStageStats(static_cast<Stage>(i));
+            report += fmt::format("  {:<24} {:>10} allocations {:>12} bytes", STAGE_LABELS[i],
+                                  stats.allocationCount, stats.allocatedBytes);
+            if (eventCount > 0 && static_cast<Stage>(i) != Stage::None)
+            {
+                report += fmt::format(", {:.1f} allocations {:.0f} bytes per event",
+                                      static_cast<double>(stats.allocationCount) / static_cast<double>(eventCount),
+                                      static_cast<double>(stats.allocatedBytes) / static_cast<double>(eventCount));
+            }
+            report.push_back('\n');
+        }
+        return report;
+    }
+
+    // Charges the allocations of the calling thread to the stage until the scope ends
+    class ScopedStage final
+    {
+    public:
+        explicit ScopedStage(Stage stage) noexcept
+            : previousStage_(detail::currentStage)
+        {
+            detail::currentStage = stage;
+        }
+
+        DISALLOW_COPY_MOVE(ScopedStage);
+
+        ~ScopedStage()
+        {
+            detail::currentStage = previousStage_;
+        }
+
+    private:
+        Stage previousStage_;
+    };
+}
+
+// Compiled out unless the ALLOCATION_ACCOUNTING CMake option is on
+#ifdef ALLOCATION_ACCOUNTING
+#define ALLOCATION_SCOPE(stage) ed::allocation::ScopedStage CONCAT(allocation_scope_, __LINE__)(ed::allocation::Stage::stage)
+#define ALLOCATION_COUNT_EVENT() ed::allocation::CountProcessedEvent()
+#else
+#define ALLOCATION_SCOPE(stage) static_cast<void>(0)
+#define ALLOCATION_COUNT_EVENT() static_cast<void>(0)
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+
+#include <spdlog/spdlog.h>
+
+namespace ed::coro
+{
+    // Return type of a fire-and-forget coroutine: it starts at once, runs up to its first suspension
+    // and is resumed by whatever it awaits; the frame is freed when the coroutine finishes.
+    // Meant for the loop thread, so an exception leaving the coroutine is logged and not thrown into the loop.
+    class Task final
+    {
+    public:
+        struct promise_type
+        {
+            Task get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept;
+        };
+    };
+}
+
+
+inline void ed::coro::Task::promise_type::unhandled_exception() noexcept
+{
+    try
+    {
+        throw;
+    }
+    catch (const std::exception& ex)
+    {
+        spdlog::error("Coroutine failed: {}", ex.what());
+    }
+    catch (...)
+    {
+        spdlog::error("Coroutine failed with an unknown exception.");
+    }
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "ClassDefHelper.h"
+#include "Metrics.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace ed::tracing
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Stages of a device event on its way from the PulseAudio subscription callback to the broker ACK:
+    //   PaQuery  - subscription event .. device info delivered by PulseAudio
+    //   Dispatch - device info delivered .. observer starts serializing (collection update, observers)
+    //   Encode   - serializing starts .. message pushed to the outbound queue
+    //   Send     - pushed .. handed to the RabbitMQ producer (queueing, backpressure, reconnects)
+    //   Ack      - handed to the producer .. publisher confirm received
+    enum class EventStage : uint8_t
+    {
+        PaQuery = 0,
+        Dispatch,
+        Encode,
+        Send,
+        Ack,
+        Count
+    };
+
+    inline constexpr std::array<std::string_view, static_cast<size_t>(EventStage::Count)> EVENT_STAGE_LABELS = {
+        "pa_query", "dispatch", "encode", "send", "ack"
+    };
+
+    // 10 us .. 10 s; most stages of an idle agent stay well below the default 100 us bucket
+    inline const std::vector<double>& GetStageLatencyBounds()
+    {
+        static const std::vector<double> bounds{
+            0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 10
+        };
+        return bounds;
+    }
+
+    // Monotonic stamps of one event; a default capture time means the event is not traced,
+    // e.g. the initial inventory or a request relayed from another process
+    struct EventTrace
+    {
+        Clock::time_point captureTime{};
+        Clock::time_point stageStartTime{};
+        // Non-zero for a message of the initial inventory, see StartupTrace::AddInventoryMessage
+        uint64_t inventoryMessageNumber = 0;
+
+        [[nodiscard]] bool IsTraced() const { return captureTime != Clock::time_point{}; }
+
+        // Records the time since the previous stage completed and starts the next one
+        void CompleteStage(EventStage stage, Clock::time_point now = Clock::now());
+        // Records the time since the capture; called once the broker has confirmed the event
+        void CompleteEndToEnd(Clock::time_point now = Clock::now()) const;
+    };
+
+    inline EventTrace StartEventTrace(Clock::time_point captureTime)
+    {
+        return {captureTime, captureTime};
+    }
+
+    // The trace of the event being handled on the calling thread. The PulseAudio callbacks, the observers
+    // and the request dispatcher run synchronously on the mainloop thread, so the trace travels with the call
+    // instead of through every interface; it is copied into the outbound message where the thread changes.
+    inline EventTrace& CurrentEventTrace()
+    {
+        thread_local EventTrace trace;
+        return trace;
+    }
+
+    // Makes the trace current for the scope and restores the previous one afterwards
+    class ScopedEventTrace final
+    {
+    public:
+        explicit ScopedEventTrace(const EventTrace& trace)
+            : previousTrace_(CurrentEventTrace())
+        {
+            CurrentEventTrace() = trace;
+        }
+
+        DISALLOW_COPY_MOVE(ScopedEventTrace);
+
+        ~ScopedEventTrace()
+        {
+            CurrentEventTrace() = previousTrace_;
+        }
+
+    private:
+        EventTrace previousTrace_;
+    };
+
+    inline metrics::Histogram& GetStageHistogram(EventStage stage)
+    {
+        static const auto histograms = []
+        {
+            std::array<metrics::Histogram*, static_cast<size_t>(EventStage::Count)> result{};
+            for (size_t i = 0; i < result.size(); ++i)
+            {
+                result[i] = &metrics::Registry::Inst().GetHistogram(
+                    "soundscanner_event_stage_seconds", "Latency of a device event per pipeline stage.",
+                    GetStageLatencyBounds(), fmt::format(R"(stage="{}")", EVENT_STAGE_LABELS[i]));
+            }
+            return result;
+        }();
+        return *histograms[static_cast<size_t>(stage)];
+    }
+
+    inline metrics::Histogram& GetEndToEndHistogram()
+    {
+        static auto& histogram = metrics::Registry::Inst().GetHistogram(
+            "soundscanner_event_end_to_end_seconds",
+            "Latency of a device event from the PulseAudio callback to the broker ACK.",
+            GetStageLatencyBounds());
+        return histogram;
+    }
+
+    // Creates the histograms up front, so they are exported before the first event and not created mid-stage
+    inline void RegisterMetrics()
+    {
+        for (size_t i = 0; i < static_cast<size_t>(EventStage::Count); ++i)
+        {
+            GetStageHistogram(static_cast<EventStage>(i));
+        }
+        GetEndToEndHistogram();
+    }
+
+    // The wall-clock time of a monotonic stamp, e.g. to date a message by its capture instead of its encoding
+    inline std::chrono::system_clock::time_point ToSystemTime(Clock::time_point timePoint)
+    {
+        return std::chrono::system_clock::now()
+            - std::chrono::duration_cast<std::chrono::system_clock::duration>(Clock::now() - timePoint);
+    }
+}
+
+inline void ed::tracing::EventTrace::CompleteStage(EventStage stage, Clock::time_point now)
+{
+    if (!IsTraced())
+    {
+        return;
+    }
+    GetStageHistogram(stage).Observe(now - stageStartTime);
+    stageStartTime = now;
+}
+
+inline void ed::tracing::EventTrace::CompleteEndToEnd(Clock::time_point now) const
+{
+    if (IsTraced())
+    {
+        GetEndToEndHistogram().Observe(now - captureTime);
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+
+namespace ed
+{
+    // Appends text escaped the way nlohmann::json::dump does (no ASCII-only escaping of UTF-8 sequences);
+    // the text is expected to be valid UTF-8 already, see Utf8Utils.h
+    inline void AppendJsonEscaped(std::string& output, std::string_view text)
+    {
+        constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+        auto runBegin = text.data();
+        const auto textEnd = text.data() + text.size();
+        for (auto cursor = runBegin; cursor != textEnd; ++cursor)
+        {
+            const auto c = static_cast<unsigned char>(*cursor);
+            if (c >= 0x20 && c != '"' && c != '\\')
+            {
+                continue;
+            }
+
+            output.append(runBegin, cursor);
+            runBegin = cursor + 1;
+            switch (c)
+            {
+            case '"': output.append("\\\""); break;
+            case '\\': output.append("\\\\"); break;
+            case '\b': output.append("\\b"); break;
+            case '\f': output.append("\\f"); break;
+            case '\n': output.append("\\n"); break;
+            case '\r': output.append("\\r"); break;
+            case '\t': output.append("\\t"); break;
+            default:
+                output.append("\\u00");
+                output.push_back(HEX_DIGITS[c >> 4]);
+                output.push_back(HEX_DIGITS[c & 0x0F]);
+                break;
+            }
+        }
+        output.append(runBegin, textEnd);
+    }
+
+    // Appends "text" including the quotes
+    inline void AppendJsonString(std::string& output, std::string_view text)
+    {
+        output.push_back('"');
+        AppendJsonEscaped(output, text);
+        output.push_back('"');
+    }
+
+    template <typename T_>
+        requires std::is_integral_v<T_> || std::is_enum_v<T_>
+    void AppendJsonNumber(std::string& output, T_ value)
+    {
+        char buffer[24];
+        const auto [ptr, ec] = [&]
+        {
+            if constexpr (std::is_enum_v<T_>)
+            {
+                // Enums serialize as their underlying integer, like nlohmann::json does
+                return std::to_chars(std::begin(buffer), std::end(buffer),
+                                     static_cast<int64_t>(static_cast<std::underlying_type_t<T_>>(value)));
+            }
+            else
+            {
+                return std::to_chars(std::begin(buffer), std::end(buffer), value);
+            }
+        }();
+        output.append(buffer, ptr);
+    }
+
+    // Finds the raw (still escaped) value of a top-level "key":"value" pair in a flat JSON object
+    // produced by this application; returns an empty view if there is none
+    inline std::string_view FindJsonStringField(std::string_view document, std::string_view key)
+    {
+        std::string pattern;
+        pattern.reserve(key.size() + 4);
+        pattern.push_back('"');
+        pattern.append(key);
+        pattern.append("\":\"");
+
+        const auto valueBegin = document.find(pattern);
+        if (valueBegin == std::string_view::npos)
+        {
+            return {};
+        }
+        const auto begin = valueBegin + pattern.size();
+        for (auto end = begin; end < document.size(); ++end)
+        {
+            if (document[end] == '\\')
+            {
+                ++end;
+            }
+            else if (document[end] == '"')
+            {
+                return document.substr(begin, end - begin);
+            }
+        }
+        return {};
+    }
+
+    // Same as FindJsonStringField for an unquoted number value
+    inline std::string_view FindJsonNumberField(std::string_view document, std::string_view key)
+    {
+        std::string pattern;
+        pattern.reserve(key.size() + 3);
+        pattern.push_back('"');
+        pattern.append(key);
+        pattern.append("\":");
+
+        const auto valueBegin = document.find(pattern);
+        if (valueBegin == std::string_view::npos)
+        {
+            return {};
+        }
+        const auto begin = valueBegin + pattern.size();
+        const auto end = document.find_first_not_of("-0123456789", begin);
+        return document.substr(begin, (end == std::string_view::npos ? document.size() : end) - begin);
+    }
+}
@@ -0,0 +1,377 @@
+#pragma once
+
+#include "ClassDefHelper.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace ed::metrics
+{
+    // Counters and histograms are split into cache-line sized shards, picked per thread,
+    // so recording is one relaxed atomic increment without cache-line ping-pong between threads
+    inline constexpr size_t SHARD_COUNT = 8;
+    inline constexpr size_t CACHE_LINE_SIZE = 64;
+
+    inline size_t GetThreadShardIndex()
+    {
+        static std::atomic<size_t> nextIndex{0};
+        thread_local const size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+        return index;
+    }
+
+    class Counter final
+    {
+    public:
+        Counter() = default;
+        DISALLOW_COPY_MOVE(Counter);
+        ~Counter() = default;
+
+        void Increment(uint64_t value = 1)
+        {
+            shards_[GetThreadShardIndex()].value.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t GetValue() const
+        {
+            uint64_t sum = 0;
+            for (const auto& shard : shards_)
+            {
+                sum += shard.value.load(std::memory_order_relaxed);
+            }
+            return sum;
+        }
+
+    private:
+        struct alignas(CACHE_LINE_SIZE) Shard
+        {
+            std::atomic<uint64_t> value{0};
+        };
+        std::array<Shard, SHARD_COUNT> shards_;
+    };
+
+    // A value set by its owner, e.g. a queue depth; not sharded, since it is a store, not a read-modify-write
+    class Gauge final
+    {
+    public:
+        Gauge() = default;
+        DISALLOW_COPY_MOVE(Gauge);
+        ~Gauge() = default;
+
+        void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+        void Add(int64_t value) { value_.fetch_add(value, std::memory_order_relaxed); }
+        [[nodiscard]] int64_t GetValue() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        alignas(CACHE_LINE_SIZE) std::atomic<int64_t> value_{0};
+    };
+
+    // Durations in fixed buckets; the bounds are upper bounds in seconds, as Prometheus expects them
+    class Histogram final
+    {
+    public:
+        static constexpr size_t MAX_BUCKET_COUNT = 15;
+
+        explicit Histogram(const std::vector<double>& upperBoundsInSeconds);
+        DISALLOW_COPY_MOVE(Histogram);
+        ~Histogram() = default;
+
+        void Observe(std::chrono::nanoseconds duration);
+
+        struct Snapshot
+        {
+            std::vector<double> upperBoundsInSeconds;
+            std::vector<uint64_t> cumulativeCounts; // One more than the bounds: +Inf
+            double sumInSeconds = 0;
+        };
+        [[nodiscard]] Snapshot GetSnapshot() const;
+
+    private:
+        struct alignas(CACHE_LINE_SIZE) Shard
+        {
+            std::array<std::atomic<uint64_t>, MAX_BUCKET_COUNT + 1> counts{};
+            std::atomic<uint64_t> sumInNanoseconds{0};
+        };
+
+        size_t boundCount_;
+        std::array<int64_t, MAX_BUCKET_COUNT> upperBoundsInNanoseconds_{};
+        std::vector<double> upperBoundsInSeconds_;
+        std::array<Shard, SHARD_COUNT> shards_;
+    };
+
+    // 100 us .. 10 s, for event and round trip latencies
+    inline const std::vector<double>& GetDefaultLatencyBounds()
+    {
+        static const std::vector<double> bounds{
+            0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 10
+        };
+        return bounds;
+    }
+
+    // Process-wide set of metrics, rendered in the Prometheus text exposition format.
+    // Metrics are created once (e.g. in constructors) and then recorded through the returned references,
+    // which stay valid for the lifetime of the process. Labels are given preformatted: R"(lane="0")".
+    class Registry final
+    {
+    public:
+        DISALLOW_COPY_MOVE(Registry);
+        ~Registry() = default;
+
+        static Registry& Inst();
+
+        // Returns the existing metric for the same name and labels
+        Counter& GetCounter(std::string_view name, std::string_view help, std::string_view labels = "");
+        Gauge& GetGauge(std::string_view name, std::string_view help, std::string_view labels = "");
+        Histogram& GetHistogram(std::string_view name, std::string_view help,
+                                const std::vector<double>& upperBoundsInSeconds = GetDefaultLatencyBounds(),
+                                std::string_view labels = "");
+
+        // Read at rendering time; for values kept by process-lifetime objects (e.g. the logger)
+        void AddCounterCallback(std::string_view name, std::string_view help, std::function<uint64_t()> callback,
+                                std::string_view labels = "");
+
+        [[nodiscard]] std::string Render() const;
+
+    private:
+        Registry() = default;
+
+        enum class Type : uint8_t
+        {
+            Counter,
+            Gauge,
+            Histogram
+        };
+
+        struct Family
+        {
+            std::string help;
+            Type type = Type::Counter;
+            // Labels to metric
+            std::map<std::string, Counter*, std::less<>> counters;
+            std::map<std::string, Gauge*, std::less<>> gauges;
+            std::map<std::string, Histogram*, std::less<>> histograms;
+            std::map<std::string, std::function<uint64_t()>, std::less<>> callbacks;
+        };
+
+        Family& GetFamilyLocked(std::string_view name, std::string_view help, Type type);
+        static void RenderSample(std::string& output, std::string_view name, std::string_view labels,
+                                 std::string_view extraLabel, auto value);
+
+    private:
+        mutable std::mutex guard_;
+        std::map<std::string, Family, std::less<>> families_;
+        std::deque<Counter> counterStorage_;
+        std::deque<Gauge> gaugeStorage_;
+        std::deque<std::unique_ptr<Histogram>> histogramStorage_;
+    };
+
+    // Records the time from construction to destruction
+    class ScopedTimer final
+    {
+    public:
+        explicit ScopedTimer(Histogram& histogram)
+            : histogram_(histogram)
+            , start_(std::chrono::steady_clock::now())
+        {
+        }
+        DISALLOW_COPY_MOVE(ScopedTimer);
+
+        ~ScopedTimer()
+        {
+            histogram_.Observe(std::chrono::steady_clock::now() - start_);
+        }
+
+    private:
+        Histogram& histogram_;
+        std::chrono::steady_clock::time_point start_;
+    };
+}
+
+
+inline ed::metrics::Histogram::Histogram(const std::vector<double>& upperBoundsInSeconds)
+    : boundCount_(std::min(upperBoundsInSeconds.size(), MAX_BUCKET_COUNT))
+    , upperBoundsInSeconds_(upperBoundsInSeconds.begin(),
+                            upperBoundsInSeconds.begin() + static_cast<std::ptrdiff_t>(boundCount_))
+{
+    std::ranges::sort(upperBoundsInSeconds_);
+    for (size_t i = 0; i < boundCount_; ++i)
+    {
+        upperBoundsInNanoseconds_[i] = static_cast<int64_t>(upperBoundsInSeconds_[i] * 1e9);
+    }
+}
+
+inline void ed::metrics::Histogram::Observe(std::chrono::nanoseconds duration)
+{
+    const auto nanoseconds = std::max<int64_t>(duration.count(), 0);
+    size_t bucket = 0;
+    while (bucket < boundCount_ && nanoseconds > upperBoundsInNanoseconds_[bucket])
+    {
+        ++bucket;
+    }
+
+    auto& shard = shards_[GetThreadShardIndex()];
+    shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.sumInNanoseconds.fetch_add(static_cast<uint64_t>(nanoseconds), std::memory_order_relaxed);
+}
+
+inline ed::metrics::Histogram::Snapshot ed::metrics::Histogram::GetSnapshot() const
+{
+    Snapshot snapshot;
+    snapshot.upperBoundsInSeconds = upperBoundsInSeconds_;
+    snapshot.cumulativeCounts.assign(boundCount_ + 1, 0);
+
+    uint64_t sumInNanoseconds = 0;
+    for (const auto& shard : shards_)
+    {
+        for (size_t bucket = 0; bucket <= boundCount_; ++bucket)
+        {
+            snapshot.cumulativeCounts[bucket] += shard.counts[bucket].load(std::memory_order_relaxed);
+        }
+        sumInNanoseconds += shard.sumInNanoseconds.load(std::memory_order_relaxed);
+    }
+    for (size_t bucket = 1; bucket <= boundCount_; ++bucket)
+    {
+        snapshot.cumulativeCounts[bucket] += snapshot.cumulativeCounts[bucket - 1];
+    }
+    snapshot.sumInSeconds = static_cast<double>(sumInNanoseconds) / 1e9;
+    return snapshot;
+}
+
+inline ed::metrics::Registry& ed::metrics::Registry::Inst()
+{
+    static Registry registry;
+    return registry;
+}
+
+inline ed::metrics::Registry::Family& ed::metrics::Registry::GetFamilyLocked(std::string_view name,
+    std::string_view help, Type type)
+{
+    auto foundPair = families_.find(name);
+    if (foundPair == families_.end())
+    {
+        foundPair = families_.emplace(std::string(name), Family{}).first;
+        foundPair->second.help = help;
+        foundPair->second.type = type;
+    }
+    return foundPair->second;
+}
+
+inline ed::metrics::Counter& ed::metrics::Registry::GetCounter(std::string_view name, std::string_view help,
+    std::string_view labels)
+{
+    std::lock_guard lock(guard_);
+    auto& family = GetFamilyLocked(name, help, Type::Counter);
+    if (const auto foundPair = family.counters.find(labels); foundPair != family.counters.end())
+    {
+        return *foundPair->second;
+    }
+    auto& counter = counterStorage_.emplace_back();
+    family.counters.emplace(std::string(labels), &counter);
+    return counter;
+}
+
+inline ed::metrics::Gauge& ed::metrics::Registry::GetGauge(std::string_view name, std::string_view help,
+    std::string_view labels)
+{
+    std::lock_guard lock(guard_);
+    auto& family = GetFamilyLocked(name, help, Type::Gauge);
+    if (const auto foundPair = family.gauges.find(labels); foundPair != family.gauges.end())
+    {
+        return *foundPair->second;
+    }
+    auto& gauge = gaugeStorage_.emplace_back();
+    family.gauges.emplace(std::string(labels), &gauge);
+    return gauge;
+}
+
+inline ed::metrics::Histogram& ed::metrics::Registry::GetHistogram(std::string_view name, std::string_view help,
+    const std::vector<double>& upperBoundsInSeconds, std::string_view labels)
+{
+    std::lock_guard lock(guard_);
+    auto& family = GetFamilyLocked(name, help, Type::Histogram);
+    if (const auto foundPair = family.histograms.find(labels); foundPair != family.histograms.end())
+    {
+        return *foundPair->second;
+    }
+    auto& histogram = *histogramStorage_.emplace_back(std::make_unique<Histogram>(upperBoundsInSeconds));
+    family.histograms.emplace(std::string(labels), &histogram);
+    return histogram;
+}
+
+inline void ed::metrics::Registry::AddCounterCallback(std::string_view name, std::string_view help,
+    std::function<uint64_t()> callback, std::string_view labels)
+{
+    std::lock_guard lock(guard_);
+    GetFamilyLocked(name, help, Type::Counter).callbacks.insert_or_assign(std::string(labels), std::move(callback));
+}
+
+inline void ed::metrics::Registry::RenderSample(std::string& output, std::string_view name, std::string_view labels,
+    std::string_view extraLabel, auto value)
+{
+    output.append(name);
+    if (!labels.empty() || !extraLabel.empty())
+    {
+        output.push_back('{');
+        output.append(labels);
+        if (!labels.empty() && !extraLabel.empty())
+        {
+            output.push_back(',');
+        }
+        output.append(extraLabel);
+        output.push_back('}');
+    }
+    fmt::format_to(std::back_inserter(output), " {}\n", value);
+}
+
+inline std::string ed::metrics::Registry::Render() const
+{
+    constexpr std::string_view TYPE_NAMES[] = {"counter", "gauge", "histogram"};
+
+    std::string output;
+    std::lock_guard lock(guard_);
+    for (const auto& [name, family] : families_)
+    {
+        fmt::format_to(std::back_inserter(output), "# HELP {} {}\n# TYPE {} {}\n",
+                       name, family.help, name, TYPE_NAMES[static_cast<size_t>(family.type)]);
+        for (const auto& [labels, callback] : family.callbacks)
+        {
+            RenderSample(output, name, labels, "", callback());
+        }
+        for (const auto& [labels, counter] : family.counters)
+        {
+            RenderSample(output, name, labels, "", counter->GetValue());
+        }
+        for (const auto& [labels, gauge] : family.gauges)
+        {
+            RenderSample(output, name, labels, "", gauge->GetValue());
+        }
+        for (const auto& [labels, histogram] : family.histograms)
+        {
+            const auto snapshot = histogram->GetSnapshot();
+            const auto bucketName = name + "_bucket";
+            for (size_t bucket = 0; bucket < snapshot.upperBoundsInSeconds.size(); ++bucket)
+            {
+                RenderSample(output, bucketName, labels,
+                             fmt::format(R"(le="{}")", snapshot.upperBoundsInSeconds[bucket]),
+                             snapshot.cumulativeCounts[bucket]);
+            }
+            RenderSample(output, bucketName, labels, R"(le="+Inf")", snapshot.cumulativeCounts.back());
+            RenderSample(output, name + "_sum", labels, "", snapshot.sumInSeconds);
+            RenderSample(output, name + "_count", labels, "", snapshot.cumulativeCounts.back());
+        }
+    }
+    return output;
+}
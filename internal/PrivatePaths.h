@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fmt/format.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ed::utility
+{
+    // Directories of the files other local users must neither plant, read nor replace (the relay socket,
+    // the spill file): created with mode 0700 if missing, rejected unless owned by the effective user
+    class PrivatePaths
+    {
+    public:
+        // $XDG_RUNTIME_DIR/<appName>; as root /run/<appName>; otherwise /tmp/<appName>-<uid>
+        static std::filesystem::path GetRuntimeDir(const std::string& appName);
+        // $XDG_STATE_HOME/<appName>; otherwise $HOME/.local/state/<appName>
+        static std::filesystem::path GetStateDir(const std::string& appName);
+        // A relative path is placed in the directory, an absolute one is used as configured; empty stays empty
+        static std::filesystem::path Resolve(const std::string& path, const std::filesystem::path& dir);
+
+        // Throws std::runtime_error if the directory can not be created or is not private
+        static void EnsurePrivateDir(const std::filesystem::path& dir);
+
+    private:
+        static std::filesystem::path GetEnvDir(const char* variableName);
+    };
+}
+
+
+inline std::filesystem::path ed::utility::PrivatePaths::GetRuntimeDir(const std::string& appName)
+{
+    if (auto dir = GetEnvDir("XDG_RUNTIME_DIR"); !dir.empty())
+    {
+        return dir / appName;
+    }
+    if (::geteuid() == 0)
+    {
+        return std::filesystem::path("/run") / appName;
+    }
+    return std::filesystem::path("/tmp") / fmt::format("{}-{}", appName, ::geteuid());
+}
+
+inline std::filesystem::path ed::utility::PrivatePaths::GetStateDir(const std::string& appName)
+{
+    if (auto dir = GetEnvDir("XDG_STATE_HOME"); !dir.empty())
+    {
+        return dir / appName;
+    }
+    if (auto dir = GetEnvDir("HOME"); !dir.empty())
+    {
+        return dir / ".local" / "state" / appName;
+    }
+    return GetRuntimeDir(appName);
+}
+
+inline std::filesystem::path ed::utility::PrivatePaths::Resolve(const std::string& path,
+                                                                const std::filesystem::path& dir)
+{
+    if (path.empty())
+    {
+        return {};
+    }
+    std::filesystem::path result(path);
+    if (result.is_absolute())
+    {
+        return result;
+    }
+    EnsurePrivateDir(dir);
+    return dir / result;
+}
+
+inline void ed::utility::PrivatePaths::EnsurePrivateDir(const std::filesystem::path& dir)
+{
+    std::error_code errorCode;
+    std::filesystem::create_directories(dir.parent_path(), errorCode);
+    if (::mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)
+    {
+        throw std::runtime_error(fmt::format("Can not create the directory {}: {}",
+                                             dir.string(), std::generic_category().message(errno)));
+    }
+
+    // lstat: a symbolic link planted in place of the directory is rejected as well
+    struct stat dirStat{};
+    if (::lstat(dir.c_str(), &dirStat) != 0 || !S_ISDIR(dirStat.st_mode) || dirStat.st_uid != ::geteuid())
+    {
+        throw std::runtime_error(fmt::format("{} is not a directory owned by user {}", dir.string(), ::geteuid()));
+    }
+    if ((dirStat.st_mode & 077) != 0 && ::chmod(dir.c_str(), 0700) != 0)
+    {
+        throw std::runtime_error(fmt::format("Can not restrict the access to {}: {}",
+                                             dir.string(), std::generic_category().message(errno)));
+    }
+}
+
+inline std::filesystem::path ed::utility::PrivatePaths::GetEnvDir(const char* variableName)
+{
+    const char* value = std::getenv(variableName);
+    if (value == nullptr || *value != '/')
+    {
+        return {};
+    }
+    return value;
+}
@@ -1,20 +1,78 @@
 ﻿#pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <iomanip>
+#include <set>
 #include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
 
 namespace ed::utility
 {
+    enum class LogRetentionAction : uint8_t
+    {
+        Delete,
+        Archive // Move into the "archive" subdirectory
+    };
+
+    // Limits for the log files of previous runs; 0 means "no limit".
+    // The count and size limits also apply to the archive, on its own; archived files beyond them are deleted.
+    struct LogRetentionPolicy
+    {
+        size_t maxFileCount = 0;
+        uint64_t maxTotalBytes = 0;
+        std::chrono::hours maxAge{0};
+        LogRetentionAction action = LogRetentionAction::Delete;
+    };
+
+    struct LogRetentionResult
+    {
+        size_t keptFileCount = 0;
+        uint64_t keptBytes = 0;
+        size_t removedFileCount = 0;
+        uint64_t removedBytes = 0;
+    };
+
     class AppPath
     {
     public:
-        static bool GetAndValidateLogFilePathName(std::filesystem::path& logFile, const std::string& appFileNameWoExt);
+        static constexpr int MAX_LOG_FILE_NUMBER = 99999;
+        static constexpr auto ARCHIVE_DIR_NAME = "archive";
+
+        // Scans the log directory once: picks the number after the highest one in use and applies the retention policy,
+        // then, when archiving, applies its count and size limits to the archive
+        static bool GetAndValidateLogFilePathName(std::filesystem::path& logFile, const std::string& appFileNameWoExt,
+                                                  const LogRetentionPolicy& retentionPolicy = {},
+                                                  LogRetentionResult* retentionResult = nullptr,
+                                                  LogRetentionResult* archiveRetentionResult = nullptr);
     protected:
+        struct LogFileInfo
+        {
+            std::filesystem::path path;
+            int number = 0;
+            uint64_t size = 0;
+            std::filesystem::file_time_type lastWriteTime;
+        };
+
         static void GetLogDir(std::filesystem::path& ownDataPath, const std::string& appFileNameWoExt);
+        // Files whose size or modification time can not be read are left out of logFiles, not of usedNumbers
+        static void ScanLogFiles(const std::filesystem::path& directory, const std::string& logFileNameWoExt,
+                                 std::vector<LogFileInfo>& logFiles, std::set<int>& usedNumbers);
+        // Returns -1 unless the name is "<logFileNameWoExt><5 digits>" followed by the end or '.'
+        static int ParseLogFileNumber(const std::string& fileName, const std::string& logFileNameWoExt);
+        static LogRetentionResult ApplyRetentionPolicy(const std::filesystem::path& ownDataPath,
+                                                       std::vector<LogFileInfo>& logFiles,
+                                                       const LogRetentionPolicy& retentionPolicy);
     };
 }
 
-inline bool ed::utility::AppPath::GetAndValidateLogFilePathName(std::filesystem::path& logFile, const std::string& appFileNameWoExt)
+inline bool ed::utility::AppPath::GetAndValidateLogFilePathName(std::filesystem::path& logFile,
+    const std::string& appFileNameWoExt, const LogRetentionPolicy& retentionPolicy,
+    LogRetentionResult* retentionResult, LogRetentionResult* archiveRetentionResult)
 {
     std::filesystem::path ownDataPath;
     GetLogDir(ownDataPath, appFileNameWoExt);
@@ -24,26 +82,59 @@ inline bool ed::utility::AppPath::GetAndValidateLogFilePathName(std::filesystem:
     { // replace . via _
         logFileNameWoExt.replace(logFileNameWoExt.find('.'), 1, "_");
     }
-    if (exists(ownDataPath) || create_directories(ownDataPath))
+    if (!exists(ownDataPath) && !create_directories(ownDataPath))
     {
-        std::filesystem::path logFilePathName;
-        auto numberToIncrement = -1;
-        do
+        return false;
+    }
+
+    std::vector<LogFileInfo> logFiles;
+    std::set<int> usedNumbers;
+    ScanLogFiles(ownDataPath, logFileNameWoExt, logFiles, usedNumbers);
+
+    // Continue after the highest number, so the numbers keep the order of the runs;
+    // only when the range is exhausted, reuse the lowest free one
+    auto numberToUse = usedNumbers.empty() ? 0 : *usedNumbers.rbegin() + 1;
+    if (numberToUse > MAX_LOG_FILE_NUMBER)
+    {
+        numberToUse = 0;
+        while (usedNumbers.contains(numberToUse))
         {
-            if (++numberToIncrement > 99999)
+            if (++numberToUse > MAX_LOG_FILE_NUMBER)
             {
                 return false;
             }
-            std::ostringstream ossForFileName;
-            ossForFileName << logFileNameWoExt << std::setfill('0') << std::setw(5) << numberToIncrement;
-            logFilePathName = ownDataPath / ossForFileName.str();
-            logFilePathName.replace_extension(".log");
-        } while (std::filesystem::exists(logFilePathName));
+        }
+    }
+
+    const auto result = ApplyRetentionPolicy(ownDataPath, logFiles, retentionPolicy);
+    if (retentionResult != nullptr)
+    {
+        *retentionResult = result;
+    }
+
+    if (retentionPolicy.action == LogRetentionAction::Archive)
+    {
+        std::vector<LogFileInfo> archivedFiles;
+        std::set<int> archivedNumbers;
+        ScanLogFiles(ownDataPath / ARCHIVE_DIR_NAME, logFileNameWoExt, archivedFiles, archivedNumbers);
 
-        logFile.swap(logFilePathName);
-        return true;
+        auto archivePolicy = retentionPolicy;
+        archivePolicy.maxAge = std::chrono::hours(0); // Files are archived for being old
+        archivePolicy.action = LogRetentionAction::Delete;
+        const auto archiveResult = ApplyRetentionPolicy(ownDataPath / ARCHIVE_DIR_NAME, archivedFiles, archivePolicy);
+        if (archiveRetentionResult != nullptr)
+        {
+            *archiveRetentionResult = archiveResult;
+        }
     }
-    return false;
+
+    std::ostringstream ossForFileName;
+    ossForFileName << logFileNameWoExt << std::setfill('0') << std::setw(5) << numberToUse;
+    std::filesystem::path logFilePathName = ownDataPath / ossForFileName.str();
+    logFilePathName.replace_extension(".log");
+
+    logFile.swap(logFilePathName);
+    return true;
 }
 
 inline void ed::utility::AppPath::GetLogDir(std::filesystem::path& ownDataPath,
@@ -52,3 +143,107 @@ inline void ed::utility::AppPath::GetLogDir(std::filesystem::path& ownDataPath,
     ownDataPath = std::filesystem::path(std::getenv("HOME")) / "logs";
 }
 
+inline void ed::utility::AppPath::ScanLogFiles(const std::filesystem::path& directory,
+    const std::string& logFileNameWoExt, std::vector<LogFileInfo>& logFiles, std::set<int>& usedNumbers)
+{
+    std::error_code errorCode;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, errorCode))
+    {
+        if (!entry.is_regular_file(errorCode))
+        {
+            continue;
+        }
+        const auto number = ParseLogFileNumber(entry.path().filename().string(), logFileNameWoExt);
+        if (number < 0)
+        {
+            continue;
+        }
+        usedNumbers.insert(number);
+
+        // On an error the size is -1 and the time file_time_type::min(), which would overflow the age
+        std::error_code sizeErrorCode;
+        std::error_code timeErrorCode;
+        const auto size = entry.file_size(sizeErrorCode);
+        const auto lastWriteTime = entry.last_write_time(timeErrorCode);
+        if (sizeErrorCode || timeErrorCode)
+        {
+            continue;
+        }
+        logFiles.push_back({entry.path(), number, size, lastWriteTime});
+    }
+}
+
+inline int ed::utility::AppPath::ParseLogFileNumber(const std::string& fileName, const std::string& logFileNameWoExt)
+{
+    constexpr size_t NUMBER_WIDTH = 5;
+    if (!fileName.starts_with(logFileNameWoExt) || fileName.size() < logFileNameWoExt.size() + NUMBER_WIDTH)
+    {
+        return -1;
+    }
+    const auto numberEnd = logFileNameWoExt.size() + NUMBER_WIDTH;
+    if (numberEnd < fileName.size() && fileName[numberEnd] != '.')
+    {
+        return -1;
+    }
+
+    int number = 0;
+    for (auto i = logFileNameWoExt.size(); i < numberEnd; ++i)
+    {
+        if (fileName[i] < '0' || fileName[i] > '9')
+        {
+            return -1;
+        }
+        number = number * 10 + (fileName[i] - '0');
+    }
+    return number;
+}
+
+inline ed::utility::LogRetentionResult ed::utility::AppPath::ApplyRetentionPolicy(
+    const std::filesystem::path& ownDataPath, std::vector<LogFileInfo>& logFiles,
+    const LogRetentionPolicy& retentionPolicy)
+{
+    LogRetentionResult result;
+
+    // Newest first: files are kept while they fit into all limits
+    std::ranges::sort(logFiles, [](const LogFileInfo& left, const LogFileInfo& right)
+    {
+        return left.lastWriteTime > right.lastWriteTime;
+    });
+
+    const auto now = std::filesystem::file_time_type::clock::now();
+    for (const auto& logFile : logFiles)
+    {
+        const bool isWithinLimits =
+            (retentionPolicy.maxFileCount == 0 || result.keptFileCount < retentionPolicy.maxFileCount)
+            && (retentionPolicy.maxTotalBytes == 0 || result.keptBytes + logFile.size <= retentionPolicy.maxTotalBytes)
+            && (retentionPolicy.maxAge.count() == 0 || now - logFile.lastWriteTime <= retentionPolicy.maxAge);
+        if (isWithinLimits)
+        {
+            ++result.keptFileCount;
+            result.keptBytes += logFile.size;
+            continue;
+        }
+
+        std::error_code errorCode;
+        if (retentionPolicy.action == LogRetentionAction::Archive)
+        {
+            const auto archivePath = ownDataPath / ARCHIVE_DIR_NAME;
+            std::filesystem::create_directories(archivePath, errorCode);
+            std::filesystem::rename(logFile.path, archivePath / logFile.path.filename(), errorCode);
+        }
+        else
+        {
+            std::filesystem::remove(logFile.path, errorCode);
+        }
+
+        if (errorCode)
+        {
+            ++result.keptFileCount; // Could not be removed, it still takes the space
+            result.keptBytes += logFile.size;
+            continue;
+        }
+        ++result.removedFileCount;
+        result.removedBytes += logFile.size;
+    }
+    return result;
+}
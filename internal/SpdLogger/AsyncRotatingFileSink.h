@@ -0,0 +1,526 @@
+#pragma once
+
+#include "../ClassDefHelper.h"
+#include "../StallWatchdog.h"
+#include "LogCompressor.h"
+
+#include <spdlog/sinks/base_sink.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(HAS_LIBURING)
+#include <liburing.h>
+#endif
+
+namespace ed::model
+{
+    // Rotating file sink that never does file I/O on the logging threads: formatted records are
+    // batched into page-aligned buffers, which a writer thread submits with io_uring (write if
+    // liburing is not compiled in or the kernel refuses a ring) and rotates the files in between.
+    // The file is opened for appending, so a sink replacing another one on the same file (Logger::Reinit)
+    // never overwrites the lines the old one is still writing.
+    // File names follow spdlog's rotating_file_sink: name.log, name.1.log, ... name.N.log.
+    // With a compressed byte budget, rotated files are numbered in rotation order instead
+    // (name.1.log is the oldest), gzipped in the background and limited by that budget, not by maxFiles.
+    class AsyncRotatingFileSink final : public spdlog::sinks::base_sink<std::mutex>
+    {
+    public:
+        static constexpr size_t BUFFER_ALIGNMENT = 4096;
+        static constexpr size_t DEFAULT_BUFFER_SIZE = 256 * 1024;
+        static constexpr size_t BUFFER_COUNT = 4;
+
+        // maxCompressedBytes 0: rotated files stay uncompressed
+        AsyncRotatingFileSink(std::filesystem::path pathName, size_t maxFileSize, size_t maxFiles,
+                              uint64_t maxCompressedBytes = 0, size_t bufferSize = DEFAULT_BUFFER_SIZE);
+        ~AsyncRotatingFileSink() override;
+
+        DISALLOW_COPY_MOVE(AsyncRotatingFileSink);
+
+        [[nodiscard]] bool IsUsingIoUring() const { return isUsingIoUring_.load(std::memory_order_relaxed); }
+        [[nodiscard]] bool IsCompressing() const { return compressor_ != nullptr; }
+
+    protected:
+        void sink_it_(const spdlog::details::log_msg& msg) override;
+        void flush_() override;
+
+    private:
+        struct Buffer
+        {
+            char* data = nullptr;
+            size_t size = 0;
+            int writeResult = 0; // Set by the writer thread
+        };
+
+        // Requires base_sink's mutex
+        void AppendLocked(const char* data, size_t size);
+        void SubmitActiveLocked();
+
+        void WriterThreadFunction();
+        void WriteBatch(const std::vector<Buffer*>& batch);
+        void WriteSegment(const std::vector<Buffer*>& segment);
+        void WriteSynchronously(const char* data, size_t size);
+#if defined(HAS_LIBURING)
+        // Waits for the completions of the submitted entries; false if the ring has to be given up
+        [[nodiscard]] bool ReapCompletions(size_t count);
+#endif
+        void Rotate();
+        void RotateForCompression();
+        void OpenFile(bool truncate);
+        [[nodiscard]] std::filesystem::path CalcFileName(size_t index) const;
+        void ReportError(const char* operation, int errorCode);
+
+    private:
+        std::filesystem::path pathName_;
+        size_t maxFileSize_;
+        size_t maxFiles_;
+        size_t bufferSize_;
+
+        std::vector<std::unique_ptr<char, decltype(&std::free)>> storage_;
+        std::vector<Buffer> buffers_;
+        Buffer* activeBuffer_ = nullptr; // Guarded by base_sink's mutex
+
+        std::mutex queueGuard_;
+        std::condition_variable queueCondition_; // Filled buffers for the writer
+        std::condition_variable freeCondition_; // Free buffers and write progress for the loggers
+        std::deque<Buffer*> filledBuffers_;
+        std::vector<Buffer*> freeBuffers_;
+        uint64_t submittedBufferCount_ = 0;
+        uint64_t writtenBufferCount_ = 0;
+        bool isStopping_ = false;
+
+        // Used by the writer thread only
+        int fd_ = -1;
+        size_t currentFileSize_ = 0;
+        bool isErrorReported_ = false;
+        size_t rotationCount_ = 0;
+        std::atomic<bool> isUsingIoUring_{false};
+#if defined(HAS_LIBURING)
+        io_uring ring_{};
+#endif
+
+        std::unique_ptr<LogCompressor> compressor_;
+        std::thread writerThread_;
+    };
+}
+
+
+inline ed::model::AsyncRotatingFileSink::AsyncRotatingFileSink(std::filesystem::path pathName, size_t maxFileSize,
+    size_t maxFiles, uint64_t maxCompressedBytes, size_t bufferSize)
+    : pathName_(std::move(pathName))
+    , maxFileSize_(std::max<size_t>(maxFileSize, 1))
+    , maxFiles_(maxFiles)
+    , bufferSize_((std::max<size_t>(bufferSize, BUFFER_ALIGNMENT) + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT)
+{
+    buffers_.resize(BUFFER_COUNT);
+    for (auto& buffer : buffers_)
+    {
+        auto* data = static_cast<char*>(std::aligned_alloc(BUFFER_ALIGNMENT, bufferSize_));
+        if (data == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        storage_.emplace_back(data, &std::free);
+        buffer.data = data;
+        freeBuffers_.push_back(&buffer);
+    }
+    activeBuffer_ = freeBuffers_.back();
+    freeBuffers_.pop_back();
+
+    OpenFile(false);
+
+    if (maxCompressedBytes > 0)
+    {
+        compressor_ = std::make_unique<LogCompressor>(pathName_, maxCompressedBytes);
+    }
+
+#if defined(HAS_LIBURING)
+    isUsingIoUring_ = io_uring_queue_init(static_cast<unsigned>(BUFFER_COUNT), &ring_, 0) == 0;
+#endif
+
+    writerThread_ = std::thread(&AsyncRotatingFileSink::WriterThreadFunction, this);
+}
+
+inline ed::model::AsyncRotatingFileSink::~AsyncRotatingFileSink()
+{
+    {
+        std::lock_guard lock(mutex_);
+        SubmitActiveLocked();
+    }
+    {
+        std::lock_guard lock(queueGuard_);
+        isStopping_ = true;
+    }
+    queueCondition_.notify_one();
+    writerThread_.join();
+
+#if defined(HAS_LIBURING)
+    if (isUsingIoUring_)
+    {
+        io_uring_queue_exit(&ring_);
+    }
+#endif
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+inline void ed::model::AsyncRotatingFileSink::sink_it_(const spdlog::details::log_msg& msg)
+{
+    spdlog::memory_buf_t formatted;
+    formatter_->format(msg, formatted);
+    AppendLocked(formatted.data(), formatted.size());
+}
+
+inline void ed::model::AsyncRotatingFileSink::flush_()
+{
+    SubmitActiveLocked();
+
+    std::unique_lock lock(queueGuard_);
+    const auto submittedBufferCount = submittedBufferCount_;
+    freeCondition_.wait(lock, [this, submittedBufferCount] { return writtenBufferCount_ >= submittedBufferCount; });
+}
+
+inline void ed::model::AsyncRotatingFileSink::AppendLocked(const char* data, size_t size)
+{
+    // Rotation happens between buffers, so keep a record in one buffer unless it is larger than a buffer
+    if (activeBuffer_ != nullptr && size <= bufferSize_ && activeBuffer_->size + size > bufferSize_)
+    {
+        SubmitActiveLocked();
+    }
+
+    while (size > 0)
+    {
+        if (activeBuffer_ == nullptr)
+        {
+            // The writer is behind by BUFFER_COUNT buffers: wait, like spdlog's blocking overflow policy
+            std::unique_lock lock(queueGuard_);
+            freeCondition_.wait(lock, [this] { return !freeBuffers_.empty(); });
+            activeBuffer_ = freeBuffers_.back();
+            freeBuffers_.pop_back();
+            activeBuffer_->size = 0;
+        }
+
+        const auto chunkSize = std::min(size, bufferSize_ - activeBuffer_->size);
+        std::memcpy(activeBuffer_->data + activeBuffer_->size, data, chunkSize);
+        activeBuffer_->size += chunkSize;
+        data += chunkSize;
+        size -= chunkSize;
+
+        if (activeBuffer_->size == bufferSize_)
+        {
+            SubmitActiveLocked();
+        }
+    }
+}
+
+inline void ed::model::AsyncRotatingFileSink::SubmitActiveLocked()
+{
+    if (activeBuffer_ == nullptr || activeBuffer_->size == 0)
+    {
+        return;
+    }
+    {
+        std::lock_guard lock(queueGuard_);
+        filledBuffers_.push_back(activeBuffer_);
+        ++submittedBufferCount_;
+    }
+    activeBuffer_ = nullptr;
+    queueCondition_.notify_one();
+}
+
+inline void ed::model::AsyncRotatingFileSink::WriterThreadFunction()
+{
+    const ed::watchdog::ScopedThreadRegistration watchdogRegistration("log-writer", true);
+    std::vector<Buffer*> batch;
+    for (;;)
+    {
+        {
+            std::unique_lock lock(queueGuard_);
+            queueCondition_.wait(lock, [this] { return isStopping_ || !filledBuffers_.empty(); });
+            if (filledBuffers_.empty())
+            {
+                return; // Stopping and drained
+            }
+            batch.assign(filledBuffers_.begin(), filledBuffers_.end());
+            filledBuffers_.clear();
+        }
+
+        WriteBatch(batch);
+
+        {
+            std::lock_guard lock(queueGuard_);
+            for (auto* buffer : batch)
+            {
+                buffer->size = 0;
+                freeBuffers_.push_back(buffer);
+            }
+            writtenBufferCount_ += batch.size();
+        }
+        freeCondition_.notify_all();
+    }
+}
+
+inline void ed::model::AsyncRotatingFileSink::WriteBatch(const std::vector<Buffer*>& batch)
+{
+    WATCHDOG_SCOPE();
+    // Another sink may have appended to the file since the previous batch
+    if (struct stat fileStat{}; fd_ >= 0 && ::fstat(fd_, &fileStat) == 0)
+    {
+        currentFileSize_ = static_cast<size_t>(fileStat.st_size);
+    }
+
+    // Buffers up to the next rotation point are written with one submission
+    std::vector<Buffer*> segment;
+    size_t segmentSize = 0;
+    for (auto* buffer : batch)
+    {
+        if (currentFileSize_ + segmentSize + buffer->size > maxFileSize_ && currentFileSize_ + segmentSize > 0)
+        {
+            WriteSegment(segment);
+            segment.clear();
+            segmentSize = 0;
+            Rotate();
+        }
+        segment.push_back(buffer);
+        segmentSize += buffer->size;
+    }
+    WriteSegment(segment);
+}
+
+inline void ed::model::AsyncRotatingFileSink::WriteSegment(const std::vector<Buffer*>& segment)
+{
+    if (segment.empty() || fd_ < 0)
+    {
+        return;
+    }
+
+#if defined(HAS_LIBURING)
+    if (isUsingIoUring_)
+    {
+        // The file is opened with O_APPEND, which ignores the offset; linked, the appends keep the buffer order
+        for (auto* buffer : segment)
+        {
+            buffer->writeResult = 0;
+            io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+            io_uring_prep_write(sqe, fd_, buffer->data, static_cast<unsigned>(buffer->size), 0);
+            io_uring_sqe_set_data(sqe, buffer);
+            if (buffer != segment.back())
+            {
+                io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+            }
+        }
+
+        if (const auto submitted = io_uring_submit(&ring_); submitted < 0)
+        {
+            ReportError("io_uring_submit", -submitted);
+            // Nothing reached the kernel: drop the ring with its queued entries and stay on write
+            io_uring_queue_exit(&ring_);
+            isUsingIoUring_ = false;
+        }
+        else if (!ReapCompletions(segment.size()))
+        {
+            io_uring_queue_exit(&ring_);
+            isUsingIoUring_ = false;
+            for (const auto* buffer : segment)
+            {
+                currentFileSize_ += buffer->size;
+            }
+            return;
+        }
+        else
+        {
+            // A failed or short write breaks the link, the entries after it are cancelled: finish them in order
+            for (const auto* buffer : segment)
+            {
+                const auto writtenSize = static_cast<size_t>(std::max(buffer->writeResult, 0));
+                if (buffer->writeResult < 0 && buffer->writeResult != -ECANCELED)
+                {
+                    ReportError("io_uring write", -buffer->writeResult);
+                }
+                WriteSynchronously(buffer->data + writtenSize, buffer->size - writtenSize);
+                currentFileSize_ += buffer->size;
+            }
+            return;
+        }
+    }
+#endif
+
+    for (const auto* buffer : segment)
+    {
+        WriteSynchronously(buffer->data, buffer->size);
+        currentFileSize_ += buffer->size;
+    }
+}
+
+#if defined(HAS_LIBURING)
+inline bool ed::model::AsyncRotatingFileSink::ReapCompletions(size_t count)
+{
+    // Every submitted entry is reaped before its buffer is reused, also when waiting fails
+    constexpr auto MAX_POLL_COUNT = 1000;
+    auto pollCount = 0;
+    while (count > 0)
+    {
+        io_uring_cqe* cqe = nullptr;
+        if (const auto result = pollCount == 0 ? io_uring_wait_cqe(&ring_, &cqe) : io_uring_peek_cqe(&ring_, &cqe);
+            result < 0)
+        {
+            if (result == -EINTR)
+            {
+                continue;
+            }
+            if (pollCount == 0)
+            {
+                ReportError("io_uring_wait_cqe", -result);
+            }
+            if (++pollCount > MAX_POLL_COUNT)
+            {
+                // Give up on the entries that never complete; what they write is not counted
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        static_cast<Buffer*>(io_uring_cqe_get_data(cqe))->writeResult = cqe->res;
+        io_uring_cqe_seen(&ring_, cqe);
+        --count;
+    }
+    return true;
+}
+#endif
+
+inline void ed::model::AsyncRotatingFileSink::WriteSynchronously(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        const auto written = ::write(fd_, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ReportError("write", errno);
+            return;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+inline void ed::model::AsyncRotatingFileSink::Rotate()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    if (compressor_ != nullptr)
+    {
+        RotateForCompression();
+        return;
+    }
+
+    for (auto index = maxFiles_; index > 0; --index)
+    {
+        const auto source = CalcFileName(index - 1);
+        std::error_code errorCode;
+        if (!std::filesystem::exists(source, errorCode))
+        {
+            continue;
+        }
+        const auto target = CalcFileName(index);
+        std::filesystem::remove(target, errorCode);
+        std::filesystem::rename(source, target, errorCode);
+        if (errorCode)
+        {
+            ReportError("rename", errorCode.value());
+        }
+    }
+
+    OpenFile(true);
+}
+
+inline void ed::model::AsyncRotatingFileSink::RotateForCompression()
+{
+    // Skip numbers used before a re-initialization of the logger with the same path
+    std::filesystem::path target;
+    std::error_code errorCode;
+    do
+    {
+        target = CalcFileName(++rotationCount_);
+    }
+    while (std::filesystem::exists(target, errorCode)
+        || std::filesystem::exists(std::filesystem::path(target) += LogCompressor::COMPRESSED_EXTENSION, errorCode));
+
+    std::filesystem::rename(pathName_, target, errorCode);
+    if (errorCode)
+    {
+        ReportError("rename", errorCode.value());
+    }
+    else
+    {
+        compressor_->Enqueue(std::move(target));
+    }
+
+    OpenFile(true);
+}
+
+inline void ed::model::AsyncRotatingFileSink::OpenFile(bool truncate)
+{
+    fd_ = ::open(pathName_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+    if (fd_ < 0)
+    {
+        ReportError("open", errno);
+        currentFileSize_ = 0;
+        return;
+    }
+
+    struct stat fileStat{};
+    currentFileSize_ = ::fstat(fd_, &fileStat) == 0 ? static_cast<size_t>(fileStat.st_size) : 0;
+    isErrorReported_ = false;
+}
+
+inline std::filesystem::path ed::model::AsyncRotatingFileSink::CalcFileName(size_t index) const
+{
+    if (index == 0)
+    {
+        return pathName_;
+    }
+    auto fileName = pathName_.stem();
+    fileName += "." + std::to_string(index);
+    fileName += pathName_.extension();
+    return pathName_.parent_path() / fileName;
+}
+
+inline void ed::model::AsyncRotatingFileSink::ReportError(const char* operation, int errorCode)
+{
+    // Logging from inside the sink could recurse into it; one line on stderr until the next successful open
+    if (!isErrorReported_)
+    {
+        isErrorReported_ = true;
+        std::cerr << "Log file " << pathName_.string() << ": " << operation << " failed: "
+            << std::generic_category().message(errorCode) << std::endl;
+    }
+}
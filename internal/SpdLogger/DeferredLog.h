@@ -0,0 +1,410 @@
+#pragma once
+
+#include "../ClassDefHelper.h"
+#include "../StallWatchdog.h"
+
+#include <spdlog/details/fmt_helper.h>
+#include <spdlog/details/os.h>
+#include <spdlog/pattern_formatter.h>
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace ed::model
+{
+    namespace deferred_detail
+    {
+        template <typename T_>
+        concept Text = std::convertible_to<const T_&, std::string_view>
+            || requires(const T_& text)
+            {
+                { text.data() } -> std::convertible_to<const char*>;
+                { text.size() } -> std::convertible_to<size_t>;
+            };
+
+        template <typename T_>
+        concept Encodable = Text<T_> || std::is_arithmetic_v<T_>;
+
+        // Text arguments come back as views into the slot, numbers as themselves
+        template <typename T_>
+        using Decoded = std::conditional_t<Text<T_>, std::string_view, T_>;
+
+        template <typename T_>
+        std::string_view AsView(const T_& text)
+        {
+            if constexpr (std::convertible_to<const T_&, std::string_view>)
+            {
+                return text;
+            }
+            else
+            {
+                return {text.data(), static_cast<size_t>(text.size())};
+            }
+        }
+
+        template <typename T_>
+        size_t EncodedSize(const T_& value)
+        {
+            if constexpr (Text<T_>)
+            {
+                return sizeof(uint32_t) + AsView(value).size();
+            }
+            else
+            {
+                return sizeof(T_);
+            }
+        }
+
+        template <typename T_>
+        void Encode(std::byte*& cursor, const T_& value)
+        {
+            if constexpr (Text<T_>)
+            {
+                const auto text = AsView(value);
+                const auto size = static_cast<uint32_t>(text.size());
+                std::memcpy(cursor, &size, sizeof(size));
+                std::memcpy(cursor + sizeof(size), text.data(), size);
+                cursor += sizeof(size) + size;
+            }
+            else
+            {
+                std::memcpy(cursor, &value, sizeof(T_));
+                cursor += sizeof(T_);
+            }
+        }
+
+        template <typename T_>
+        Decoded<T_> Decode(const std::byte*& cursor)
+        {
+            if constexpr (Text<T_>)
+            {
+                uint32_t size;
+                std::memcpy(&size, cursor, sizeof(size));
+                const std::string_view text(reinterpret_cast<const char*>(cursor + sizeof(size)), size);
+                cursor += sizeof(size) + size;
+                return text;
+            }
+            else
+            {
+                T_ value;
+                std::memcpy(&value, cursor, sizeof(T_));
+                cursor += sizeof(T_);
+                return value;
+            }
+        }
+    }
+
+    // Pattern flag %*: the thread id of the call site. Unlike %t, it is not the drain thread's id for a deferred
+    // line, which carries the id of its caller in its source location (the log pattern shows no source location).
+    // Contract with DeferredLog::Drain: a deferred line has source.funcname pointing to DEFERRED_LINE_MARKER,
+    // compared by address, not by content, and its caller's thread id in source.line.
+    class CallerThreadIdFlag final : public spdlog::custom_flag_formatter
+    {
+    public:
+        static constexpr char FLAG = '*';
+        // An inline variable: one address in every translation unit
+        static constexpr auto DEFERRED_LINE_MARKER = "deferred";
+
+        void format(const spdlog::details::log_msg& message, const std::tm&, spdlog::memory_buf_t& output) override
+        {
+            spdlog::details::fmt_helper::append_int(
+                message.source.funcname == DEFERRED_LINE_MARKER ? static_cast<size_t>(message.source.line) : message.thread_id,
+                output);
+        }
+
+        [[nodiscard]] std::unique_ptr<custom_flag_formatter> clone() const override
+        {
+            return std::make_unique<CallerThreadIdFlag>();
+        }
+    };
+
+    // Deferred formatting for hot-path log lines: the call site copies the format string pointer and the
+    // raw arguments into a preallocated ring slot, and a drain thread formats them and passes the text with
+    // its original timestamp and thread id (see CallerThreadIdFlag) to the default spdlog logger. Lines that do not fit into a slot, or arrive
+    // while the ring is full or deferral is disabled, are formatted synchronously like a plain spdlog call.
+    // Deferred lines may appear in the log after synchronous lines logged slightly later.
+    // The drain thread sleeps while the ring is empty; only the line that finds it asleep pays for the wake-up.
+    class DeferredLog final
+    {
+    public:
+        static constexpr size_t SLOT_COUNT = 1024; // Power of two
+        static constexpr size_t SLOT_SIZE = 1024;
+
+        DISALLOW_COPY_MOVE(DeferredLog);
+        ~DeferredLog();
+
+        static DeferredLog& Inst();
+
+        // Disabling drains the ring; it is meant for start-up and shutdown
+        void SetEnabled(bool isEnabled);
+        [[nodiscard]] bool IsEnabled() const { return isEnabled_.load(std::memory_order_relaxed); }
+        [[nodiscard]] uint64_t GetSynchronousFallbackCount() const
+        {
+            return synchronousFallbackCount_.load(std::memory_order_relaxed);
+        }
+
+        // The format string must be a literal: only its address is stored
+        template <typename... Args_>
+            requires (deferred_detail::Encodable<std::remove_cvref_t<Args_>> && ...)
+        void Log(spdlog::level::level_enum level, fmt::format_string<Args_...> format, Args_&&... args);
+
+    private:
+        DeferredLog();
+
+        using DecodeFunction = void(fmt::string_view format, const std::byte* payload, spdlog::memory_buf_t& output);
+
+        struct alignas(64) Slot
+        {
+            std::atomic<uint64_t> sequence{0};
+            DecodeFunction* decode = nullptr;
+            fmt::string_view format;
+            spdlog::log_clock::time_point time;
+            size_t threadId = 0;
+            spdlog::level::level_enum level = spdlog::level::off;
+            alignas(8) std::byte payload[SLOT_SIZE];
+        };
+
+        template <typename... Args_>
+        static void DecodeAndFormat(fmt::string_view format, const std::byte* payload, spdlog::memory_buf_t& output);
+
+        Slot* TryAcquireSlot(uint64_t& ticket);
+        void WakeDrainThread();
+        void ThreadFunction();
+        [[nodiscard]] bool HasPendingLine();
+        void Drain();
+
+    private:
+        std::unique_ptr<Slot[]> slots_;
+        alignas(64) std::atomic<uint64_t> nextWriteTicket_{0};
+        alignas(64) std::atomic<uint64_t> synchronousFallbackCount_{0};
+        std::atomic<bool> isEnabled_{false};
+        // Writers between their check of isEnabled_ and the publication of their line
+        alignas(64) std::atomic<uint32_t> activeWriterCount_{0};
+
+        // Drain side
+        std::mutex drainGuard_;
+        uint64_t nextReadTicket_ = 0;
+        spdlog::memory_buf_t formatBuffer_;
+
+        std::mutex threadGuard_;
+        std::atomic<bool> isStopping_{false};
+        // True while the drain thread sleeps or is about to; the writer that clears it wakes the thread
+        alignas(64) std::atomic<bool> isDrainThreadWaiting_{false};
+        std::thread thread_;
+    };
+}
+
+
+inline ed::model::DeferredLog::DeferredLog()
+    : slots_(std::make_unique<Slot[]>(SLOT_COUNT))
+{
+    static_assert(std::has_single_bit(SLOT_COUNT));
+    for (size_t i = 0; i < SLOT_COUNT; ++i)
+    {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+inline ed::model::DeferredLog::~DeferredLog()
+{
+    SetEnabled(false);
+}
+
+inline ed::model::DeferredLog& ed::model::DeferredLog::Inst()
+{
+    static DeferredLog deferredLog;
+    return deferredLog;
+}
+
+inline void ed::model::DeferredLog::SetEnabled(bool isEnabled)
+{
+    std::unique_lock lock(threadGuard_);
+    if (isEnabled == isEnabled_.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    // Sequentially consistent with the writers' count and check: either a writer sees the flag cleared,
+    // or the wait below sees the writer
+    isEnabled_.store(isEnabled);
+
+    if (isEnabled)
+    {
+        isStopping_.store(false);
+        thread_ = std::thread(&DeferredLog::ThreadFunction, this);
+        return;
+    }
+
+    isStopping_.store(true);
+    lock.unlock();
+    isDrainThreadWaiting_.store(false);
+    isDrainThreadWaiting_.notify_one();
+    thread_.join();
+    // Lines of writers that saw the flag just before it was cleared: drained once all of them are published
+    while (activeWriterCount_.load(std::memory_order_acquire) != 0)
+    {
+        std::this_thread::yield();
+    }
+    Drain();
+}
+
+template <typename... Args_>
+    requires (ed::model::deferred_detail::Encodable<std::remove_cvref_t<Args_>> && ...)
+void ed::model::DeferredLog::Log(spdlog::level::level_enum level, fmt::format_string<Args_...> format,
+                                 Args_&&... args)
+{
+    if (!spdlog::should_log(level))
+    {
+        return;
+    }
+
+    if (isEnabled_.load(std::memory_order_relaxed))
+    {
+        // Counted before the flag is checked again, so that SetEnabled(false) waits for the line to be published
+        activeWriterCount_.fetch_add(1);
+        if (isEnabled_.load())
+        {
+            const size_t payloadSize = (size_t{0} + ... + deferred_detail::EncodedSize(args));
+            uint64_t ticket;
+            if (Slot* slot = payloadSize <= SLOT_SIZE ? TryAcquireSlot(ticket) : nullptr; slot != nullptr)
+            {
+                slot->decode = &DecodeAndFormat<std::remove_cvref_t<Args_>...>;
+                slot->format = static_cast<fmt::string_view>(format);
+                slot->time = spdlog::log_clock::now();
+                slot->threadId = spdlog::details::os::thread_id();
+                slot->level = level;
+                auto* cursor = slot->payload;
+                (deferred_detail::Encode(cursor, args), ...);
+                slot->sequence.store(ticket + 1, std::memory_order_release);
+                WakeDrainThread();
+                activeWriterCount_.fetch_sub(1, std::memory_order_release);
+                return;
+            }
+            synchronousFallbackCount_.fetch_add(1, std::memory_order_relaxed);
+        }
+        activeWriterCount_.fetch_sub(1, std::memory_order_release);
+    }
+
+    spdlog::log(level, format, std::forward<Args_>(args)...);
+}
+
+template <typename... Args_>
+void ed::model::DeferredLog::DecodeAndFormat(fmt::string_view format, const std::byte* payload,
+                                             spdlog::memory_buf_t& output)
+{
+    // Braced initialization decodes the arguments left to right
+    std::tuple<deferred_detail::Decoded<Args_>...> values{deferred_detail::Decode<Args_>(payload)...};
+    std::apply([&output, format](auto&... value)
+    {
+        fmt::vformat_to(std::back_inserter(output), format, fmt::make_format_args(value...));
+    }, values);
+}
+
+inline ed::model::DeferredLog::Slot* ed::model::DeferredLog::TryAcquireSlot(uint64_t& ticket)
+{
+    // Bounded multi-producer queue: a slot is free for ticket t when its sequence is t
+    ticket = nextWriteTicket_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        auto& slot = slots_[ticket & (SLOT_COUNT - 1)];
+        const auto sequence = slot.sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<int64_t>(sequence - ticket);
+        if (difference == 0)
+        {
+            if (nextWriteTicket_.compare_exchange_weak(ticket, ticket + 1, std::memory_order_relaxed))
+            {
+                return &slot;
+            }
+        }
+        else if (difference < 0)
+        {
+            return nullptr; // Full
+        }
+        else
+        {
+            ticket = nextWriteTicket_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+inline void ed::model::DeferredLog::WakeDrainThread()
+{
+    // Pairs with the fence in ThreadFunction: either the drain thread sees the line, or this sees it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (isDrainThreadWaiting_.load(std::memory_order_relaxed) && isDrainThreadWaiting_.exchange(false))
+    {
+        isDrainThreadWaiting_.notify_one();
+    }
+}
+
+inline void ed::model::DeferredLog::ThreadFunction()
+{
+    const ed::watchdog::ScopedThreadRegistration watchdogRegistration("log-deferred-drain", true);
+    while (!isStopping_.load())
+    {
+        Drain();
+
+        isDrainThreadWaiting_.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!HasPendingLine() && !isStopping_.load())
+        {
+            isDrainThreadWaiting_.wait(true);
+        }
+        isDrainThreadWaiting_.store(false);
+    }
+}
+
+inline bool ed::model::DeferredLog::HasPendingLine()
+{
+    std::lock_guard lock(drainGuard_);
+    return slots_[nextReadTicket_ & (SLOT_COUNT - 1)].sequence.load(std::memory_order_acquire) == nextReadTicket_ + 1;
+}
+
+inline void ed::model::DeferredLog::Drain()
+{
+    WATCHDOG_SCOPE();
+    std::lock_guard lock(drainGuard_);
+    const auto logger = spdlog::default_logger();
+    for (;;)
+    {
+        auto& slot = slots_[nextReadTicket_ & (SLOT_COUNT - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != nextReadTicket_ + 1)
+        {
+            return;
+        }
+
+        if (logger != nullptr)
+        {
+            formatBuffer_.clear();
+            try
+            {
+                slot.decode(slot.format, slot.payload, formatBuffer_);
+                // Marked for CallerThreadIdFlag: the marker's address as the function name, the caller's id as the line
+                logger->log(slot.time,
+                            spdlog::source_loc{"", static_cast<int>(slot.threadId), CallerThreadIdFlag::DEFERRED_LINE_MARKER},
+                            slot.level, spdlog::string_view_t(formatBuffer_.data(), formatBuffer_.size()));
+            }
+            catch (const std::exception& ex)
+            {
+                logger->log(slot.time, spdlog::source_loc{}, spdlog::level::err,
+                            fmt::format("Deferred log line \"{}\" cannot be formatted: {}",
+                                        std::string_view(slot.format.data(), slot.format.size()), ex.what()));
+            }
+        }
+
+        slot.sequence.store(nextReadTicket_ + SLOT_COUNT, std::memory_order_release);
+        ++nextReadTicket_;
+    }
+}
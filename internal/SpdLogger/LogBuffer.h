@@ -1,18 +1,36 @@
 ﻿#pragma once
 
-#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <mutex>
-#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+#include <fmt/format.h>
 #include <spdlog/sinks/sink.h>
 
 namespace ed::model
 {
+    // Bounded buffer of log lines: a lock-free multi-producer ring of preallocated slots,
+    // drained by GetAndClearNextQueueChunk. When the reader falls behind, the oldest lines are
+    // overwritten and counted as dropped; a marker line reports them in the next chunk.
     class LogBuffer final : public spdlog::sinks::sink
     {
     public:
-        LogBuffer() = default;
+        static constexpr size_t DEFAULT_CAPACITY = 2048; // Lines, rounded up to a power of two
+        static constexpr size_t DEFAULT_MAX_LINE_LENGTH = 1024; // Longer lines are truncated
+
+        explicit LogBuffer(size_t capacity = DEFAULT_CAPACITY, size_t maxLineLength = DEFAULT_MAX_LINE_LENGTH);
+
+        // Single consumer; concurrent callers are serialized, writers are never blocked
         std::vector<std::string> GetAndClearNextQueueChunk();
+        [[nodiscard]] uint64_t GetDroppedLineCount() const { return droppedLineCount_.load(std::memory_order_relaxed); }
 
         void log(const spdlog::details::log_msg& msg) override;
 
@@ -29,38 +47,154 @@ namespace ed::model
         }
 
     protected:
-        void Put(const std::string& val);
+        void Put(std::string_view val);
+
     private:
-        std::vector<std::string> m_queue;
-        mutable std::recursive_mutex m_queueGuard;
+        using Word = std::atomic<uint64_t>;
+
+        // Sequence 2 * ticket + 1 while the line of that ticket is written, 2 * ticket + 2 once published.
+        // The text is copied in relaxed atomic words, so a reader racing a writer is detected, not undefined.
+        struct alignas(64) Slot
+        {
+            std::atomic<uint64_t> sequence{0};
+            std::atomic<uint32_t> length{0};
+            Word* text = nullptr;
+        };
+
+    private:
+        size_t capacityMask_;
+        size_t maxLineLength_;
+        std::unique_ptr<Word[]> textStorage_;
+        std::unique_ptr<Slot[]> slots_;
+
+        alignas(64) std::atomic<uint64_t> nextWriteTicket_{0};
+        alignas(64) std::atomic<uint64_t> droppedLineCount_{0};
+
+        std::mutex readGuard_;
+        uint64_t nextReadTicket_ = 0;
+        uint64_t reportedDroppedLineCount_ = 0;
     };
 }
 
 
+inline ed::model::LogBuffer::LogBuffer(size_t capacity, size_t maxLineLength)
+    : capacityMask_(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1)
+    , maxLineLength_((std::max<size_t>(maxLineLength, 1) + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t))
+    , textStorage_(std::make_unique<Word[]>((capacityMask_ + 1) * (maxLineLength_ / sizeof(uint64_t))))
+    , slots_(std::make_unique<Slot[]>(capacityMask_ + 1))
+{
+    for (size_t i = 0; i <= capacityMask_; ++i)
+    {
+        slots_[i].text = textStorage_.get() + i * (maxLineLength_ / sizeof(uint64_t));
+    }
+}
+
 inline std::vector<std::string> ed::model::LogBuffer::GetAndClearNextQueueChunk()
 {
     std::vector<std::string> result;
 
-    std::lock_guard lock(m_queueGuard);
+    std::lock_guard lock(readGuard_);
+
+    const auto capacity = capacityMask_ + 1;
+    const auto writeTicket = nextWriteTicket_.load(std::memory_order_acquire);
+    if (writeTicket - nextReadTicket_ > capacity)
+    {
+        droppedLineCount_.fetch_add(writeTicket - capacity - nextReadTicket_, std::memory_order_relaxed);
+        nextReadTicket_ = writeTicket - capacity;
+    }
+
+    result.reserve(writeTicket - nextReadTicket_ + 1);
+    for (; nextReadTicket_ < writeTicket; ++nextReadTicket_)
+    {
+        auto& slot = slots_[nextReadTicket_ & capacityMask_];
+        const auto publishedSequence = 2 * nextReadTicket_ + 2;
 
-    result.swap(m_queue);
+        const auto sequenceBefore = slot.sequence.load(std::memory_order_acquire);
+        if (sequenceBefore < publishedSequence)
+        {
+            break; // Still being written; picked up by the next call
+        }
+        if (sequenceBefore > publishedSequence)
+        {
+            droppedLineCount_.fetch_add(1, std::memory_order_relaxed); // Overwritten by a newer line
+            continue;
+        }
+
+        const auto length = std::min<size_t>(slot.length.load(std::memory_order_relaxed), maxLineLength_);
+        std::string line(length, '\0');
+        for (size_t offset = 0; offset < length; offset += sizeof(uint64_t))
+        {
+            const auto word = slot.text[offset / sizeof(uint64_t)].load(std::memory_order_relaxed);
+            std::memcpy(line.data() + offset, &word, std::min(sizeof(uint64_t), length - offset));
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequenceBefore)
+        {
+            droppedLineCount_.fetch_add(1, std::memory_order_relaxed); // Overwritten while being copied
+            continue;
+        }
+        result.push_back(std::move(line));
+    }
+
+    if (const auto droppedLineCount = droppedLineCount_.load(std::memory_order_relaxed);
+        droppedLineCount != reportedDroppedLineCount_)
+    {
+        result.push_back(fmt::format("[{} log line(s) dropped]", droppedLineCount - reportedDroppedLineCount_));
+        reportedDroppedLineCount_ = droppedLineCount;
+    }
     return result;
 }
 
 inline void ed::model::LogBuffer::log(const spdlog::details::log_msg& msg)
 {
-    const std::string text(msg.payload.begin(), msg.payload.end());
-    std::stringstream ss(text);
-    std::string line;
-    while (std::getline(ss, line))
+    const char* cursor = msg.payload.data();
+    const char* const end = cursor + msg.payload.size();
+    while (cursor != end)
     {
-        Put(line);
+        const auto* newLine = static_cast<const char*>(std::memchr(cursor, '\n', static_cast<size_t>(end - cursor)));
+        const char* lineEnd = newLine != nullptr ? newLine : end;
+        Put(std::string_view(cursor, static_cast<size_t>(lineEnd - cursor)));
+        cursor = newLine != nullptr ? newLine + 1 : end;
     }
 }
 
-inline void ed::model::LogBuffer::Put(const std::string& val)
+inline void ed::model::LogBuffer::Put(std::string_view val)
 {
-    std::lock_guard<std::recursive_mutex> lock(m_queueGuard);
-    m_queue.push_back(val);
-}
+    const auto ticket = nextWriteTicket_.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = slots_[ticket & capacityMask_];
+    const auto writingSequence = 2 * ticket + 1;
+
+    // Claim the slot; a writer of an older lap may still be copying, a newer one supersedes this line
+    auto sequence = slot.sequence.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        if (sequence >= writingSequence)
+        {
+            return; // Counted as dropped by the reader
+        }
+        if ((sequence & 1) != 0)
+        {
+            std::this_thread::yield();
+            sequence = slot.sequence.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (slot.sequence.compare_exchange_weak(sequence, writingSequence, std::memory_order_acquire,
+                                                std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const auto length = std::min(val.size(), maxLineLength_);
+    for (size_t offset = 0; offset < length; offset += sizeof(uint64_t))
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, val.data() + offset, std::min(sizeof(uint64_t), length - offset));
+        slot.text[offset / sizeof(uint64_t)].store(word, std::memory_order_relaxed);
+    }
+    slot.length.store(static_cast<uint32_t>(length), std::memory_order_relaxed);
 
+    slot.sequence.store(writingSequence + 1, std::memory_order_release);
+}
@@ -0,0 +1,328 @@
+#pragma once
+
+#include "../ClassDefHelper.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+namespace ed::model
+{
+    // Gzips rotated log files on a SCHED_IDLE thread (nice 19 if that is refused) and keeps the
+    // compressed files within a byte budget, deleting the oldest ones first.
+    // The budget covers the archives of earlier runs too: at start the thread adopts the <stem>.<n><ext>.gz files
+    // next to the log file and queues the rotated files a previous run left uncompressed.
+    class LogCompressor final
+    {
+    public:
+        static constexpr auto COMPRESSED_EXTENSION = ".gz";
+        static constexpr auto TEMPORARY_EXTENSION = ".tmp";
+        static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+        LogCompressor(std::filesystem::path logFile, uint64_t maxCompressedBytes);
+        // Does not wait for the queued files: the file being compressed is abandoned (its original kept),
+        // the rest stay uncompressed on disk and are compressed by the next run
+        ~LogCompressor();
+
+        DISALLOW_COPY_MOVE(LogCompressor);
+
+        // The file is handed over: it is replaced by <file>.gz and deleted
+        void Enqueue(std::filesystem::path rotatedFile);
+
+    private:
+        void ThreadFunction();
+        // Adopts the archives and queues the rotated files of earlier runs, oldest first
+        void ScanEarlierRuns();
+        // <stem>.<n><ext>: the rotated file name, see AsyncRotatingFileSink::CalcFileName
+        [[nodiscard]] bool IsRotatedFileName(const std::string& fileName) const;
+        // Returns the size of the compressed file, 0 on failure or if stopping (the original is kept then)
+        uint64_t Compress(const std::filesystem::path& source, const std::filesystem::path& target);
+        void ApplyBudget();
+        static void LowerOwnPriority();
+        void ReportError(const std::filesystem::path& file, const char* operation);
+
+    private:
+        std::filesystem::path logFile_;
+        uint64_t maxCompressedBytes_;
+
+        std::mutex queueGuard_;
+        std::condition_variable queueCondition_;
+        std::deque<std::filesystem::path> pendingFiles_;
+        // Set under queueGuard_, also polled between the chunks of a compression
+        std::atomic<bool> isStopping_{false};
+
+        // Used by the compressor thread only, oldest first
+        std::deque<std::pair<std::filesystem::path, uint64_t>> compressedFiles_;
+        uint64_t compressedBytes_ = 0;
+        bool isErrorReported_ = false;
+
+        std::thread thread_;
+    };
+}
+
+
+inline ed::model::LogCompressor::LogCompressor(std::filesystem::path logFile, uint64_t maxCompressedBytes)
+    : logFile_(std::move(logFile))
+    , maxCompressedBytes_(maxCompressedBytes)
+    , thread_(&LogCompressor::ThreadFunction, this)
+{
+}
+
+inline ed::model::LogCompressor::~LogCompressor()
+{
+    {
+        std::lock_guard lock(queueGuard_);
+        isStopping_ = true;
+    }
+    queueCondition_.notify_one();
+    thread_.join();
+}
+
+inline void ed::model::LogCompressor::Enqueue(std::filesystem::path rotatedFile)
+{
+    {
+        std::lock_guard lock(queueGuard_);
+        pendingFiles_.push_back(std::move(rotatedFile));
+    }
+    queueCondition_.notify_one();
+}
+
+inline void ed::model::LogCompressor::ThreadFunction()
+{
+    LowerOwnPriority();
+    ScanEarlierRuns();
+
+    for (;;)
+    {
+        std::filesystem::path source;
+        {
+            std::unique_lock lock(queueGuard_);
+            queueCondition_.wait(lock, [this] { return isStopping_ || !pendingFiles_.empty(); });
+            if (isStopping_)
+            {
+                return; // The queued files are left for the next run
+            }
+            source = std::move(pendingFiles_.front());
+            pendingFiles_.pop_front();
+        }
+
+        auto target = source;
+        target += COMPRESSED_EXTENSION;
+        if (const auto compressedSize = Compress(source, target); compressedSize > 0)
+        {
+            compressedFiles_.emplace_back(std::move(target), compressedSize);
+            compressedBytes_ += compressedSize;
+            ApplyBudget();
+        }
+    }
+}
+
+inline void ed::model::LogCompressor::ScanEarlierRuns()
+{
+    struct FoundFile
+    {
+        std::filesystem::path path;
+        std::filesystem::file_time_type lastWriteTime;
+        uint64_t size;
+    };
+    std::vector<FoundFile> archives;
+    std::vector<FoundFile> rotatedFiles;
+
+    auto directory = logFile_.parent_path();
+    if (directory.empty())
+    {
+        directory = ".";
+    }
+    std::error_code errorCode;
+    for (std::filesystem::directory_iterator it(directory, errorCode), end; !errorCode && it != end; it.increment(errorCode))
+    {
+        const auto& path = it->path();
+        if (!it->is_regular_file(errorCode))
+        {
+            continue;
+        }
+        auto fileName = path.filename().string();
+        if (fileName.ends_with(TEMPORARY_EXTENSION))
+        {
+            // A compression interrupted by a crash or a shutdown; its original is still there
+            fileName.resize(fileName.size() - std::char_traits<char>::length(TEMPORARY_EXTENSION));
+            if (fileName.ends_with(COMPRESSED_EXTENSION))
+            {
+                std::error_code removeErrorCode;
+                std::filesystem::remove(path, removeErrorCode);
+            }
+            continue;
+        }
+        const bool isArchive = fileName.ends_with(COMPRESSED_EXTENSION);
+        if (isArchive)
+        {
+            fileName.resize(fileName.size() - std::char_traits<char>::length(COMPRESSED_EXTENSION));
+        }
+        if (!IsRotatedFileName(fileName))
+        {
+            continue;
+        }
+
+        // A file whose time or size can not be read is left alone
+        std::error_code fileErrorCode;
+        const auto lastWriteTime = it->last_write_time(fileErrorCode);
+        const auto size = fileErrorCode ? 0 : it->file_size(fileErrorCode);
+        if (!fileErrorCode)
+        {
+            (isArchive ? archives : rotatedFiles).push_back({path, lastWriteTime, size});
+        }
+    }
+
+    const auto isOlder = [](const FoundFile& left, const FoundFile& right)
+    {
+        return left.lastWriteTime < right.lastWriteTime;
+    };
+    std::ranges::sort(archives, isOlder);
+    std::ranges::sort(rotatedFiles, isOlder);
+    for (auto& archive : archives)
+    {
+        compressedBytes_ += archive.size;
+        compressedFiles_.emplace_back(std::move(archive.path), archive.size);
+    }
+    ApplyBudget();
+
+    if (!rotatedFiles.empty())
+    {
+        std::lock_guard lock(queueGuard_);
+        for (auto it = rotatedFiles.rbegin(); it != rotatedFiles.rend(); ++it)
+        {
+            // Unless the sink rotated it since the start
+            if (std::ranges::none_of(pendingFiles_, [&it](const std::filesystem::path& pendingFile)
+                {
+                    return pendingFile.filename() == it->path.filename();
+                }))
+            {
+                pendingFiles_.push_front(std::move(it->path));
+            }
+        }
+    }
+}
+
+inline bool ed::model::LogCompressor::IsRotatedFileName(const std::string& fileName) const
+{
+    const auto prefix = logFile_.stem().string() + ".";
+    const auto suffix = logFile_.extension().string();
+    if (fileName.size() <= prefix.size() + suffix.size() || !fileName.starts_with(prefix) || !fileName.ends_with(suffix))
+    {
+        return false;
+    }
+    const auto index = std::string_view(fileName).substr(prefix.size(), fileName.size() - prefix.size() - suffix.size());
+    return std::ranges::all_of(index, [](char c) { return c >= '0' && c <= '9'; });
+}
+
+inline uint64_t ed::model::LogCompressor::Compress(const std::filesystem::path& source,
+                                                   const std::filesystem::path& target)
+{
+    std::ifstream input(source, std::ios::binary);
+    if (!input)
+    {
+        ReportError(source, "open");
+        return 0;
+    }
+
+    // Written under a temporary name, so a crash never leaves a truncated .gz next to a deleted original
+    auto temporary = target;
+    temporary += TEMPORARY_EXTENSION;
+    gzFile output = gzopen(temporary.c_str(), "wb6");
+    if (output == nullptr)
+    {
+        ReportError(temporary, "gzopen");
+        return 0;
+    }
+
+    std::vector<char> chunk(CHUNK_SIZE);
+    bool isOk = true;
+    while (isOk && input)
+    {
+        if (isStopping_.load(std::memory_order_relaxed))
+        {
+            gzclose(output);
+            std::error_code errorCode;
+            std::filesystem::remove(temporary, errorCode);
+            return 0;
+        }
+        input.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        if (const auto readSize = input.gcount(); readSize > 0)
+        {
+            isOk = gzwrite(output, chunk.data(), static_cast<unsigned>(readSize)) == static_cast<int>(readSize);
+        }
+    }
+    isOk = gzclose(output) == Z_OK && isOk && input.eof();
+
+    std::error_code errorCode;
+    if (!isOk)
+    {
+        ReportError(source, "compress");
+        std::filesystem::remove(temporary, errorCode);
+        return 0;
+    }
+
+    std::filesystem::rename(temporary, target, errorCode);
+    if (errorCode)
+    {
+        ReportError(target, "rename");
+        std::filesystem::remove(temporary, errorCode);
+        return 0;
+    }
+    std::filesystem::remove(source, errorCode);
+
+    const auto compressedSize = std::filesystem::file_size(target, errorCode);
+    isErrorReported_ = false;
+    return errorCode ? 0 : compressedSize;
+}
+
+inline void ed::model::LogCompressor::ApplyBudget()
+{
+    // The newest compressed file is always kept, even if it alone exceeds the budget
+    while (maxCompressedBytes_ > 0 && compressedBytes_ > maxCompressedBytes_ && compressedFiles_.size() > 1)
+    {
+        std::error_code errorCode;
+        std::filesystem::remove(compressedFiles_.front().first, errorCode);
+        compressedBytes_ -= compressedFiles_.front().second;
+        compressedFiles_.pop_front();
+    }
+}
+
+inline void ed::model::LogCompressor::LowerOwnPriority()
+{
+    // Compression must not compete with the logging and PulseAudio threads
+    if (constexpr sched_param schedParam{}; pthread_setschedparam(pthread_self(), SCHED_IDLE, &schedParam) != 0)
+    {
+        // Linux applies the nice value to the calling thread only
+        setpriority(PRIO_PROCESS, static_cast<id_t>(::gettid()), 19);
+    }
+}
+
+inline void ed::model::LogCompressor::ReportError(const std::filesystem::path& file, const char* operation)
+{
+    // Logging from here could recurse into the file sink; one line on stderr until the next success
+    if (!isErrorReported_)
+    {
+        isErrorReported_ = true;
+        std::cerr << "Log file compression " << file.string() << ": " << operation << " failed." << std::endl;
+    }
+}
@@ -1,19 +1,23 @@
 ﻿#pragma once
 
 #include <spdlog/spdlog.h>
+#include <chrono>
+#include <mutex>
 #include <filesystem>
 
 #include "../ClassDefHelper.h"
+#include "../StallWatchdog.h"
 #include "../TimeUtil.h"
 
 
 #include <string>
 
+#include "AsyncRotatingFileSink.h"
+#include "DeferredLog.h"
 #include "LogBuffer.h"
 
 #include <spdlog/sinks/dist_sink.h>
 #include <spdlog/async_logger.h>
-#include <spdlog/sinks/rotating_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <utility>
 #include <spdlog/pattern_formatter.h>
@@ -64,9 +68,33 @@ namespace ed::model
         void SetLogBuffer(std::shared_ptr<LogBuffer> logBuffer);
         [[nodiscard]] bool IsLogBufferSet() const { return spLogBuffer_ != nullptr; }
 
+        // Applied immediately, no re-initialization
+        Logger& SetLevel(spdlog::level::level_enum level);
+        [[nodiscard]] spdlog::level::level_enum GetLevel() const { return level_; }
+
+        // Messages at flushLevel or above are flushed at once, the rest every flushInterval (0: never periodically)
+        Logger& SetFlushPolicy(spdlog::level::level_enum flushLevel, std::chrono::seconds flushInterval);
+        [[nodiscard]] spdlog::level::level_enum GetFlushLevel() const { return flushLevel_; }
+        [[nodiscard]] std::chrono::seconds GetFlushInterval() const { return flushInterval_; }
+
+        // Rotated files are gzipped in the background and limited to maxCompressedBytes instead of
+        // maxFiles, unless maxCompressedBytes is 0
+        Logger& SetRotationPolicy(size_t maxFileSize, size_t maxFiles, uint64_t maxCompressedBytes);
+        [[nodiscard]] size_t GetMaxFileSize() const { return maxFileSize_; }
+        [[nodiscard]] size_t GetMaxFiles() const { return maxFiles_; }
+        [[nodiscard]] uint64_t GetMaxCompressedBytes() const { return maxCompressedBytes_; }
+
+        // Messages lost by the asynchronous queue or the log buffer; monotonic across re-initializations.
+        // Thread-safe, e.g. for the metrics endpoint
+        [[nodiscard]] uint64_t GetDroppedMessageCount() const;
+
         void Free();
     private:
         void Reinit();
+        void ApplyLevelAndFlushPolicy() const;
+        // Keeps the count of a replaced thread pool or log buffer; under droppedCountGuard_
+        void RetireDroppedCountLocked(const std::shared_ptr<spdlog::details::thread_pool>& threadPool,
+                                      const std::shared_ptr<LogBuffer>& logBuffer);
     private:
         std::shared_ptr<LogBuffer> spLogBuffer_;
         std::filesystem::path pathName_;
@@ -76,6 +104,16 @@ namespace ed::model
         std::string appName_;
         std::string appVersion_;
         TMessageCallback* messageCallback_;
+        spdlog::level::level_enum level_ = spdlog::level::info;
+        spdlog::level::level_enum flushLevel_ = spdlog::level::warn;
+        std::chrono::seconds flushInterval_{3};
+        size_t maxFileSize_ = 1024 * 1024;
+        size_t maxFiles_ = 10;
+        uint64_t maxCompressedBytes_ = 0;
+
+        // Guards the thread pool and log buffer pointers against GetDroppedMessageCount on other threads
+        mutable std::mutex droppedCountGuard_;
+        uint64_t retiredDroppedMessageCount_ = 0;
     };
 
     class CallbackSink final : public spdlog::sinks::sink
@@ -102,6 +140,23 @@ namespace ed::model
         std::unique_ptr<spdlog::formatter> formatter_;
     };
 
+    // Marks the sink calls of the async pool workers for the stall watchdog; spdlog owns their loop
+    class MonitoredDistSink final : public spdlog::sinks::dist_sink_st
+    {
+    protected:
+        void sink_it_(const spdlog::details::log_msg& msg) override
+        {
+            WATCHDOG_SCOPE();
+            spdlog::sinks::dist_sink_st::sink_it_(msg);
+        }
+
+        void flush_() override
+        {
+            WATCHDOG_SCOPE();
+            spdlog::sinks::dist_sink_st::flush_();
+        }
+    };
+
 
 }
 
@@ -182,10 +237,57 @@ inline ed::model::Logger& ed::model::Logger::SetMessageCallback(TMessageCallback
 
 inline void ed::model::Logger::SetLogBuffer(std::shared_ptr<LogBuffer> logBuffer)
 {
-    spLogBuffer_ = std::move(logBuffer);
+    {
+        std::lock_guard lock(droppedCountGuard_);
+        if (logBuffer != spLogBuffer_)
+        {
+            RetireDroppedCountLocked(nullptr, spLogBuffer_);
+            spLogBuffer_ = std::move(logBuffer);
+        }
+    }
     Reinit();
 }
 
+inline ed::model::Logger& ed::model::Logger::SetLevel(spdlog::level::level_enum level)
+{
+    level_ = level;
+    ApplyLevelAndFlushPolicy();
+    return *this;
+}
+
+inline ed::model::Logger& ed::model::Logger::SetFlushPolicy(spdlog::level::level_enum flushLevel,
+    std::chrono::seconds flushInterval)
+{
+    flushLevel_ = flushLevel;
+    flushInterval_ = flushInterval;
+    ApplyLevelAndFlushPolicy();
+    return *this;
+}
+
+inline void ed::model::Logger::ApplyLevelAndFlushPolicy() const
+{
+    spdlog::set_level(level_);
+    spdlog::flush_on(flushLevel_);
+    // Replaces a previously started periodic flusher, which joins its thread; with 0 the new one never starts
+    spdlog::flush_every(flushInterval_);
+}
+
+inline ed::model::Logger& ed::model::Logger::SetRotationPolicy(size_t maxFileSize, size_t maxFiles,
+    uint64_t maxCompressedBytes)
+{
+    if (maxFileSize_ != maxFileSize || maxFiles_ != maxFiles || maxCompressedBytes_ != maxCompressedBytes)
+    {
+        maxFileSize_ = maxFileSize;
+        maxFiles_ = maxFiles;
+        maxCompressedBytes_ = maxCompressedBytes;
+        if (!pathName_.empty())
+        {
+            Reinit();
+        }
+    }
+    return *this;
+}
+
 inline ed::model::Logger& ed::model::Logger::SetOutputToConsole(bool isOutputToConsole)
 {
     if (isOutputToConsole_ != isOutputToConsole)
@@ -202,14 +304,18 @@ inline void ed::model::Logger::Reinit()
     auto finalMessage = std::string();
     spdlog::shutdown();
 
-    auto distributedSink = std::make_shared<spdlog::sinks::dist_sink_st>();
+    auto distributedSink = std::make_shared<MonitoredDistSink>();
     if (!pathName_.empty())
     {
-        const auto rotatingFileSink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
-            pathName_.string(), 1024 * 1024, 10);
+        const auto rotatingFileSink = std::make_shared<AsyncRotatingFileSink>(
+            pathName_, maxFileSize_, maxFiles_, maxCompressedBytes_);
         distributedSink->add_sink(rotatingFileSink);
         finalMessage += "Output to file ";
         finalMessage += pathName_.string();
+        finalMessage += rotatingFileSink->IsUsingIoUring() ? " (io_uring" : " (write";
+        finalMessage += rotatingFileSink->IsCompressing()
+            ? fmt::format(", rotated files gzipped up to {} bytes)", maxCompressedBytes_)
+            : fmt::format(", {} rotated files)", maxFiles_);
     }
     else
     {
@@ -252,8 +358,16 @@ inline void ed::model::Logger::Reinit()
         finalMessage += " disabled";
     }
 
-    threadPoolSmartPtr_ = std::make_shared<
-        spdlog::details::thread_pool>(65536, 2);
+    // The replaced pool joins its workers when released, outside the lock
+    auto threadPool = std::make_shared<spdlog::details::thread_pool>(65536, 2,
+        [] { ed::watchdog::RegisterCurrentThread("log-async-worker", true); },
+        [] { ed::watchdog::UnregisterCurrentThread(); });
+    {
+        std::lock_guard lock(droppedCountGuard_);
+        RetireDroppedCountLocked(threadPoolSmartPtr_, nullptr);
+        threadPoolSmartPtr_.swap(threadPool);
+    }
+    threadPool.reset();
 
     // Create an async_logger using that custom thread pool
     const auto spdLogger = std::make_shared<spdlog::async_logger>(
@@ -266,10 +380,30 @@ inline void ed::model::Logger::Reinit()
     spdlog::register_logger(spdLogger);
     spdlog::set_default_logger(spdLogger);
 
-    spdlog::set_pattern(std::string("%Y-%m-%d") + delimiterBetweenDateAndTime_ + "%H:%M:%S.%f%z %L [%t] %v");
-    spdlog::set_level(spdlog::level::debug);
-    spdlog::flush_on(spdlog::level::debug);
-    spdlog::info("Log for {} (version {}) was reinitiated: {}", appName_, appVersion_, finalMessage);
+    // %* instead of %t: a deferred line shows the thread that logged it, not the drain thread
+    auto formatter = std::make_unique<spdlog::pattern_formatter>();
+    formatter->add_flag<CallerThreadIdFlag>(CallerThreadIdFlag::FLAG)
+        .set_pattern(std::string("%Y-%m-%d") + delimiterBetweenDateAndTime_ + "%H:%M:%S.%f%z %L [%*] %v");
+    spdlog::set_formatter(std::move(formatter));
+    ApplyLevelAndFlushPolicy();
+    spdlog::info("Log for {} (version {}) was reinitiated: {}, level {}, flush on {} and every {} s",
+        appName_, appVersion_, finalMessage, spdlog::level::to_string_view(level_),
+        spdlog::level::to_string_view(flushLevel_), flushInterval_.count());
+}
+
+inline uint64_t ed::model::Logger::GetDroppedMessageCount() const
+{
+    std::lock_guard lock(droppedCountGuard_);
+    return retiredDroppedMessageCount_
+        + (threadPoolSmartPtr_ != nullptr ? threadPoolSmartPtr_->overrun_counter() : 0)
+        + (spLogBuffer_ != nullptr ? spLogBuffer_->GetDroppedLineCount() : 0);
+}
+
+inline void ed::model::Logger::RetireDroppedCountLocked(
+    const std::shared_ptr<spdlog::details::thread_pool>& threadPool, const std::shared_ptr<LogBuffer>& logBuffer)
+{
+    retiredDroppedMessageCount_ += (threadPool != nullptr ? threadPool->overrun_counter() : 0)
+        + (logBuffer != nullptr ? logBuffer->GetDroppedLineCount() : 0);
 }
 
 inline void ed::model::Logger::Free()
@@ -278,8 +412,11 @@ inline void ed::model::Logger::Free()
     {
         return;
     }
+    DeferredLog::Inst().SetEnabled(false); // Formats the pending deferred lines
     spdlog::info("Log for {} (version {}) is being freed.", appName_, appVersion_);
     spdlog::shutdown();
+    std::lock_guard lock(droppedCountGuard_);
+    RetireDroppedCountLocked(threadPoolSmartPtr_, nullptr);
     threadPoolSmartPtr_.reset(); // Explicitly reset the thread pool to free resources
 }
 
@@ -299,7 +436,9 @@ inline void ed::model::CallbackSink::log(const spdlog::details::log_msg& msg)
             formatter_->format(msg, formatted);
         }
 
-        const auto timestamp = TimePointToStringAsLocal(msg.time, false, false);
+        char timestampBuffer[CachedTimestampFormatter::MAX_LENGTH];
+        const std::string timestamp(timestampBuffer,
+            ThreadLocalTimestampFormatter(false, false, false).Format(msg.time, timestampBuffer));
         const auto levelStringView = spdlog::level::to_string_view(msg.level);
         const std::string levelString(levelStringView.data(), levelStringView.size());
         auto messageString = fmt::to_string(formatted);
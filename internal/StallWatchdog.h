@@ -0,0 +1,320 @@
+#pragma once
+
+#include "ClassDefHelper.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+// Detects threads stuck in one piece of work. A monitored thread registers itself and marks what it is doing
+// with WATCHDOG_SCOPE(); waiting for work is outside any scope, so an idle thread is never reported.
+// The watchdog thread reports a scope that runs longer than the stall threshold, once, with the scope's name.
+namespace ed::watchdog
+{
+    class MonitoredThread final
+    {
+    public:
+        MonitoredThread(std::string name, bool isReportedToStderr)
+            : name_(std::move(name))
+            , isReportedToStderr_(isReportedToStderr)
+            , stallCounter_(metrics::Registry::Inst().GetCounter("soundscanner_thread_stalls_total",
+                "Work items that ran longer than the stall threshold, per monitored thread.",
+                fmt::format(R"(thread="{}")", name_)))
+        {
+        }
+
+        DISALLOW_COPY_MOVE(MonitoredThread);
+        ~MonitoredThread() = default;
+
+    private:
+        friend class StallWatchdog;
+        friend class ScopedActivity;
+        friend std::pair<const char*, std::chrono::nanoseconds> TakeSlowestActivity();
+
+        std::string name_;
+        bool isReportedToStderr_;
+        metrics::Counter& stallCounter_;
+
+        // Written by the owner thread only. The start time is stored before the activity on entry and after it
+        // on exit, so the watchdog, reading the activity first, can under- but never over-estimate a duration.
+        std::atomic<const char*> activity_{nullptr};
+        std::atomic<int64_t> activitySinceNs_{0};
+        // The start time of the activity already reported as stalled
+        int64_t reportedSinceNs_ = 0;
+
+        // Owner thread only: the longest activity since the last TakeSlowestActivity()
+        const char* slowestActivity_ = nullptr;
+        int64_t slowestDurationNs_ = 0;
+    };
+
+    namespace detail
+    {
+        inline thread_local MonitoredThread* currentThread = nullptr;
+
+        inline int64_t NowNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    class StallWatchdog final
+    {
+    public:
+        static StallWatchdog& Inst();
+
+        DISALLOW_COPY_MOVE(StallWatchdog);
+        ~StallWatchdog();
+
+        // 0 disables the checks; threads can register and mark activities either way
+        void Start(std::chrono::milliseconds stallThreshold);
+        void Stop();
+
+        [[nodiscard]] std::chrono::milliseconds GetStallThreshold() const;
+
+        MonitoredThread& Register(std::string name, bool isReportedToStderr);
+        void Unregister(const MonitoredThread& thread);
+
+    private:
+        StallWatchdog() = default;
+
+        struct StallReport
+        {
+            bool isReportedToStderr;
+            std::string message;
+        };
+
+        void ThreadFunction();
+        // Only collects the reports: logging under the lock would block a thread registering from a sink
+        void CollectStallsLocked(int64_t nowNs, std::vector<StallReport>& reports);
+
+    private:
+        std::mutex guard_;
+        std::condition_variable stopCondition_;
+        std::list<MonitoredThread> threads_;
+        std::atomic<int64_t> stallThresholdMs_{0};
+        bool isStopping_ = false;
+        std::thread thread_;
+    };
+
+    // Monitors the calling thread for its lifetime; logger threads report to stderr, as the logger may be stuck
+    class ScopedThreadRegistration final
+    {
+    public:
+        explicit ScopedThreadRegistration(std::string name, bool isReportedToStderr = false)
+            : thread_(StallWatchdog::Inst().Register(std::move(name), isReportedToStderr))
+        {
+            detail::currentThread = &thread_;
+        }
+
+        DISALLOW_COPY_MOVE(ScopedThreadRegistration);
+
+        ~ScopedThreadRegistration()
+        {
+            detail::currentThread = nullptr;
+            StallWatchdog::Inst().Unregister(thread_);
+        }
+
+    private:
+        MonitoredThread& thread_;
+    };
+
+    // For threads started by a library with start and stop hooks only (e.g. spdlog's pool workers): monitors the
+    // calling thread from RegisterCurrentThread() until UnregisterCurrentThread() on the same thread
+    void RegisterCurrentThread(std::string name, bool isReportedToStderr = false);
+    void UnregisterCurrentThread();
+
+    // Marks the work being done on the calling thread; a no-op on threads not registered
+    class ScopedActivity final
+    {
+    public:
+        explicit ScopedActivity(const char* activity)
+            : thread_(detail::currentThread)
+        {
+            if (thread_ == nullptr)
+            {
+                return;
+            }
+            previousActivity_ = thread_->activity_.load(std::memory_order_relaxed);
+            previousSinceNs_ = thread_->activitySinceNs_.load(std::memory_order_relaxed);
+            thread_->activitySinceNs_.store(detail::NowNs(), std::memory_order_release);
+            thread_->activity_.store(activity, std::memory_order_release);
+        }
+
+        DISALLOW_COPY_MOVE(ScopedActivity);
+
+        ~ScopedActivity()
+        {
+            if (thread_ == nullptr)
+            {
+                return;
+            }
+            const auto activity = thread_->activity_.load(std::memory_order_relaxed);
+            const auto durationNs = detail::NowNs() - thread_->activitySinceNs_.load(std::memory_order_relaxed);
+            if (durationNs > thread_->slowestDurationNs_)
+            {
+                thread_->slowestDurationNs_ = durationNs;
+                thread_->slowestActivity_ = activity;
+            }
+            thread_->activity_.store(previousActivity_, std::memory_order_release);
+            thread_->activitySinceNs_.store(previousSinceNs_, std::memory_order_release);
+        }
+
+    private:
+        MonitoredThread* thread_;
+        const char* previousActivity_ = nullptr;
+        int64_t previousSinceNs_ = 0;
+    };
+
+    // The longest activity of the calling (registered) thread since the previous call, then reset
+    inline std::pair<const char*, std::chrono::nanoseconds> TakeSlowestActivity()
+    {
+        auto* thread = detail::currentThread;
+        if (thread == nullptr)
+        {
+            return {nullptr, std::chrono::nanoseconds::zero()};
+        }
+        const std::pair<const char*, std::chrono::nanoseconds> result{
+            thread->slowestActivity_, std::chrono::nanoseconds(thread->slowestDurationNs_)
+        };
+        thread->slowestActivity_ = nullptr;
+        thread->slowestDurationNs_ = 0;
+        return result;
+    }
+}
+
+// Marks the enclosing function as the current activity of a monitored thread
+#define WATCHDOG_SCOPE() ed::watchdog::ScopedActivity CONCAT(watchdog_activity_, __LINE__)(__PRETTY_FUNCTION__)
+
+
+inline ed::watchdog::StallWatchdog& ed::watchdog::StallWatchdog::Inst()
+{
+    // Never destroyed: threads of other singletons (e.g. the log writer) unregister during static destruction
+    static auto* instance = new StallWatchdog();
+    return *instance;
+}
+
+inline ed::watchdog::StallWatchdog::~StallWatchdog()
+{
+    Stop();
+}
+
+inline void ed::watchdog::StallWatchdog::Start(std::chrono::milliseconds stallThreshold)
+{
+    Stop();
+    stallThresholdMs_.store(stallThreshold.count());
+    if (stallThreshold.count() <= 0)
+    {
+        return;
+    }
+
+    std::lock_guard lock(guard_);
+    isStopping_ = false;
+    thread_ = std::thread(&StallWatchdog::ThreadFunction, this);
+}
+
+inline void ed::watchdog::StallWatchdog::Stop()
+{
+    {
+        std::lock_guard lock(guard_);
+        isStopping_ = true;
+    }
+    stopCondition_.notify_all();
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+inline std::chrono::milliseconds ed::watchdog::StallWatchdog::GetStallThreshold() const
+{
+    return std::chrono::milliseconds(stallThresholdMs_.load());
+}
+
+inline ed::watchdog::MonitoredThread& ed::watchdog::StallWatchdog::Register(std::string name, bool isReportedToStderr)
+{
+    std::lock_guard lock(guard_);
+    return threads_.emplace_back(std::move(name), isReportedToStderr);
+}
+
+inline void ed::watchdog::StallWatchdog::Unregister(const MonitoredThread& thread)
+{
+    std::lock_guard lock(guard_);
+    threads_.remove_if([&thread](const MonitoredThread& candidate) { return &candidate == &thread; });
+}
+
+inline void ed::watchdog::StallWatchdog::ThreadFunction()
+{
+    const auto checkInterval = std::max(GetStallThreshold() / 4, std::chrono::milliseconds(10));
+    std::vector<StallReport> reports;
+    std::unique_lock lock(guard_);
+    while (!stopCondition_.wait_for(lock, checkInterval, [this] { return isStopping_; }))
+    {
+        CollectStallsLocked(detail::NowNs(), reports);
+        if (reports.empty())
+        {
+            continue;
+        }
+
+        lock.unlock();
+        for (const auto& report : reports)
+        {
+            if (report.isReportedToStderr)
+            {
+                std::cerr << report.message << std::endl;
+            }
+            else
+            {
+                spdlog::warn(report.message);
+            }
+        }
+        reports.clear();
+        lock.lock();
+    }
+}
+
+inline void ed::watchdog::StallWatchdog::CollectStallsLocked(int64_t nowNs, std::vector<StallReport>& reports)
+{
+    const auto thresholdNs = stallThresholdMs_.load() * 1000000;
+    for (auto& thread : threads_)
+    {
+        const auto* activity = thread.activity_.load(std::memory_order_acquire);
+        const auto sinceNs = thread.activitySinceNs_.load(std::memory_order_acquire);
+        if (activity == nullptr || nowNs - sinceNs <= thresholdNs || thread.reportedSinceNs_ == sinceNs)
+        {
+            continue;
+        }
+
+        thread.reportedSinceNs_ = sinceNs;
+        thread.stallCounter_.Increment();
+        reports.push_back({thread.isReportedToStderr_, fmt::format("Thread \"{}\" has been stalled for {} ms in {}.",
+                                                                   thread.name_, (nowNs - sinceNs) / 1000000, activity)});
+    }
+}
+
+inline void ed::watchdog::RegisterCurrentThread(std::string name, bool isReportedToStderr)
+{
+    UnregisterCurrentThread();
+    detail::currentThread = &StallWatchdog::Inst().Register(std::move(name), isReportedToStderr);
+}
+
+inline void ed::watchdog::UnregisterCurrentThread()
+{
+    if (auto* thread = std::exchange(detail::currentThread, nullptr); thread != nullptr)
+    {
+        StallWatchdog::Inst().Unregister(*thread);
+    }
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include "ClassDefHelper.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <ctime>
+#include <unistd.h>
+
+namespace ed
+{
+    // Critical path of the process start. The main thread ends its phases in sequence; other threads
+    // (the PulseAudio mainloop, the RabbitMQ confirms) mark milestones once, measured from the process start.
+    // Phase durations are exported as soundscanner_startup_phase_milliseconds{phase="..."},
+    // milestones as soundscanner_startup_milestone_milliseconds{milestone="..."}.
+    class StartupTrace final
+    {
+    public:
+        static constexpr auto MILESTONE_PULSE_AUDIO_READY = "PulseAudio context ready";
+        static constexpr auto MILESTONE_INVENTORY_COLLECTED = "initial inventory collected";
+        static constexpr auto MILESTONE_INVENTORY_DISPATCHED = "initial inventory dispatched";
+        static constexpr auto MILESTONE_INVENTORY_CONFIRMED = "initial inventory confirmed";
+
+        using CompletionCallback = std::function<void(const std::string& report)>;
+
+        static StartupTrace& Inst();
+
+        DISALLOW_COPY_MOVE(StartupTrace);
+        ~StartupTrace() = default;
+
+        // Records the time since the previous phase ended; the first phase starts when the process is executed
+        void EndPhase(std::string_view name);
+        // Records the time since the process start, once per milestone
+        void MarkMilestone(std::string_view name);
+        // The callback is invoked with the report when the milestone is marked (at once, if it already is)
+        void SetFinalMilestone(std::string_view name, CompletionCallback onComplete);
+
+        // The initial inventory is dispatched as one message per device. Numbers the next one from 1;
+        // 0 once the inventory is complete, i.e. for the devices reported again after a reconnect.
+        uint64_t AddInventoryMessage();
+        // Called by the collection after its last inventory device: the observers dispatch synchronously,
+        // so the last inventory message is dispatched as well. An empty inventory has nothing to confirm.
+        void CompleteInventory();
+        // Called on a broker confirm of an inventory message. The lanes of a producer pool confirm out of order,
+        // so the confirmed milestone is marked once every inventory message is confirmed, not the last-numbered one.
+        void ConfirmInventoryMessage(uint64_t number);
+
+        [[nodiscard]] std::string Render() const;
+
+    private:
+        struct Entry
+        {
+            std::string name;
+            std::chrono::microseconds duration; // Phase: its duration; milestone: since the process start
+        };
+
+        StartupTrace();
+
+        // The steady clock time the kernel started the process, so loading and static initialization are included
+        static std::chrono::steady_clock::time_point GetProcessStartTime();
+
+        [[nodiscard]] bool IsMarkedLocked(std::string_view name) const;
+        [[nodiscard]] std::string RenderLocked() const;
+
+    private:
+        mutable std::mutex guard_;
+        std::chrono::steady_clock::time_point startTime_;
+        std::chrono::steady_clock::time_point lastPhaseEndTime_;
+        std::vector<Entry> phases_;
+        std::vector<Entry> milestones_;
+        std::string finalMilestone_;
+        CompletionCallback onComplete_;
+        uint64_t inventoryMessageCount_ = 0;
+        // May reach the count before the inventory is complete
+        uint64_t confirmedInventoryMessageCount_ = 0;
+        bool isInventoryComplete_ = false;
+    };
+}
+
+inline ed::StartupTrace& ed::StartupTrace::Inst()
+{
+    static StartupTrace instance;
+    return instance;
+}
+
+inline ed::StartupTrace::StartupTrace()
+    : startTime_(GetProcessStartTime())
+    , lastPhaseEndTime_(startTime_)
+{
+}
+
+inline std::chrono::steady_clock::time_point ed::StartupTrace::GetProcessStartTime()
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    // Field 22 of /proc/self/stat: the start time in clock ticks after boot; the command (field 2) may hold spaces
+    std::ifstream statFile("/proc/self/stat");
+    std::string stat((std::istreambuf_iterator<char>(statFile)), std::istreambuf_iterator<char>());
+    const auto commandEnd = stat.rfind(')');
+    timespec bootTime{};
+    const auto ticksPerSecond = sysconf(_SC_CLK_TCK);
+    if (commandEnd == std::string::npos || ticksPerSecond <= 0 || clock_gettime(CLOCK_BOOTTIME, &bootTime) != 0)
+    {
+        return now;
+    }
+
+    std::istringstream fields(stat.substr(commandEnd + 2));
+    std::string field;
+    for (int fieldNumber = 3; fieldNumber < 22 && fields >> field; ++fieldNumber)
+    {
+    }
+    unsigned long long startTicks = 0;
+    if (!(fields >> startTicks))
+    {
+        return now;
+    }
+
+    const auto sinceBoot = std::chrono::seconds(bootTime.tv_sec) + std::chrono::nanoseconds(bootTime.tv_nsec);
+    const auto startSinceBoot = std::chrono::microseconds(startTicks * 1000000ULL / ticksPerSecond);
+    const auto elapsed = std::chrono::duration_cast<std::chrono::steady_clock::duration>(sinceBoot - startSinceBoot);
+    return elapsed > std::chrono::steady_clock::duration::zero() ? now - elapsed : now;
+}
+
+inline void ed::StartupTrace::EndPhase(std::string_view name)
+{
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard lock(guard_);
+    const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(now - lastPhaseEndTime_);
+    lastPhaseEndTime_ = now;
+    phases_.push_back({std::string(name), duration});
+
+    metrics::Registry::Inst().GetGauge("soundscanner_startup_phase_milliseconds",
+        "Duration of a startup phase on the main thread.", fmt::format(R"(phase="{}")", name))
+        .Set(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
+}
+
+inline void ed::StartupTrace::MarkMilestone(std::string_view name)
+{
+    const auto now = std::chrono::steady_clock::now();
+    CompletionCallback onComplete;
+    std::string report;
+    {
+        std::lock_guard lock(guard_);
+        if (IsMarkedLocked(name))
+        {
+            return;
+        }
+        const auto sinceStart = std::chrono::duration_cast<std::chrono::microseconds>(now - startTime_);
+        milestones_.push_back({std::string(name), sinceStart});
+
+        metrics::Registry::Inst().GetGauge("soundscanner_startup_milestone_milliseconds",
+            "Time from the process start to a startup milestone.", fmt::format(R"(milestone="{}")", name))
+            .Set(std::chrono::duration_cast<std::chrono::milliseconds>(sinceStart).count());
+
+        if (name == finalMilestone_ && onComplete_)
+        {
+            onComplete = std::move(onComplete_);
+            onComplete_ = nullptr;
+            report = RenderLocked();
+        }
+    }
+    if (onComplete)
+    {
+        onComplete(report);
+    }
+}
+
+inline void ed::StartupTrace::SetFinalMilestone(std::string_view name, CompletionCallback onComplete)
+{
+    std::string report;
+    {
+        std::lock_guard lock(guard_);
+        finalMilestone_ = name;
+        if (!IsMarkedLocked(name))
+        {
+            onComplete_ = std::move(onComplete);
+            return;
+        }
+        onComplete_ = nullptr;
+        report = RenderLocked();
+    }
+    if (onComplete)
+    {
+        onComplete(report);
+    }
+}
+
+inline uint64_t ed::StartupTrace::AddInventoryMessage()
+{
+    std::lock_guard lock(guard_);
+    if (isInventoryComplete_)
+    {
+        return 0;
+    }
+    return ++inventoryMessageCount_;
+}
+
+inline void ed::StartupTrace::CompleteInventory()
+{
+    bool isConfirmed = false;
+    {
+        std::lock_guard lock(guard_);
+        if (isInventoryComplete_)
+        {
+            return;
+        }
+        isInventoryComplete_ = true;
+        isConfirmed = confirmedInventoryMessageCount_ == inventoryMessageCount_;
+    }
+    MarkMilestone(MILESTONE_INVENTORY_COLLECTED);
+    MarkMilestone(MILESTONE_INVENTORY_DISPATCHED);
+    if (isConfirmed)
+    {
+        MarkMilestone(MILESTONE_INVENTORY_CONFIRMED);
+    }
+}
+
+inline void ed::StartupTrace::ConfirmInventoryMessage(uint64_t number)
+{
+    {
+        std::lock_guard lock(guard_);
+        if (number == 0 || number > inventoryMessageCount_
+            || ++confirmedInventoryMessageCount_ != inventoryMessageCount_ || !isInventoryComplete_)
+        {
+            return;
+        }
+    }
+    MarkMilestone(MILESTONE_INVENTORY_CONFIRMED);
+}
+
+inline std::string ed::StartupTrace::Render() const
+{
+    std::lock_guard lock(guard_);
+    return RenderLocked();
+}
+
+inline bool ed::StartupTrace::IsMarkedLocked(std::string_view name) const
+{
+    return std::ranges::any_of(milestones_, [name](const Entry& milestone) { return milestone.name == name; });
+}
+
+inline std::string ed::StartupTrace::RenderLocked() const
+{
+    constexpr auto toMilliseconds = [](std::chrono::microseconds duration)
+    {
+        return static_cast<double>(duration.count()) / 1000.0;
+    };
+
+    std::string report = "Startup phases (main thread, in order):\n";
+    std::chrono::microseconds total{0};
+    for (const auto& phase : phases_)
+    {
+        total += phase.duration;
+        report += fmt::format("  {:<40} {:>10.1f} ms\n", phase.name, toMilliseconds(phase.duration));
+    }
+    report += fmt::format("  {:<40} {:>10.1f} ms\n", "total", toMilliseconds(total));
+
+    report += "Startup milestones (since the process start):\n";
+    for (const auto& milestone : milestones_)
+    {
+        report += fmt::format("  {:<40} {:>10.1f} ms\n", milestone.name, toMilliseconds(milestone.duration));
+    }
+    if (!finalMilestone_.empty() && !IsMarkedLocked(finalMilestone_))
+    {
+        report += fmt::format("  {:<40} {:>13}\n", finalMilestone_, "not reached");
+    }
+    return report;
+}
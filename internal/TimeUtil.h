@@ -1,7 +1,11 @@
 ﻿#pragma once
 
 #include <fmt/chrono.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <ctime>
+#include <limits>
 #include <string>
 
 namespace ed
@@ -51,41 +55,176 @@ namespace ed
         return tm;
     }
 
-    inline std::string TimePointToString(const std::chrono::system_clock::time_point& timePoint,
-        bool utcOrLocal,
-        bool insertTBetweenDateAndTime,
-        bool addTimeZone)
+    // Formats "YYYY-MM-DD HH:MM:SS.ffffff" (optionally with 'T' and a "Z" / "+hh:mm" zone suffix)
+    // into a caller-provided buffer. The date-time prefix is cached per second and the local UTC offset
+    // per zone transition, so a call within the same second only writes the sub-second digits.
+    // Not thread-safe; use one instance per thread, see ThreadLocalTimestampFormatter.
+    class CachedTimestampFormatter final
     {
-        const auto timeT = std::chrono::system_clock::to_time_t(timePoint);
-        const auto timeTm = ToTm(timeT, utcOrLocal);
+    public:
+        static constexpr size_t MAX_LENGTH = 33; // "YYYY-MM-DDTHH:MM:SS.ffffff+hh:mm" + '\0'
 
-        // Microseconds
-        const auto sinceEpoch = timePoint.time_since_epoch();
-        const auto microSec = std::chrono::duration_cast<std::chrono::microseconds>(sinceEpoch).count() % 1000000;
+        CachedTimestampFormatter(bool utcOrLocal, bool insertTBetweenDateAndTime, bool addTimeZone)
+            : utcOrLocal_(utcOrLocal)
+            , insertTBetweenDateAndTime_(insertTBetweenDateAndTime)
+            , addTimeZone_(addTimeZone)
+        {
+        }
 
-        std::string timeAsString;
-        if (insertTBetweenDateAndTime)
+        // Writes at most MAX_LENGTH bytes including the terminating '\0'; returns the length without it
+        size_t Format(const std::chrono::system_clock::time_point& timePoint, char* buffer)
         {
-            timeAsString = fmt::format("{:%Y-%m-%dT%H:%M:%S}.{:06d}", timeTm, microSec);
+            using namespace std::chrono;
+
+            const auto sinceEpochMicroSec = duration_cast<microseconds>(timePoint.time_since_epoch()).count();
+            auto epochSecond = sinceEpochMicroSec / 1000000;
+            auto microSec = sinceEpochMicroSec % 1000000;
+            if (microSec < 0)
+            {
+                microSec += 1000000;
+                --epochSecond;
+            }
+
+            if (epochSecond != cachedEpochSecond_)
+            {
+                RefreshPrefix(epochSecond);
+            }
+
+            std::memcpy(buffer, prefix_, PREFIX_LENGTH);
+            auto* cursor = buffer + PREFIX_LENGTH;
+            *cursor++ = '.';
+            for (auto* digit = cursor + 5; digit >= cursor; --digit)
+            {
+                *digit = static_cast<char>('0' + microSec % 10);
+                microSec /= 10;
+            }
+            cursor += 6;
+            std::memcpy(cursor, zoneSuffix_, zoneSuffixLength_);
+            cursor += zoneSuffixLength_;
+            *cursor = '\0';
+            return static_cast<size_t>(cursor - buffer);
         }
-        else
+
+        std::string Format(const std::chrono::system_clock::time_point& timePoint)
         {
-            timeAsString = fmt::format("{:%Y-%m-%d %H:%M:%S}.{:06d}", timeTm, microSec);
+            char buffer[MAX_LENGTH];
+            const auto length = Format(timePoint, buffer);
+            return {buffer, length};
         }
 
-        if (addTimeZone)
+    private:
+        static constexpr size_t PREFIX_LENGTH = 19; // "YYYY-MM-DDTHH:MM:SS"
+
+        void RefreshPrefix(int64_t epochSecond)
         {
-            if (utcOrLocal)
+            using namespace std::chrono;
+
+            const sys_seconds sysSecond{seconds(epochSecond)};
+            auto civilSecond = sysSecond;
+            if (!utcOrLocal_)
             {
-                timeAsString += "Z";
+                if (sysSecond < zoneValidFrom_ || sysSecond >= zoneValidUntil_)
+                {
+                    RefreshZone(sysSecond);
+                }
+                civilSecond += zoneOffset_;
             }
-            else
+            else if (zoneSuffixLength_ == 0 && addTimeZone_)
             {
-                timeAsString += LocalUtcOffsetString(timePoint);
+                zoneSuffix_[0] = 'Z';
+                zoneSuffixLength_ = 1;
             }
+
+            const auto dayPoint = floor<days>(civilSecond);
+            const year_month_day ymd{dayPoint};
+            const hh_mm_ss hms{civilSecond - dayPoint};
+
+            WriteDigits(prefix_, static_cast<int>(ymd.year()), 4);
+            prefix_[4] = '-';
+            WriteDigits(prefix_ + 5, static_cast<int>(static_cast<unsigned>(ymd.month())), 2);
+            prefix_[7] = '-';
+            WriteDigits(prefix_ + 8, static_cast<int>(static_cast<unsigned>(ymd.day())), 2);
+            prefix_[10] = insertTBetweenDateAndTime_ ? 'T' : ' ';
+            WriteDigits(prefix_ + 11, static_cast<int>(hms.hours().count()), 2);
+            prefix_[13] = ':';
+            WriteDigits(prefix_ + 14, static_cast<int>(hms.minutes().count()), 2);
+            prefix_[16] = ':';
+            WriteDigits(prefix_ + 17, static_cast<int>(hms.seconds().count()), 2);
+
+            cachedEpochSecond_ = epochSecond;
         }
 
-        return timeAsString;
+        void RefreshZone(const std::chrono::sys_seconds& sysSecond)
+        {
+            using namespace std::chrono;
+
+            if (timeZone_ == nullptr)
+            {
+                timeZone_ = current_zone();
+            }
+            const auto info = timeZone_->get_info(sysSecond);
+            zoneValidFrom_ = info.begin;
+            zoneValidUntil_ = info.end;
+            zoneOffset_ = info.offset;
+
+            zoneSuffixLength_ = 0;
+            if (addTimeZone_)
+            {
+                auto totalMinutes = duration_cast<minutes>(zoneOffset_).count();
+                zoneSuffix_[0] = totalMinutes < 0 ? '-' : '+';
+                if (totalMinutes < 0)
+                {
+                    totalMinutes = -totalMinutes;
+                }
+                WriteDigits(zoneSuffix_ + 1, static_cast<int>(totalMinutes / 60), 2);
+                zoneSuffix_[3] = ':';
+                WriteDigits(zoneSuffix_ + 4, static_cast<int>(totalMinutes % 60), 2);
+                zoneSuffixLength_ = 6;
+            }
+        }
+
+        static void WriteDigits(char* buffer, int value, int width)
+        {
+            for (auto* digit = buffer + width - 1; digit >= buffer; --digit)
+            {
+                *digit = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+        }
+
+    private:
+        bool utcOrLocal_;
+        bool insertTBetweenDateAndTime_;
+        bool addTimeZone_;
+
+        int64_t cachedEpochSecond_ = std::numeric_limits<int64_t>::min();
+        char prefix_[PREFIX_LENGTH] = {};
+
+        const std::chrono::time_zone* timeZone_ = nullptr;
+        std::chrono::sys_seconds zoneValidFrom_ = std::chrono::sys_seconds::max();
+        std::chrono::sys_seconds zoneValidUntil_ = std::chrono::sys_seconds::min();
+        std::chrono::seconds zoneOffset_{0};
+        char zoneSuffix_[6] = {};
+        size_t zoneSuffixLength_ = 0;
+    };
+
+    inline CachedTimestampFormatter& ThreadLocalTimestampFormatter(bool utcOrLocal,
+        bool insertTBetweenDateAndTime,
+        bool addTimeZone)
+    {
+        thread_local CachedTimestampFormatter formatters[] = {
+            {false, false, false}, {false, false, true}, {false, true, false}, {false, true, true},
+            {true, false, false}, {true, false, true}, {true, true, false}, {true, true, true}
+        };
+        return formatters[(utcOrLocal ? 4 : 0) + (insertTBetweenDateAndTime ? 2 : 0) + (addTimeZone ? 1 : 0)];
+    }
+
+    inline std::string TimePointToString(const std::chrono::system_clock::time_point& timePoint,
+        bool utcOrLocal,
+        bool insertTBetweenDateAndTime,
+        bool addTimeZone)
+    {
+        return ThreadLocalTimestampFormatter(utcOrLocal, insertTBetweenDateAndTime, addTimeZone).Format(timePoint);
     }
 
     inline std::string TimePointToStringAsUtc(const std::chrono::system_clock::time_point& timePoint,
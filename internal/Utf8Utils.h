@@ -0,0 +1,182 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+
+namespace ed
+{
+    namespace utf8_detail
+    {
+        // Index of the first byte >= 0x80; vectorized, since device strings are mostly ASCII
+        inline size_t FindFirstNonAscii(const unsigned char* data, size_t size)
+        {
+            size_t i = 0;
+#if defined(__AVX2__)
+            for (; i + 32 <= size; i += 32)
+            {
+                const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                if (const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(chunk)); mask != 0)
+                {
+                    return i + std::countr_zero(mask);
+                }
+            }
+#endif
+#if defined(__SSE2__) || defined(__AVX2__)
+            for (; i + 16 <= size; i += 16)
+            {
+                const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                if (const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(chunk)); mask != 0)
+                {
+                    return i + std::countr_zero(mask);
+                }
+            }
+#endif
+            for (; i + 8 <= size; i += 8)
+            {
+                uint64_t word;
+                std::memcpy(&word, data + i, sizeof(word));
+                if ((word & 0x8080808080808080ULL) != 0)
+                {
+                    break;
+                }
+            }
+            for (; i < size; ++i)
+            {
+                if (data[i] >= 0x80)
+                {
+                    return i;
+                }
+            }
+            return size;
+        }
+
+        // Length of the well-formed sequence starting at data[0] (a non-ASCII lead byte), or 0 if it is
+        // ill-formed; maximalSubpartLength then receives the number of bytes to replace (Unicode 3.9, U+FFFD policy)
+        inline size_t DecodeSequence(const unsigned char* data, size_t size, size_t& maximalSubpartLength)
+        {
+            const unsigned char lead = data[0];
+            size_t length;
+            unsigned char secondMin = 0x80;
+            unsigned char secondMax = 0xBF;
+            if (lead >= 0xC2 && lead <= 0xDF)
+            {
+                length = 2;
+            }
+            else if (lead >= 0xE0 && lead <= 0xEF)
+            {
+                length = 3;
+                secondMin = lead == 0xE0 ? 0xA0 : 0x80;
+                secondMax = lead == 0xED ? 0x9F : 0xBF;
+            }
+            else if (lead >= 0xF0 && lead <= 0xF4)
+            {
+                length = 4;
+                secondMin = lead == 0xF0 ? 0x90 : 0x80;
+                secondMax = lead == 0xF4 ? 0x8F : 0xBF;
+            }
+            else
+            {
+                maximalSubpartLength = 1;
+                return 0;
+            }
+
+            for (size_t i = 1; i < length; ++i)
+            {
+                const unsigned char min = i == 1 ? secondMin : 0x80;
+                const unsigned char max = i == 1 ? secondMax : 0xBF;
+                if (i >= size || data[i] < min || data[i] > max)
+                {
+                    maximalSubpartLength = i;
+                    return 0;
+                }
+            }
+            return length;
+        }
+    }
+
+    // Offset of the first ill-formed byte, or std::string_view::npos if the text is valid UTF-8
+    inline size_t FindFirstInvalidUtf8(std::string_view text)
+    {
+        const auto* data = reinterpret_cast<const unsigned char*>(text.data());
+        const auto size = text.size();
+
+        size_t i = 0;
+        while (i < size)
+        {
+            i += utf8_detail::FindFirstNonAscii(data + i, size - i);
+            // Validate the non-ASCII run byte by byte, then return to the vectorized scan
+            while (i < size && data[i] >= 0x80)
+            {
+                size_t maximalSubpartLength = 0;
+                const auto length = utf8_detail::DecodeSequence(data + i, size - i, maximalSubpartLength);
+                if (length == 0)
+                {
+                    return i;
+                }
+                i += length;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    inline bool IsValidUtf8(std::string_view text)
+    {
+        return FindFirstInvalidUtf8(text) == std::string_view::npos;
+    }
+
+    // Replaces every maximal ill-formed subsequence with U+FFFD, the way nlohmann::json's
+    // error_handler_t::replace does; returns false if the text had to be changed
+    inline bool SanitizeUtf8(std::string& text)
+    {
+        auto invalidPos = FindFirstInvalidUtf8(text);
+        if (invalidPos == std::string_view::npos)
+        {
+            return true;
+        }
+
+        constexpr std::string_view REPLACEMENT_CHARACTER = "\xEF\xBF\xBD";
+
+        const auto* data = reinterpret_cast<const unsigned char*>(text.data());
+        const auto size = text.size();
+
+        std::string sanitized;
+        sanitized.reserve(size + 2 * REPLACEMENT_CHARACTER.size());
+        sanitized.append(text, 0, invalidPos);
+
+        size_t i = invalidPos;
+        while (i < size)
+        {
+            if (data[i] < 0x80)
+            {
+                const auto asciiLength = utf8_detail::FindFirstNonAscii(data + i, size - i);
+                sanitized.append(text, i, asciiLength);
+                i += asciiLength;
+                continue;
+            }
+
+            size_t maximalSubpartLength = 0;
+            if (const auto length = utf8_detail::DecodeSequence(data + i, size - i, maximalSubpartLength);
+                length != 0)
+            {
+                sanitized.append(text, i, length);
+                i += length;
+            }
+            else
+            {
+                sanitized.append(REPLACEMENT_CHARACTER);
+                i += maximalSubpartLength;
+            }
+        }
+
+        text = std::move(sanitized);
+        return false;
+    }
+}
@@ -1,15 +1,24 @@
 ﻿#pragma once
 
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "../internal//ClassDefHelper.h"
 
 
 class SoundDeviceCollectionInterface;
 class DeviceCollectionObserver;
+class SoundDeviceEventAwaiter;
 class SoundDeviceInterface;
 class SoundDeviceObserverInterface;
+class SoundDeviceVisitorInterface;
 
 enum class SoundDeviceEventType : uint8_t {
     Confirmed = 0,
@@ -26,6 +35,25 @@ enum class SoundDeviceFlowType : uint8_t {
     RenderAndCapture
 };
 
+enum class SoundDeviceChangeLogStatus : uint8_t {
+    Ok = 0,
+    ResyncRequired // The requested version is older than the change log keeps, re-enumerate the collection
+};
+
+struct SoundDeviceEvent {
+    SoundDeviceEventType type = SoundDeviceEventType::Confirmed;
+    std::string devicePnpId;
+};
+
+// A plain copy of a device's state; reusing one record across reads reuses its string capacity
+struct DeviceRecord {
+    std::string pnpId;
+    std::string name;
+    SoundDeviceFlowType flow = SoundDeviceFlowType::None;
+    uint16_t renderVolume = 0; // 0 to 1000
+    uint16_t captureVolume = 0; // 0 to 1000
+};
+
 class SoundAgent final {
 public:
     static std::unique_ptr<SoundDeviceCollectionInterface> CreateDeviceCollection();
@@ -40,17 +68,70 @@ public:
     virtual size_t GetSize() const = 0;
     virtual std::unique_ptr<SoundDeviceInterface> CreateItem(size_t deviceNumber) const = 0;
     virtual std::unique_ptr<SoundDeviceInterface> CreateItem(const std::string& devicePnpId) const = 0;
+    // Non-throwing lookup; returns false if the device is not in the collection
+    virtual bool TryFind(const std::string& devicePnpId, DeviceRecord& record) const = 0;
+    // Visits the devices in place, without copying; references are valid during Visit only
+    virtual void ForEachDevice(SoundDeviceVisitorInterface& visitor) const = 0;
+
+    // Monotonic, incremented on every device change; thread-safe
+    virtual uint64_t GetVersion() const = 0;
+    // Collects the distinct PnP ids changed after sinceVersion; thread-safe
+    virtual SoundDeviceChangeLogStatus GetChangesSince(uint64_t sinceVersion,
+        std::vector<std::string>& changedDevicePnpIds, uint64_t& currentVersion) const = 0;
 
 	virtual void ActivateAndStartLoop() = 0;
 	virtual void DeactivateAndStopLoop() = 0;
+    // Runs the handler on the loop thread, not in signal context, when the signal arrives;
+    // effective at once, a signal received before the loop starts is handled when it does
+    virtual void AddSignalHandler(int signalNumber, std::function<void()> handler) = 0;
 
     virtual void Subscribe(SoundDeviceObserverInterface& observer) = 0;
     virtual void Unsubscribe(SoundDeviceObserverInterface& observer) = 0;
 
+    // In a coroutine on the loop thread (e.g. returning ed::coro::Task), co_await NextEvent() resumes,
+    // from the loop, with the next collection change; nullopt if the timeout expires first.
+    // Changes are queued from the first call on, so none is missed between two awaits; one coroutine awaits at a time
+    SoundDeviceEventAwaiter NextEvent(std::chrono::milliseconds timeout = std::chrono::milliseconds::max());
+    // Takes a queued change without waiting, e.g. to drain a batch; also starts the queueing
+    virtual bool TryTakeEvent(SoundDeviceEvent& event) = 0;
+    // Resumes the consumer on the loop once a change is queued or the timeout expires
+    virtual void ResumeOnEvent(std::coroutine_handle<> consumer, std::chrono::milliseconds timeout) = 0;
+
     AS_INTERFACE(SoundDeviceCollectionInterface);
     DISALLOW_COPY_MOVE(SoundDeviceCollectionInterface);
 };
 
+class SoundDeviceEventAwaiter final {
+public:
+    SoundDeviceEventAwaiter(SoundDeviceCollectionInterface& collection, std::chrono::milliseconds timeout)
+        : collection_(collection)
+        , timeout_(timeout)
+    {
+    }
+
+    bool await_ready() { isTaken_ = collection_.TryTakeEvent(event_); return isTaken_; }
+    void await_suspend(std::coroutine_handle<> consumer) { collection_.ResumeOnEvent(consumer, timeout_); }
+    std::optional<SoundDeviceEvent> await_resume()
+    {
+        if (!isTaken_ && !collection_.TryTakeEvent(event_))
+        {
+            return std::nullopt;
+        }
+        return std::move(event_);
+    }
+
+private:
+    SoundDeviceCollectionInterface& collection_;
+    std::chrono::milliseconds timeout_;
+    SoundDeviceEvent event_;
+    bool isTaken_ = false;
+};
+
+inline SoundDeviceEventAwaiter SoundDeviceCollectionInterface::NextEvent(std::chrono::milliseconds timeout)
+{
+    return {*this, timeout};
+}
+
 class SoundDeviceObserverInterface {
 public:
     virtual void OnCollectionChanged(SoundDeviceEventType event, const std::string& devicePnpId) = 0;
@@ -60,14 +141,30 @@ public:
 };
 
 
+// Strings are validated (ill-formed sequences replaced) when they enter the library,
+// so GetName and GetPnpId always return valid UTF-8 and serializers need not re-check them
 class SoundDeviceInterface {
 public:
-    virtual std::string GetName() const = 0;
-    virtual std::string GetPnpId() const = 0;
+    // Views are valid as long as the device object is
+    virtual std::string_view GetNameView() const = 0;
+    virtual std::string_view GetPnpIdView() const = 0;
     virtual SoundDeviceFlowType GetFlow() const = 0;
     virtual uint16_t GetCurrentRenderVolume() const = 0; // 0 to 1000
     virtual uint16_t GetCurrentCaptureVolume() const = 0;
+    // Copies all fields in one call
+    virtual void Read(DeviceRecord& record) const = 0;
+
+    std::string GetName() const { return std::string(GetNameView()); }
+    std::string GetPnpId() const { return std::string(GetPnpIdView()); }
 
     AS_INTERFACE(SoundDeviceInterface);
     DISALLOW_COPY_MOVE(SoundDeviceInterface);
 };
+
+class SoundDeviceVisitorInterface {
+public:
+    virtual void Visit(const SoundDeviceInterface& device) = 0;
+
+    AS_INTERFACE(SoundDeviceVisitorInterface);
+    DISALLOW_COPY_MOVE(SoundDeviceVisitorInterface);
+};
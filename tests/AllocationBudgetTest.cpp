@@ -0,0 +1,128 @@
+#include "os-dependencies.h"
+
+#include "ServiceObserver.h"
+#include "HttpRequestDispatcherInterface.h"
+
+#include "internal/AllocationAccounting.h"
+
+#include <spdlog/spdlog.h>
+
+#include <cstdlib>
+#include <iostream>
+
+// Runs device events through ServiceObserver and AudioDeviceApiClient, with a collection and a dispatcher
+// that do not allocate, and checks the allocations per event of their stages against the budgets below.
+// PulseDeviceCollection and RequestPublisher need a PulseAudio server and a broker; they are not covered here.
+namespace
+{
+    // Allocations per event after the warm-up, as measured; an event is a POST or a PUT, half of each.
+    // ServiceObserver builds the hint prefix of a POST (1). AudioDeviceApiClient builds the payload (1),
+    // the hint (2) and, for a PUT, the URL suffix (2).
+    constexpr double SERVICE_OBSERVER_BUDGET = 0.5;
+    constexpr double AUDIO_DEVICE_API_CLIENT_BUDGET = 4.5;
+
+    constexpr size_t WARM_UP_EVENT_COUNT = 16;
+    constexpr size_t MEASURED_EVENT_COUNT = 10000;
+
+    class DeviceCollectionStub final : public SoundDeviceCollectionInterface
+    {
+    public:
+        [[nodiscard]] size_t GetSize() const override { return 1; }
+        [[nodiscard]] std::unique_ptr<SoundDeviceInterface> CreateItem(size_t) const override { return nullptr; }
+        [[nodiscard]] std::unique_ptr<SoundDeviceInterface> CreateItem(const std::string&) const override { return nullptr; }
+
+        bool TryFind(const std::string& devicePnpId, DeviceRecord& record) const override
+        {
+            record.pnpId = devicePnpId;
+            record.name = "Speakers (High Definition Audio Device with a long name)";
+            record.flow = SoundDeviceFlowType::Render;
+            record.renderVolume = 420;
+            record.captureVolume = 0;
+            return true;
+        }
+
+        void ForEachDevice(SoundDeviceVisitorInterface&) const override {}
+        [[nodiscard]] uint64_t GetVersion() const override { return 0; }
+        SoundDeviceChangeLogStatus GetChangesSince(uint64_t, std::vector<std::string>&, uint64_t& currentVersion) const override
+        {
+            currentVersion = 0;
+            return SoundDeviceChangeLogStatus::Ok;
+        }
+
+        void ActivateAndStartLoop() override {}
+        void DeactivateAndStopLoop() override {}
+        void AddSignalHandler(int, std::function<void()>) override {}
+        void Subscribe(SoundDeviceObserverInterface&) override {}
+        void Unsubscribe(SoundDeviceObserverInterface&) override {}
+        bool TryTakeEvent(SoundDeviceEvent&) override { return false; }
+        void ResumeOnEvent(std::coroutine_handle<>, std::chrono::milliseconds) override {}
+    };
+
+    class CountingDispatcher final : public HttpRequestDispatcherInterface
+    {
+    public:
+        void EnqueueRequest(bool, const std::string&, const std::string&, const std::string&,
+                            const std::string&) override
+        {
+            ++requestCount;
+        }
+
+        [[nodiscard]] bool IsUnderBackpressure() const override { return false; }
+        void Drain(std::chrono::steady_clock::time_point) override {}
+
+        size_t requestCount = 0;
+    };
+
+    bool CheckBudget(ed::allocation::Stage stage, const ed::allocation::StageStats& before, double budget)
+    {
+        const auto after = ed::allocation::GetStageStats(stage);
+        const auto perEvent = static_cast<double>(after.allocationCount - before.allocationCount)
+            / static_cast<double>(MEASURED_EVENT_COUNT);
+        const auto& label = ed::allocation::STAGE_LABELS[static_cast<size_t>(stage)];
+        std::cout << label << ": " << perEvent << " allocations per event, budget " << budget << '\n';
+        if (perEvent > budget)
+        {
+            std::cerr << label << " exceeds its allocation budget.\n";
+            return false;
+        }
+        return true;
+    }
+
+    void RunEvents(ServiceObserver& observer, size_t eventCount)
+    {
+        const std::string devicePnpId = "alsa_output.pci-0000_00_1f.3.analog-stereo";
+        for (size_t i = 0; i < eventCount; ++i)
+        {
+            observer.OnCollectionChanged(
+                i % 2 == 0 ? SoundDeviceEventType::Discovered : SoundDeviceEventType::VolumeRenderChanged, devicePnpId);
+        }
+    }
+}
+
+int main()
+{
+    // The per-event log lines are filtered out: their cost depends on the sinks, not on the event path
+    spdlog::set_level(spdlog::level::warn);
+
+    DeviceCollectionStub collection;
+    CountingDispatcher dispatcher;
+    ServiceObserver observer(collection, dispatcher);
+
+    // Grows the reused device record and the static host and OS names
+    RunEvents(observer, WARM_UP_EVENT_COUNT);
+
+    const auto observerBefore = ed::allocation::GetStageStats(ed::allocation::Stage::ServiceObserver);
+    const auto apiClientBefore = ed::allocation::GetStageStats(ed::allocation::Stage::AudioDeviceApiClient);
+    RunEvents(observer, MEASURED_EVENT_COUNT);
+
+    if (dispatcher.requestCount != WARM_UP_EVENT_COUNT + MEASURED_EVENT_COUNT)
+    {
+        std::cerr << "Expected one request per event, got " << dispatcher.requestCount << ".\n";
+        return EXIT_FAILURE;
+    }
+
+    const bool isWithinBudget =
+        CheckBudget(ed::allocation::Stage::ServiceObserver, observerBefore, SERVICE_OBSERVER_BUDGET)
+        & CheckBudget(ed::allocation::Stage::AudioDeviceApiClient, apiClientBefore, AUDIO_DEVICE_API_CLIENT_BUDGET);
+    return isWithinBudget ? EXIT_SUCCESS : EXIT_FAILURE;
+}
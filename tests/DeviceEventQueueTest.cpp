@@ -0,0 +1,172 @@
+#include "os-dependencies.h"
+
+#include "SoundLib/impl/DeviceEventQueue.h"
+
+#include "internal/Coroutine.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Runs the NextEvent consumer of the README on DeviceEventQueue, with a stand-in for the glib sources
+// PulseDeviceCollection uses to resume it, and checks the timeout, the drop of the oldest change and the teardown.
+namespace
+{
+    constexpr size_t CAPACITY = 1024;
+    constexpr std::chrono::milliseconds QUIET_PERIOD{200};
+
+    // Resumes the consumer like PulseDeviceCollection: on a queued change from an idle source, otherwise on its timeout
+    class ManualLoopCollection final : public SoundDeviceCollectionInterface
+    {
+    public:
+        [[nodiscard]] size_t GetSize() const override { return 0; }
+        [[nodiscard]] std::unique_ptr<SoundDeviceInterface> CreateItem(size_t) const override { return nullptr; }
+        [[nodiscard]] std::unique_ptr<SoundDeviceInterface> CreateItem(const std::string&) const override { return nullptr; }
+        bool TryFind(const std::string&, DeviceRecord&) const override { return false; }
+        void ForEachDevice(SoundDeviceVisitorInterface&) const override {}
+        [[nodiscard]] uint64_t GetVersion() const override { return 0; }
+        SoundDeviceChangeLogStatus GetChangesSince(uint64_t, std::vector<std::string>&, uint64_t& currentVersion) const override
+        {
+            currentVersion = 0;
+            return SoundDeviceChangeLogStatus::Ok;
+        }
+
+        void ActivateAndStartLoop() override {}
+        void DeactivateAndStopLoop() override {}
+        void AddSignalHandler(int, std::function<void()>) override {}
+        void Subscribe(SoundDeviceObserverInterface&) override {}
+        void Unsubscribe(SoundDeviceObserverInterface&) override {}
+
+        bool TryTakeEvent(SoundDeviceEvent& event) override { return queue.TryTake(event); }
+
+        void ResumeOnEvent(std::coroutine_handle<> consumer, std::chrono::milliseconds timeout) override
+        {
+            queue.SetConsumer(consumer);
+            isTimeoutPending = timeout != std::chrono::milliseconds::max();
+        }
+
+        void Change(size_t deviceNumber)
+        {
+            if (queue.IsOpen())
+            {
+                queue.Push(SoundDeviceEventType::VolumeRenderChanged, "device-" + std::to_string(deviceNumber));
+                isResumePending = queue.HasConsumer();
+            }
+        }
+
+        // One dispatch of the loop; returns false if nothing was due
+        bool Dispatch()
+        {
+            if (!isResumePending && !isTimeoutPending)
+            {
+                return false;
+            }
+            isResumePending = false;
+            isTimeoutPending = false;
+            queue.ResumeConsumer();
+            return true;
+        }
+
+        DeviceEventQueue queue{CAPACITY};
+        bool isResumePending = false;
+        bool isTimeoutPending = false;
+    };
+
+    // The batching consumer of the README
+    ed::coro::Task PublishBatches(SoundDeviceCollectionInterface& collection, std::vector<size_t>& batchSizes)
+    {
+        while (auto first = co_await collection.NextEvent())
+        {
+            std::vector<SoundDeviceEvent> batch{std::move(*first)};
+            while (auto next = co_await collection.NextEvent(QUIET_PERIOD))
+            {
+                batch.push_back(std::move(*next));
+            }
+            batchSizes.push_back(batch.size());
+        }
+    }
+
+    struct DestructionFlag
+    {
+        bool& isDestroyed;
+        ~DestructionFlag() { isDestroyed = true; }
+    };
+
+    ed::coro::Task AwaitForever(SoundDeviceCollectionInterface& collection, bool& isFrameDestroyed)
+    {
+        const DestructionFlag flag{isFrameDestroyed};
+        co_await collection.NextEvent();
+    }
+
+    bool Check(bool condition, const char* description)
+    {
+        std::cout << (condition ? "passed: " : "FAILED: ") << description << '\n';
+        return condition;
+    }
+}
+
+int main()
+{
+    bool isPassed = true;
+
+    {
+        ManualLoopCollection collection;
+        collection.Change(0);
+        isPassed &= Check(collection.queue.GetSize() == 0, "changes before the first take are not queued");
+
+        SoundDeviceEvent event;
+        collection.TryTakeEvent(event);
+        for (size_t i = 0; i < CAPACITY + 6; ++i)
+        {
+            collection.Change(i);
+        }
+        isPassed &= Check(collection.queue.GetDroppedCount() == 6 && collection.queue.GetSize() == CAPACITY,
+                          "a full queue drops the oldest changes and counts them");
+        isPassed &= Check(collection.TryTakeEvent(event) && event.devicePnpId == "device-6",
+                          "the oldest change kept is taken first");
+        while (collection.TryTakeEvent(event))
+        {
+        }
+
+        std::vector<size_t> batchSizes;
+        PublishBatches(collection, batchSizes);
+        isPassed &= Check(collection.queue.HasConsumer() && !collection.isTimeoutPending,
+                          "the consumer waits for the first change without a timeout");
+
+        for (size_t i = 0; i < 3; ++i)
+        {
+            collection.Change(i);
+        }
+        collection.Dispatch(); // The idle source: takes the three changes, then waits for the quiet period
+        isPassed &= Check(batchSizes.empty() && collection.isTimeoutPending,
+                          "the consumer waits for more changes with a timeout");
+
+        collection.Dispatch(); // The timeout source
+        isPassed &= Check(batchSizes == std::vector<size_t>{3}, "the timeout ends the batch of three");
+        isPassed &= Check(collection.queue.HasConsumer() && !collection.isTimeoutPending,
+                          "the consumer waits for the next batch");
+
+        bool isRejected = false;
+        try
+        {
+            collection.ResumeOnEvent(std::noop_coroutine(), std::chrono::milliseconds::max());
+        }
+        catch (const std::runtime_error&)
+        {
+            isRejected = true;
+        }
+        isPassed &= Check(isRejected, "a second consumer is rejected");
+    }
+
+    bool isFrameDestroyed = false;
+    {
+        ManualLoopCollection collection;
+        AwaitForever(collection, isFrameDestroyed);
+    }
+    isPassed &= Check(isFrameDestroyed, "the frame of a consumer never resumed is freed with the queue");
+
+    return isPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
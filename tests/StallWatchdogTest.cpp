@@ -0,0 +1,99 @@
+#include "os-dependencies.h"
+
+#include "internal/StallWatchdog.h"
+
+#include <spdlog/sinks/base_sink.h>
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Runs activities longer than the stall threshold on monitored threads and checks that each one is reported once,
+// that nothing is reported while the watchdog is disabled, and that a report is logged outside the watchdog lock.
+namespace
+{
+    constexpr std::chrono::milliseconds STALL_THRESHOLD{50};
+    constexpr std::chrono::milliseconds STALL_DURATION{300};
+    constexpr std::chrono::seconds REPORT_TIMEOUT{5};
+
+    // Registers a thread with the watchdog from inside the log call; if the watchdog logged under its lock, this would
+    // deadlock it and the test would hang until the ctest timeout
+    class RegisteringSink final : public spdlog::sinks::base_sink<std::mutex>
+    {
+    public:
+        std::atomic<size_t> messageCount{0};
+
+    protected:
+        void sink_it_(const spdlog::details::log_msg&) override
+        {
+            const ed::watchdog::ScopedThreadRegistration registration("test-sink");
+            ++messageCount;
+        }
+
+        void flush_() override {}
+    };
+
+    uint64_t GetStallCount(const std::string& threadName)
+    {
+        return ed::metrics::Registry::Inst().GetCounter("soundscanner_thread_stalls_total", "",
+            fmt::format(R"(thread="{}")", threadName)).GetValue();
+    }
+
+    void RunStalledActivity(const std::string& threadName)
+    {
+        std::thread([&threadName] {
+            const ed::watchdog::ScopedThreadRegistration registration(threadName);
+            const ed::watchdog::ScopedActivity activity("StalledActivity");
+            std::this_thread::sleep_for(STALL_DURATION);
+        }).join();
+    }
+
+    bool Check(bool condition, const char* description)
+    {
+        std::cout << (condition ? "passed: " : "FAILED: ") << description << '\n';
+        return condition;
+    }
+}
+
+int main()
+{
+    const auto sink = std::make_shared<RegisteringSink>();
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("test", sink));
+    auto& watchdog = ed::watchdog::StallWatchdog::Inst();
+    bool isPassed = true;
+
+    watchdog.Start(std::chrono::milliseconds::zero());
+    RunStalledActivity("test-disabled");
+    isPassed &= Check(GetStallCount("test-disabled") == 0, "no report while the watchdog is disabled");
+
+    // As a reload does
+    watchdog.Start(STALL_THRESHOLD);
+    RunStalledActivity("test-enabled");
+    isPassed &= Check(GetStallCount("test-enabled") == 1, "one report of a stalled activity after enabling");
+
+    const auto deadline = std::chrono::steady_clock::now() + REPORT_TIMEOUT;
+    while (sink->messageCount.load() == 0 && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    isPassed &= Check(sink->messageCount.load() == 1, "the report is logged outside the watchdog lock");
+
+    std::thread([] {
+        ed::watchdog::RegisterCurrentThread("test-hooked", true);
+        {
+            const ed::watchdog::ScopedActivity activity("StalledActivity");
+            std::this_thread::sleep_for(STALL_DURATION);
+        }
+        ed::watchdog::UnregisterCurrentThread();
+    }).join();
+    isPassed &= Check(GetStallCount("test-hooked") == 1, "one report of a thread registered through the hooks");
+    isPassed &= Check(sink->messageCount.load() == 1, "a stderr thread's report is not logged");
+
+    watchdog.Stop();
+    return isPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}